@@ -0,0 +1,161 @@
+#include "audiocapture.h"
+#include "levelmeter.h"
+
+#include <QAudioDeviceInfo>
+#include <QAudioInput>
+#include <QIODevice>
+
+AudioCapture::AudioCapture(RingBuffer<qint16> *buffer, QObject *parent) :
+    QObject(parent),
+    m_buffer(buffer),
+    m_meter(0),
+    m_input(0),
+    m_device(0)
+{
+    m_format.setSampleRate(16000);
+    m_format.setChannelCount(1);
+    m_format.setSampleSize(16);
+    m_format.setSampleType(QAudioFormat::SignedInt);
+    m_format.setByteOrder(QAudioFormat::LittleEndian);
+    m_format.setCodec("audio/pcm");
+}
+
+AudioCapture::~AudioCapture()
+{
+    delete m_input;
+}
+
+int AudioCapture::nativeSampleRate()
+{
+    const QAudioDeviceInfo device = QAudioDeviceInfo::defaultInputDevice();
+    QAudioFormat format;
+    format.setChannelCount(1);
+    format.setSampleSize(16);
+    format.setSampleType(QAudioFormat::SignedInt);
+    format.setByteOrder(QAudioFormat::LittleEndian);
+    format.setCodec("audio/pcm");
+
+    const int rates[] = { device.preferredFormat().sampleRate(), 48000, 44100, 16000 };
+    for (int i = 0; i < 4; ++i) {
+        format.setSampleRate(rates[i]);
+        if (rates[i] > 0 && device.isFormatSupported(format))
+            return rates[i];
+    }
+    return 16000;
+}
+
+QAudioFormat AudioCapture::format() const
+{
+    return m_format;
+}
+
+void AudioCapture::setFormat(const QAudioFormat &format)
+{
+    m_format = format;
+}
+
+LevelMeter *AudioCapture::levelMeter() const
+{
+    return m_meter;
+}
+
+void AudioCapture::setLevelMeter(LevelMeter *meter)
+{
+    m_meter = meter;
+}
+
+void AudioCapture::acknowledge()
+{
+    m_notifyPending.storeRelease(0);
+}
+
+int AudioCapture::overruns() const
+{
+    return m_overruns.load();
+}
+
+void AudioCapture::start()
+{
+    if (m_input)
+        return;
+
+    const QAudioDeviceInfo device = QAudioDeviceInfo::defaultInputDevice();
+    if (!device.isFormatSupported(m_format)) {
+        emit error(QAudio::OpenError);
+        emit stateChanged(QAudio::StoppedState);
+        return;
+    }
+
+    m_input = new QAudioInput(device, m_format, this);
+    // Small periods keep the capture-to-upload delay short.
+    m_input->setBufferSize(m_format.bytesForDuration(100 * 1000));
+    connect(m_input, SIGNAL(stateChanged(QAudio::State)),
+            this, SLOT(_q_stateChanged(QAudio::State)));
+
+    m_device = m_input->start();
+    connect(m_device, SIGNAL(readyRead()), this, SLOT(_q_readyRead()));
+}
+
+void AudioCapture::stop()
+{
+    if (!m_input)
+        return;
+
+    // Collect whatever the device still holds before tearing it down.
+    _q_readyRead();
+
+    m_input->disconnect(this);
+    m_input->stop();
+    m_input->deleteLater();
+    m_input = 0;
+    m_device = 0;
+
+    emit stateChanged(QAudio::StoppedState);
+}
+
+void AudioCapture::suspend()
+{
+    if (m_input)
+        m_input->suspend();
+}
+
+void AudioCapture::resume()
+{
+    if (m_input)
+        m_input->resume();
+}
+
+void AudioCapture::_q_readyRead()
+{
+    if (!m_device)
+        return;
+
+    char block[4096];
+    qint64 size;
+    while ((size = m_device->read(block, sizeof(block))) > 0)
+        push(block, int(size));
+}
+
+void AudioCapture::push(const char *data, int size)
+{
+    const int count = size / int(sizeof(qint16));
+    if (m_meter)
+        m_meter->process(reinterpret_cast<const qint16 *>(data), count);
+
+    if (m_buffer->write(reinterpret_cast<const qint16 *>(data), count) < count)
+        m_overruns.ref();
+
+    if (m_notifyPending.testAndSetOrdered(0, 1))
+        emit dataAvailable();
+}
+
+void AudioCapture::_q_stateChanged(QAudio::State state)
+{
+    if (state == QAudio::StoppedState && m_input->error() != QAudio::NoError) {
+        emit error(m_input->error());
+        stop();
+        return;
+    }
+
+    emit stateChanged(state);
+}
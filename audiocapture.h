@@ -0,0 +1,74 @@
+#ifndef AUDIOCAPTURE_H
+#define AUDIOCAPTURE_H
+
+#include <QObject>
+#include <QAtomicInt>
+#include <QAudio>
+#include <QAudioFormat>
+
+#include "ringbuffer.h"
+
+class LevelMeter;
+
+class QAudioInput;
+class QIODevice;
+
+// Captures 16-bit mono PCM with QAudioInput and pushes it into a lock-free
+// ring buffer. Meant to live on its own thread: the input is created in
+// start() so that it belongs to whichever thread the capture was moved to,
+// and consumers are told about new data through dataAvailable(), which is
+// emitted at most once until they call acknowledge().
+class AudioCapture : public QObject
+{
+    Q_OBJECT
+
+public:
+    AudioCapture(RingBuffer<qint16> *buffer, QObject *parent = 0);
+    ~AudioCapture();
+
+    // The default input device's preferred rate if it can capture 16-bit
+    // mono there, else the first common rate it supports.
+    static int nativeSampleRate();
+
+    // Must only be changed while the capture is stopped.
+    QAudioFormat format() const;
+    void setFormat(const QAudioFormat &format);
+
+    // Measured on the capture thread for every buffer before it is queued;
+    // must only be changed while the capture is stopped.
+    LevelMeter *levelMeter() const;
+    void setLevelMeter(LevelMeter *meter);
+
+    // Thread-safe.
+    void acknowledge();
+    int overruns() const;
+
+public Q_SLOTS:
+    void start();
+    void stop();
+    void suspend();
+    void resume();
+
+Q_SIGNALS:
+    void dataAvailable();
+    void stateChanged(int state);
+    void error(int error);
+
+private Q_SLOTS:
+    void _q_readyRead();
+    void _q_stateChanged(QAudio::State state);
+
+private:
+    void push(const char *data, int size);
+
+    RingBuffer<qint16> *m_buffer;
+    LevelMeter *m_meter;
+    QAudioFormat m_format;
+    QAudioInput *m_input;
+    QIODevice *m_device;
+
+    QAtomicInt m_notifyPending;
+    QAtomicInt m_overruns;
+};
+
+#endif // AUDIOCAPTURE_H
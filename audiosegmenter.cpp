@@ -0,0 +1,94 @@
+#include "audiosegmenter.h"
+#include "dspkernels.h"
+
+#include <math.h>
+#include <string.h>
+
+namespace {
+
+// Frames of pause that end a segment once it is a quarter of the limit.
+const int kLongPause = 20;
+// A frame this far above the noise floor, in dB, is not a pause.
+const float kQuietMargin = 6.0f;
+// Frames averaged into the first noise floor estimate.
+const int kCalibrationFrames = 10;
+
+}
+
+AudioSegmenter::AudioSegmenter(int sampleRate, int maxLength) :
+    m_sampleRate(sampleRate),
+    m_maxLength(maxLength),
+    m_frameSize(sampleRate / 50),
+    m_maxFrames(qMax(maxLength / 20, 4)),
+    m_frame(sampleRate / 50)
+{
+    reset();
+}
+
+int AudioSegmenter::sampleRate() const
+{
+    return m_sampleRate;
+}
+
+int AudioSegmenter::maxLength() const
+{
+    return m_maxLength;
+}
+
+void AudioSegmenter::reset()
+{
+    m_frameFill = 0;
+    m_noiseFloor = 0.0f;
+    m_framesSeen = 0;
+    m_segmentFrames = 0;
+    m_quietFrames = 0;
+}
+
+bool AudioSegmenter::isQuiet(const qint16 *frame)
+{
+    const float energy = 10.0f * log10f(Dsp::meanSquare(frame, m_frameSize) + 1.0f);
+    if (m_framesSeen < kCalibrationFrames) {
+        m_noiseFloor += (energy - m_noiseFloor) / (m_framesSeen + 1);
+        ++m_framesSeen;
+    } else if (energy < m_noiseFloor) {
+        // Follow a falling floor quickly, a rising one slowly, so a long
+        // stretch of speech does not become the floor.
+        m_noiseFloor += (energy - m_noiseFloor) * 0.3f;
+    } else {
+        m_noiseFloor += (energy - m_noiseFloor) * 0.002f;
+    }
+    return energy < m_noiseFloor + kQuietMargin;
+}
+
+int AudioSegmenter::process(const qint16 *samples, int count)
+{
+    int offset = 0;
+    while (offset < count) {
+        const int take = qMin(count - offset, m_frameSize - m_frameFill);
+        memcpy(m_frame.data() + m_frameFill, samples + offset, take * sizeof(qint16));
+        m_frameFill += take;
+        offset += take;
+        if (m_frameFill < m_frameSize)
+            break;
+        m_frameFill = 0;
+
+        ++m_segmentFrames;
+        m_quietFrames = isQuiet(m_frame.constData()) ? m_quietFrames + 1 : 0;
+
+        // The pause asked for falls from kLongPause at a quarter of the
+        // limit to one frame at the limit itself.
+        const int earliest = m_maxFrames / 4;
+        bool cut = m_segmentFrames >= m_maxFrames;
+        if (!cut && m_segmentFrames >= earliest && m_quietFrames > 0) {
+            const int left = m_maxFrames - m_segmentFrames;
+            const int pause = qMax(1, kLongPause * left / (m_maxFrames - earliest));
+            cut = m_quietFrames >= pause;
+        }
+        if (cut) {
+            m_segmentFrames = 0;
+            m_quietFrames = 0;
+            return offset;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,47 @@
+#ifndef AUDIOSEGMENTER_H
+#define AUDIOSEGMENTER_H
+
+#include <QVector>
+
+// Chooses where to split a long recording of 16-bit mono PCM so that every
+// segment stays under a length limit and, where possible, ends in a pause.
+// Frames of 20 ms are compared against a running noise floor; once a
+// segment is a quarter of the limit long, a pause of 400 ms ends it, and
+// the pause needed shrinks as the limit approaches, down to a single quiet
+// frame. At the limit the segment is cut regardless.
+class AudioSegmenter
+{
+public:
+    // |maxLength| in milliseconds.
+    AudioSegmenter(int sampleRate, int maxLength);
+
+    int sampleRate() const;
+    int maxLength() const;
+
+    // Scans |count| samples and returns the offset where the current
+    // segment ends, or -1 if it goes on past them. The next segment starts
+    // at that offset; the caller passes the rest again.
+    int process(const qint16 *samples, int count);
+
+    void reset();
+
+private:
+    bool isQuiet(const qint16 *frame);
+
+    int m_sampleRate;
+    int m_maxLength;
+    int m_frameSize;
+    int m_maxFrames;
+
+    QVector<qint16> m_frame;
+    int m_frameFill;
+
+    // Noise floor in dB, and how far into the segment and its current
+    // pause the last frame was.
+    float m_noiseFloor;
+    int m_framesSeen;
+    int m_segmentFrames;
+    int m_quietFrames;
+};
+
+#endif // AUDIOSEGMENTER_H
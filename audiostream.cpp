@@ -0,0 +1,100 @@
+#include "audiostream.h"
+
+AudioStream::AudioStream(QObject *parent) :
+    QIODevice(parent),
+    m_contentType("audio/x-flac; rate=8000"),
+    m_readPos(0),
+    m_finished(false)
+{
+    open(QIODevice::ReadWrite | QIODevice::Unbuffered);
+}
+
+AudioStream::~AudioStream()
+{
+}
+
+QByteArray AudioStream::contentType() const
+{
+    return m_contentType;
+}
+
+void AudioStream::setContentType(const QByteArray &contentType)
+{
+    m_contentType = contentType;
+}
+
+bool AudioStream::isFinished() const
+{
+    return m_finished;
+}
+
+LatencyTrace AudioStream::trace() const
+{
+    return m_trace;
+}
+
+void AudioStream::mark(LatencyTrace::Stage stage)
+{
+    m_trace.mark(stage);
+}
+
+bool AudioStream::isSequential() const
+{
+    return true;
+}
+
+qint64 AudioStream::bytesAvailable() const
+{
+    return (m_buffer.size() - m_readPos) + QIODevice::bytesAvailable();
+}
+
+bool AudioStream::atEnd() const
+{
+    return m_finished && bytesAvailable() == 0;
+}
+
+void AudioStream::finish()
+{
+    if (m_finished)
+        return;
+
+    m_finished = true;
+    emit readChannelFinished();
+    emit finished();
+}
+
+qint64 AudioStream::readData(char *data, qint64 maxSize)
+{
+    const int available = m_buffer.size() - m_readPos;
+    if (available == 0)
+        return m_finished ? -1 : 0;
+
+    const int count = int(qMin(qint64(available), maxSize));
+    memcpy(data, m_buffer.constData() + m_readPos, count);
+    m_readPos += count;
+
+    // Drop consumed bytes once they make up most of the buffer, so a long
+    // utterance does not keep everything already uploaded in memory.
+    if (m_readPos == m_buffer.size()) {
+        m_buffer.clear();
+        m_readPos = 0;
+    } else if (m_readPos > 64 * 1024 && m_readPos > m_buffer.size() / 2) {
+        m_buffer.remove(0, m_readPos);
+        m_readPos = 0;
+    }
+
+    return count;
+}
+
+qint64 AudioStream::writeData(const char *data, qint64 maxSize)
+{
+    if (m_finished)
+        return -1;
+
+    if (maxSize <= 0)
+        return 0;
+
+    m_buffer.append(data, int(maxSize));
+    emit readyRead();
+    return maxSize;
+}
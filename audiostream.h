@@ -0,0 +1,52 @@
+#ifndef AUDIOSTREAM_H
+#define AUDIOSTREAM_H
+
+#include <QIODevice>
+#include <QByteArray>
+
+#include "latencytrace.h"
+
+// A sequential, open-ended device carrying encoded audio from the recorder
+// to the recognizer. The producer writes frames as they are encoded and
+// calls finish() once the utterance is complete; the consumer reads whatever
+// is available and treats atEnd() as the end of the upload.
+class AudioStream : public QIODevice
+{
+    Q_OBJECT
+
+public:
+    AudioStream(QObject *parent = 0);
+    ~AudioStream();
+
+    QByteArray contentType() const;
+    void setContentType(const QByteArray &contentType);
+
+    bool isFinished() const;
+
+    // Recorder stages of the utterance, picked up by the recognizer.
+    LatencyTrace trace() const;
+    void mark(LatencyTrace::Stage stage);
+
+    bool isSequential() const;
+    qint64 bytesAvailable() const;
+    bool atEnd() const;
+
+public Q_SLOTS:
+    void finish();
+
+Q_SIGNALS:
+    void finished();
+
+protected:
+    qint64 readData(char *data, qint64 maxSize);
+    qint64 writeData(const char *data, qint64 maxSize);
+
+private:
+    QByteArray m_contentType;
+    QByteArray m_buffer;
+    int m_readPos;
+    bool m_finished;
+    LatencyTrace m_trace;
+};
+
+#endif // AUDIOSTREAM_H
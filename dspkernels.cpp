@@ -0,0 +1,434 @@
+#include "dspkernels.h"
+
+#include <math.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// Polynomial approximation of log2 on the mantissa in [1, 2), good to about
+// 1e-4; the SIMD and scalar paths use the same one so they agree exactly.
+inline float fastLog2(float value)
+{
+    union { float f; quint32 i; } bits;
+    bits.f = value;
+    const float exponent = float(int((bits.i >> 23) & 0xff) - 127);
+    bits.i = (bits.i & 0x007fffff) | 0x3f800000;
+    const float m = bits.f;
+    return exponent + (-2.5128774f + (4.070135f + (-2.1206994f + (0.64514372f - 0.081614486f * m) * m) * m) * m);
+}
+
+#ifdef __SSE2__
+inline __m128 fastLog2(__m128 value)
+{
+    const __m128i bits = _mm_castps_si128(value);
+    const __m128 exponent = _mm_cvtepi32_ps(_mm_sub_epi32(
+        _mm_and_si128(_mm_srli_epi32(bits, 23), _mm_set1_epi32(0xff)), _mm_set1_epi32(127)));
+    const __m128 m = _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x007fffff)),
+                                                   _mm_set1_epi32(0x3f800000)));
+    __m128 p = _mm_sub_ps(_mm_set1_ps(0.64514372f), _mm_mul_ps(_mm_set1_ps(0.081614486f), m));
+    p = _mm_add_ps(_mm_set1_ps(-2.1206994f), _mm_mul_ps(p, m));
+    p = _mm_add_ps(_mm_set1_ps(4.070135f), _mm_mul_ps(p, m));
+    p = _mm_add_ps(_mm_set1_ps(-2.5128774f), _mm_mul_ps(p, m));
+    return _mm_add_ps(exponent, p);
+}
+
+inline float horizontalSum(__m128 v)
+{
+    float lanes[4];
+    _mm_storeu_ps(lanes, v);
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+}
+
+inline __m128 loadSamples(const qint16 *x)
+{
+    const __m128i v = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(x));
+    return _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16));
+}
+#endif
+
+}
+
+namespace Dsp {
+
+void autocorrelation(const float *x, int n, int maxLag, double *autoc)
+{
+    for (int lag = 0; lag <= maxLag; ++lag) {
+        int i = lag;
+        double sum = 0.0;
+#ifdef __SSE2__
+        __m128 acc = _mm_setzero_ps();
+        for (; i + 4 <= n; i += 4)
+            acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(x + i),
+                                             _mm_loadu_ps(x + i - lag)));
+        float lanes[4];
+        _mm_storeu_ps(lanes, acc);
+        sum = double(lanes[0]) + lanes[1] + lanes[2] + lanes[3];
+#endif
+        for (; i < n; ++i)
+            sum += double(x[i]) * x[i - lag];
+        autoc[lag] = sum;
+    }
+}
+
+void lpcResidual(const qint32 *x, int n, const qint32 *coeffs, int order,
+                 int shift, qint32 *residual)
+{
+    int i = order;
+#ifdef __SSE2__
+    // Samples are 16-bit values sign-extended into 32-bit lanes, so a
+    // multiply-add against (coefficient, 0) pairs yields exact 32-bit
+    // products without needing SSE4.1's _mm_mullo_epi32.
+    __m128i c[32];
+    for (int j = 0; j < order; ++j)
+        c[j] = _mm_set1_epi32(coeffs[j] & 0xffff);
+    const __m128i s = _mm_cvtsi32_si128(shift);
+
+    for (; i + 4 <= n; i += 4) {
+        __m128i sum = _mm_setzero_si128();
+        for (int j = 0; j < order; ++j) {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(x + i - j - 1));
+            sum = _mm_add_epi32(sum, _mm_madd_epi16(v, c[j]));
+        }
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(x + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(residual + i),
+                         _mm_sub_epi32(v, _mm_sra_epi32(sum, s)));
+    }
+#endif
+    for (; i < n; ++i) {
+        qint32 sum = 0;
+        for (int j = 0; j < order; ++j)
+            sum += coeffs[j] * x[i - j - 1];
+        residual[i] = x[i] - (sum >> shift);
+    }
+}
+
+quint32 foldedSum(const qint32 *residual, int n)
+{
+    int i = 0;
+    quint32 sum = 0;
+#ifdef __SSE2__
+    __m128i acc = _mm_setzero_si128();
+    for (; i + 4 <= n; i += 4) {
+        const __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i *>(residual + i));
+        acc = _mm_add_epi32(acc, _mm_xor_si128(_mm_slli_epi32(r, 1), _mm_srai_epi32(r, 31)));
+    }
+    quint32 lanes[4];
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(lanes), acc);
+    sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#endif
+    for (; i < n; ++i)
+        sum += (quint32(residual[i]) << 1) ^ quint32(residual[i] >> 31);
+    return sum;
+}
+
+float meanSquare(const qint16 *x, int n)
+{
+    if (n <= 0)
+        return 0.0f;
+
+    int i = 0;
+    float sum = 0.0f;
+#ifdef __SSE2__
+    __m128 acc = _mm_setzero_ps();
+    for (; i + 4 <= n; i += 4) {
+        const __m128 v = loadSamples(x + i);
+        acc = _mm_add_ps(acc, _mm_mul_ps(v, v));
+    }
+    sum = horizontalSum(acc);
+#endif
+    for (; i < n; ++i)
+        sum += float(x[i]) * x[i];
+    return sum / n;
+}
+
+void signalLevels(const qint16 *x, int n, float *sumSquares, int *peak, int *clipped)
+{
+    int i = 0;
+    float sum = 0.0f;
+    int maximum = 0;
+    int full = 0;
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i top = _mm_set1_epi16(32767);
+    __m128 acc = _mm_setzero_ps();
+    __m128i vmax = zero;
+    __m128i vfull = zero;
+    for (; i + 8 <= n; i += 8) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(x + i));
+        // The saturating negate maps -32768 to 32767.
+        const __m128i magnitude = _mm_max_epi16(v, _mm_subs_epi16(zero, v));
+        vmax = _mm_max_epi16(vmax, magnitude);
+        vfull = _mm_sub_epi16(vfull, _mm_cmpeq_epi16(magnitude, top));
+
+        const __m128 lo = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16));
+        const __m128 hi = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16));
+        acc = _mm_add_ps(acc, _mm_add_ps(_mm_mul_ps(lo, lo), _mm_mul_ps(hi, hi)));
+
+        if ((i & 0x1fff8) == 0x1fff8) {
+            // Flush before the 16-bit counters could overflow.
+            qint16 lanes[8];
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(lanes), vfull);
+            for (int l = 0; l < 8; ++l)
+                full += lanes[l];
+            vfull = zero;
+        }
+    }
+    sum = horizontalSum(acc);
+    qint16 lanes[8];
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(lanes), vmax);
+    for (int l = 0; l < 8; ++l)
+        maximum = qMax(maximum, int(lanes[l]));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(lanes), vfull);
+    for (int l = 0; l < 8; ++l)
+        full += lanes[l];
+#endif
+    for (; i < n; ++i) {
+        const int magnitude = qMin(qAbs(int(x[i])), 32767);
+        maximum = qMax(maximum, magnitude);
+        full += magnitude == 32767;
+        sum += float(x[i]) * x[i];
+    }
+
+    *sumSquares = sum;
+    *peak = maximum;
+    *clipped = full;
+}
+
+int zeroCrossings(const qint16 *x, int n)
+{
+    int i = 1;
+    int count = 0;
+#ifdef __SSE2__
+    // Lanes hold -1 where the sign differs from the previous sample.
+    __m128i acc = _mm_setzero_si128();
+    for (; i + 8 <= n; i += 8) {
+        const __m128i cur = _mm_srai_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(x + i)), 15);
+        const __m128i prev = _mm_srai_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(x + i - 1)), 15);
+        acc = _mm_sub_epi16(acc, _mm_xor_si128(cur, prev));
+        if ((i & 0x3fff) == 1) {
+            // Flush before the 16-bit lanes could overflow.
+            qint16 lanes[8];
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(lanes), acc);
+            for (int l = 0; l < 8; ++l)
+                count += lanes[l];
+            acc = _mm_setzero_si128();
+        }
+    }
+    qint16 lanes[8];
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(lanes), acc);
+    for (int l = 0; l < 8; ++l)
+        count += lanes[l];
+#endif
+    for (; i < n; ++i)
+        count += (x[i] < 0) != (x[i - 1] < 0);
+    return count;
+}
+
+void applyWindow(const qint16 *x, const float *window, int n, float *out)
+{
+    int i = 0;
+#ifdef __SSE2__
+    for (; i + 4 <= n; i += 4)
+        _mm_storeu_ps(out + i, _mm_mul_ps(loadSamples(x + i), _mm_loadu_ps(window + i)));
+#endif
+    for (; i < n; ++i)
+        out[i] = x[i] * window[i];
+}
+
+void multiply(const float *a, const float *b, int n, float *out)
+{
+    int i = 0;
+#ifdef __SSE2__
+    for (; i + 4 <= n; i += 4)
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+#endif
+    for (; i < n; ++i)
+        out[i] = a[i] * b[i];
+}
+
+void multiplyAdd(const float *a, const float *b, int n, float *out)
+{
+    int i = 0;
+#ifdef __SSE2__
+    for (; i + 4 <= n; i += 4)
+        _mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(out + i),
+                                          _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i))));
+#endif
+    for (; i < n; ++i)
+        out[i] += a[i] * b[i];
+}
+
+void powerSpectrum(const float *re, const float *im, int n, float *power)
+{
+    int i = 0;
+#ifdef __SSE2__
+    for (; i + 4 <= n; i += 4) {
+        const __m128 r = _mm_loadu_ps(re + i);
+        const __m128 m = _mm_loadu_ps(im + i);
+        _mm_storeu_ps(power + i, _mm_add_ps(_mm_mul_ps(r, r), _mm_mul_ps(m, m)));
+    }
+#endif
+    for (; i < n; ++i)
+        power[i] = re[i] * re[i] + im[i] * im[i];
+}
+
+void trackNoise(const float *power, int n, float smoothing, float bias, float rise,
+                float *smoothed, float *noise)
+{
+    const float rest = 1.0f - smoothing;
+    int i = 0;
+#ifdef __SSE2__
+    const __m128 vsmoothing = _mm_set1_ps(smoothing);
+    const __m128 vrest = _mm_set1_ps(rest);
+    const __m128 vbias = _mm_set1_ps(bias);
+    const __m128 vrise = _mm_set1_ps(rise);
+    for (; i + 4 <= n; i += 4) {
+        const __m128 s = _mm_add_ps(_mm_mul_ps(vsmoothing, _mm_loadu_ps(smoothed + i)),
+                                    _mm_mul_ps(vrest, _mm_loadu_ps(power + i)));
+        _mm_storeu_ps(smoothed + i, s);
+        _mm_storeu_ps(noise + i, _mm_min_ps(_mm_mul_ps(vbias, s),
+                                            _mm_mul_ps(vrise, _mm_loadu_ps(noise + i))));
+    }
+#endif
+    for (; i < n; ++i) {
+        smoothed[i] = smoothing * smoothed[i] + rest * power[i];
+        noise[i] = qMin(bias * smoothed[i], rise * noise[i]);
+    }
+}
+
+void wienerGain(const float *power, const float *noise, int n, float smoothing,
+                float floor, float *clean, float *gain)
+{
+    const float rest = 1.0f - smoothing;
+    int i = 0;
+#ifdef __SSE2__
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 vsmoothing = _mm_set1_ps(smoothing);
+    const __m128 vrest = _mm_set1_ps(rest);
+    const __m128 vfloor = _mm_set1_ps(floor);
+    for (; i + 4 <= n; i += 4) {
+        const __m128 p = _mm_loadu_ps(power + i);
+        const __m128 inverse = _mm_div_ps(one, _mm_max_ps(_mm_loadu_ps(noise + i), one));
+        const __m128 excess = _mm_max_ps(_mm_sub_ps(_mm_mul_ps(p, inverse), one), zero);
+        const __m128 snr = _mm_add_ps(_mm_mul_ps(vsmoothing, _mm_mul_ps(_mm_loadu_ps(clean + i), inverse)),
+                                      _mm_mul_ps(vrest, excess));
+        const __m128 g = _mm_max_ps(_mm_div_ps(snr, _mm_add_ps(one, snr)), vfloor);
+        _mm_storeu_ps(gain + i, g);
+        _mm_storeu_ps(clean + i, _mm_mul_ps(_mm_mul_ps(g, g), p));
+    }
+#endif
+    for (; i < n; ++i) {
+        const float inverse = 1.0f / qMax(noise[i], 1.0f);
+        const float excess = qMax(power[i] * inverse - 1.0f, 0.0f);
+        const float snr = smoothing * (clean[i] * inverse) + rest * excess;
+        const float g = qMax(snr / (1.0f + snr), floor);
+        gain[i] = g;
+        clean[i] = (g * g) * power[i];
+    }
+}
+
+float spectralFlatness(const float *power, int n)
+{
+    if (n <= 0)
+        return 0.0f;
+
+    // Keeps log2 finite for empty bins.
+    const float floor = 1e-3f;
+    int i = 0;
+    float logSum = 0.0f;
+    float sum = 0.0f;
+#ifdef __SSE2__
+    const __m128 vfloor = _mm_set1_ps(floor);
+    __m128 logAcc = _mm_setzero_ps();
+    __m128 acc = _mm_setzero_ps();
+    for (; i + 4 <= n; i += 4) {
+        const __m128 p = _mm_add_ps(_mm_loadu_ps(power + i), vfloor);
+        logAcc = _mm_add_ps(logAcc, fastLog2(p));
+        acc = _mm_add_ps(acc, p);
+    }
+    logSum = horizontalSum(logAcc);
+    sum = horizontalSum(acc);
+#endif
+    for (; i < n; ++i) {
+        const float p = power[i] + floor;
+        logSum += fastLog2(p);
+        sum += p;
+    }
+
+    const float arithmetic = sum / n;
+    return float(exp2(logSum / n)) / arithmetic;
+}
+
+void toBigEndian(const qint16 *x, int n, uchar *out)
+{
+    int i = 0;
+#ifdef __SSE2__
+    for (; i + 8 <= n; i += 8) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(x + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 2 * i),
+                         _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8)));
+    }
+#endif
+    for (; i < n; ++i) {
+        out[2 * i] = uchar(quint16(x[i]) >> 8);
+        out[2 * i + 1] = uchar(x[i]);
+    }
+}
+
+float dotProduct(const float *a, const float *b, int n)
+{
+    int i = 0;
+    float sum = 0.0f;
+#ifdef __SSE2__
+    // Two accumulators hide the add latency.
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+    for (; i + 8 <= n; i += 8) {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+    }
+    for (; i + 4 <= n; i += 4)
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    sum = horizontalSum(_mm_add_ps(acc0, acc1));
+#endif
+    for (; i < n; ++i)
+        sum += a[i] * b[i];
+    return sum;
+}
+
+void toFloat(const qint16 *x, int n, float *out)
+{
+    int i = 0;
+#ifdef __SSE2__
+    for (; i + 4 <= n; i += 4)
+        _mm_storeu_ps(out + i, loadSamples(x + i));
+#endif
+    for (; i < n; ++i)
+        out[i] = x[i];
+}
+
+void toInt16(const float *x, int n, qint16 *out)
+{
+    // Clamped while still float: past 2^31 the conversion yields INT_MIN,
+    // which would saturate to -32768 instead of 32767.
+    int i = 0;
+#ifdef __SSE2__
+    // cvtps rounds to nearest even under the default MXCSR.
+    const __m128 lowest = _mm_set1_ps(-32768.0f);
+    const __m128 highest = _mm_set1_ps(32767.0f);
+    for (; i + 8 <= n; i += 8) {
+        const __m128 a = _mm_max_ps(_mm_min_ps(_mm_loadu_ps(x + i), highest), lowest);
+        const __m128 b = _mm_max_ps(_mm_min_ps(_mm_loadu_ps(x + i + 4), highest), lowest);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i),
+                         _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b)));
+    }
+#endif
+    for (; i < n; ++i)
+        out[i] = qint16(lrintf(qBound(-32768.0f, x[i], 32767.0f)));
+}
+
+}
@@ -0,0 +1,77 @@
+#ifndef DSPKERNELS_H
+#define DSPKERNELS_H
+
+#include <QtGlobal>
+
+// Inner loops shared by the audio pipeline stages. Each kernel has an SSE2
+// path, selected at compile time, and a plain C++ fallback for other
+// architectures. Integer kernels agree exactly; float ones up to rounding.
+namespace Dsp {
+
+// autoc[lag] = sum x[i] * x[i - lag] for lag in [0, maxLag].
+void autocorrelation(const float *x, int n, int maxLag, double *autoc);
+
+// Linear prediction residual for 16-bit input held in 32-bit slots:
+// residual[i] = x[i] - (sum coeffs[j] * x[i - j - 1]) >> shift for i in
+// [order, n). Coefficients must fit in 16 bits.
+void lpcResidual(const qint32 *x, int n, const qint32 *coeffs, int order,
+                 int shift, qint32 *residual);
+
+// Sum of the zig-zag folded (Rice-mapped) values of |residual|.
+quint32 foldedSum(const qint32 *residual, int n);
+
+// Mean of x[i]^2, in squared sample units.
+float meanSquare(const qint16 *x, int n);
+
+// Sum of x[i]^2, the largest |x[i]| (with -32768 counted as 32767) and how
+// many samples sit at full scale, in one pass.
+void signalLevels(const qint16 *x, int n, float *sumSquares, int *peak, int *clipped);
+
+// Number of sign changes between consecutive samples.
+int zeroCrossings(const qint16 *x, int n);
+
+// out[i] = x[i] * window[i].
+void applyWindow(const qint16 *x, const float *window, int n, float *out);
+
+// out[i] = a[i] * b[i]; |out| may alias either input.
+void multiply(const float *a, const float *b, int n, float *out);
+
+// out[i] += a[i] * b[i].
+void multiplyAdd(const float *a, const float *b, int n, float *out);
+
+// power[k] = re[k]^2 + im[k]^2.
+void powerSpectrum(const float *re, const float *im, int n, float *power);
+
+// Minimum-tracking noise estimate: smoothed[k] keeps |smoothing| of its
+// old value and takes the rest from power[k]; noise[k] follows |bias|
+// times smoothed[k] down at once but rises by at most the factor |rise|.
+void trackNoise(const float *power, int n, float smoothing, float bias, float rise,
+                float *smoothed, float *noise);
+
+// Decision-directed Wiener gain: the a priori SNR of bin k takes
+// |smoothing| from the previous frame's clean power, clean[k], and the
+// rest from this frame's excess of power[k] over noise[k], which is
+// floored at 1. gain[k] = snr / (1 + snr), at least |floor|, and clean[k]
+// becomes gain[k]^2 * power[k] for the next frame.
+void wienerGain(const float *power, const float *noise, int n, float smoothing,
+                float floor, float *clean, float *gain);
+
+// Sum of a[i] * b[i].
+float dotProduct(const float *a, const float *b, int n);
+
+// out[i] = x[i], as float.
+void toFloat(const qint16 *x, int n, float *out);
+
+// out[i] = x[i] rounded to nearest and saturated to 16 bits.
+void toInt16(const float *x, int n, qint16 *out);
+
+// Writes |x| as big-endian 16-bit PCM (audio/l16) into 2 * n bytes.
+void toBigEndian(const qint16 *x, int n, uchar *out);
+
+// Geometric over arithmetic mean of |power|, in [0, 1]: close to 1 for
+// noise-like spectra and close to 0 for tonal or voiced ones.
+float spectralFlatness(const float *power, int n);
+
+}
+
+#endif // DSPKERNELS_H
@@ -0,0 +1,237 @@
+#include "featureextractor.h"
+#include "dspkernels.h"
+
+#include <math.h>
+#include <string.h>
+
+namespace {
+
+const int kFilters = 26;
+// Cepstral coefficients c1..c12; c0 only tracks loudness.
+const int kCoefficients = 12;
+const float kLowFrequency = 100.0f;
+const float kHighFrequency = 8000.0f;
+// Band energies are floored 30 dB below the frame's loudest band: those
+// bands mostly hold background noise, and flooring them keeps the
+// features from following the noise level.
+const float kBandFloor = 1e-3f;
+
+int nextPowerOfTwo(int value)
+{
+    int result = 1;
+    while (result < value)
+        result <<= 1;
+    return result;
+}
+
+float melFromHertz(float hertz)
+{
+    return 2595.0f * log10f(1.0f + hertz / 700.0f);
+}
+
+float hertzFromMel(float mel)
+{
+    return 700.0f * (powf(10.0f, mel / 2595.0f) - 1.0f);
+}
+
+}
+
+FeatureExtractor::FeatureExtractor(int sampleRate, int frameMsecs, int hopMsecs) :
+    m_sampleRate(sampleRate),
+    m_frameLength(sampleRate * frameMsecs / 1000),
+    m_hop(qMin(sampleRate * hopMsecs / 1000, sampleRate * frameMsecs / 1000)),
+    m_fft(nextPowerOfTwo(sampleRate * frameMsecs / 1000)),
+    m_window(sampleRate * frameMsecs / 1000),
+    m_dct(kCoefficients * kFilters),
+    m_history(sampleRate * frameMsecs / 1000),
+    m_features(0)
+{
+    for (int i = 0; i < m_frameLength; ++i)
+        m_window[i] = float(0.54 - 0.46 * cos(2.0 * M_PI * i / (m_frameLength - 1)));
+
+    // Triangular filters evenly spaced on the mel scale, stored as runs of
+    // weights over the bins each one covers. Frame timing and the mel scale
+    // are fixed in seconds and hertz, so features carry over between
+    // sample rates of 16 kHz and above.
+    const int bins = m_fft.size() / 2 + 1;
+    const float binWidth = float(sampleRate) / m_fft.size();
+    const float low = melFromHertz(kLowFrequency);
+    const float high = melFromHertz(qMin(kHighFrequency, sampleRate / 2.0f));
+    for (int m = 0; m < kFilters; ++m) {
+        const float left = hertzFromMel(low + (high - low) * m / (kFilters + 1)) / binWidth;
+        const float center = hertzFromMel(low + (high - low) * (m + 1) / (kFilters + 1)) / binWidth;
+        const float right = hertzFromMel(low + (high - low) * (m + 2) / (kFilters + 1)) / binWidth;
+
+        int first = int(ceilf(left));
+        int last = qMin(int(floorf(right)), bins - 1);
+        m_filterOffset.append(m_filterWeights.size());
+        if (last < first) {
+            // Narrower than a bin: take the nearest one whole.
+            first = last = qMin(int(center + 0.5f), bins - 1);
+            m_filterWeights.append(1.0f);
+        } else {
+            for (int k = first; k <= last; ++k) {
+                const float weight = k <= center ? (k - left) / (center - left)
+                                                 : (right - k) / (right - center);
+                m_filterWeights.append(qMax(weight, 0.0f));
+            }
+        }
+        m_filterStart.append(first);
+        m_filterLength.append(last - first + 1);
+    }
+
+    for (int c = 0; c < kCoefficients; ++c) {
+        for (int m = 0; m < kFilters; ++m)
+            m_dct[c * kFilters + m] = float(sqrt(2.0 / kFilters)
+                                            * cos(M_PI * (c + 1) * (m + 0.5) / kFilters));
+    }
+
+    // The window's zero padding past frameLength is never written.
+    m_block.fill(0.0f, m_fft.size() + 3 * bins + kFilters + kCoefficients);
+    m_windowed = m_block.data();
+    m_re = m_windowed + m_fft.size();
+    m_im = m_re + bins;
+    m_power = m_im + bins;
+    m_mel = m_power + bins;
+    m_mfcc = m_mel + kFilters;
+
+    m_frame.index = 0;
+    m_frame.samples = m_windowed;
+    m_frame.re = 0;
+    m_frame.im = 0;
+    m_frame.power = 0;
+    m_frame.bins = bins;
+    m_frame.mel = 0;
+    m_frame.mfcc = 0;
+    m_frame.energy = 0.0f;
+
+    reset();
+}
+
+int FeatureExtractor::sampleRate() const
+{
+    return m_sampleRate;
+}
+
+int FeatureExtractor::frameLength() const
+{
+    return m_frameLength;
+}
+
+int FeatureExtractor::hop() const
+{
+    return m_hop;
+}
+
+int FeatureExtractor::bins() const
+{
+    return m_fft.size() / 2 + 1;
+}
+
+int FeatureExtractor::filters()
+{
+    return kFilters;
+}
+
+int FeatureExtractor::coefficients()
+{
+    return kCoefficients;
+}
+
+void FeatureExtractor::addConsumer(FeatureConsumer *consumer, int features)
+{
+    m_consumers.append(consumer);
+    m_consumerFeatures.append(features);
+    updateFeatures();
+}
+
+void FeatureExtractor::removeConsumer(FeatureConsumer *consumer)
+{
+    for (int i = m_consumers.size() - 1; i >= 0; --i) {
+        if (m_consumers[i] == consumer) {
+            m_consumers.remove(i, 1);
+            m_consumerFeatures.remove(i, 1);
+        }
+    }
+    updateFeatures();
+}
+
+void FeatureExtractor::updateFeatures()
+{
+    m_features = 0;
+    for (int i = 0; i < m_consumerFeatures.size(); ++i)
+        m_features |= m_consumerFeatures[i];
+    // Each feature is computed from the one before it.
+    if (m_features & Mfcc)
+        m_features |= MelEnergies;
+    if (m_features & MelEnergies)
+        m_features |= Spectrum;
+
+    m_frame.re = m_features & Spectrum ? m_re : 0;
+    m_frame.im = m_features & Spectrum ? m_im : 0;
+    m_frame.power = m_features & Spectrum ? m_power : 0;
+    m_frame.mel = m_features & MelEnergies ? m_mel : 0;
+    m_frame.mfcc = m_features & Mfcc ? m_mfcc : 0;
+}
+
+void FeatureExtractor::reset()
+{
+    m_historyFill = 0;
+    m_frame.index = 0;
+}
+
+int FeatureExtractor::process(const qint16 *samples, int count)
+{
+    int offset = 0;
+    while (offset < count) {
+        const int take = qMin(count - offset, m_frameLength - m_historyFill);
+        Dsp::toFloat(samples + offset, take, m_history.data() + m_historyFill);
+        m_historyFill += take;
+        offset += take;
+        if (m_historyFill < m_frameLength)
+            break;
+
+        analyze();
+        // Frames overlap; keep what the next one shares with this one.
+        memmove(m_history.data(), m_history.constData() + m_hop,
+                (m_frameLength - m_hop) * sizeof(float));
+        m_historyFill = m_frameLength - m_hop;
+
+        bool stop = false;
+        for (int i = 0; i < m_consumers.size(); ++i)
+            stop = m_consumers[i]->consumeFrame(m_frame) || stop;
+        ++m_frame.index;
+        if (stop)
+            return offset;
+    }
+    return -1;
+}
+
+void FeatureExtractor::analyze()
+{
+    Dsp::multiply(m_history.constData(), m_window.constData(), m_frameLength, m_windowed);
+    m_frame.energy = logf(Dsp::dotProduct(m_windowed, m_windowed, m_frameLength) + 1.0f);
+    if (!(m_features & Spectrum))
+        return;
+
+    m_fft.forward(m_windowed, m_re, m_im);
+    Dsp::powerSpectrum(m_re, m_im, m_frame.bins, m_power);
+    if (!(m_features & MelEnergies))
+        return;
+
+    float loudest = 0.0f;
+    for (int m = 0; m < kFilters; ++m) {
+        m_mel[m] = Dsp::dotProduct(m_power + m_filterStart[m],
+                                   m_filterWeights.constData() + m_filterOffset[m],
+                                   m_filterLength[m]);
+        loudest = qMax(loudest, m_mel[m]);
+    }
+    const float floor = loudest * kBandFloor + 1.0f;
+    for (int m = 0; m < kFilters; ++m)
+        m_mel[m] = logf(qMax(m_mel[m], floor));
+    if (!(m_features & Mfcc))
+        return;
+
+    for (int c = 0; c < kCoefficients; ++c)
+        m_mfcc[c] = Dsp::dotProduct(m_dct.constData() + c * kFilters, m_mel, kFilters);
+}
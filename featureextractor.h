@@ -0,0 +1,111 @@
+#ifndef FEATUREEXTRACTOR_H
+#define FEATUREEXTRACTOR_H
+
+#include <QVector>
+
+#include "fft.h"
+
+// One analysis frame as handed to consumers. The arrays belong to the
+// extractor and are only valid during the call that delivers them; those
+// no consumer asked for are null.
+struct FeatureFrame
+{
+    // Frames since the last reset.
+    qint64 index;
+    // frameLength windowed samples.
+    const float *samples;
+    // bins complex bins and their power, DC to Nyquist.
+    const float *re;
+    const float *im;
+    const float *power;
+    int bins;
+    // Log mel band energies and cepstral coefficients c1 upwards.
+    const float *mel;
+    const float *mfcc;
+    // Log of the windowed frame's energy.
+    float energy;
+};
+
+class FeatureConsumer
+{
+public:
+    virtual ~FeatureConsumer() {}
+
+    // Returning true makes FeatureExtractor::process() stop right after
+    // this frame, so the caller can act on exactly that position.
+    virtual bool consumeFrame(const FeatureFrame &frame) = 0;
+};
+
+// Streaming spectral front end shared by the capture path's analyzers.
+// Samples are cut into overlapping Hamming-windowed frames; each frame is
+// transformed once, and its spectrum, mel energies and MFCCs are computed
+// only as far as some consumer needs, then handed to every consumer in
+// turn. The inner loops are the SIMD kernels in dspkernels.h, and one
+// frame's working set is a single contiguous block so it stays in cache
+// from the window to the last coefficient.
+class FeatureExtractor
+{
+public:
+    enum Feature {
+        Spectrum = 0x1,
+        MelEnergies = 0x2,
+        Mfcc = 0x4
+    };
+
+    FeatureExtractor(int sampleRate, int frameMsecs = 25, int hopMsecs = 10);
+
+    int sampleRate() const;
+    int frameLength() const;
+    int hop() const;
+    int bins() const;
+    static int filters();
+    static int coefficients();
+
+    // |features| is the Feature values |consumer| reads, ORed together.
+    void addConsumer(FeatureConsumer *consumer, int features);
+    void removeConsumer(FeatureConsumer *consumer);
+
+    // Buffers |count| samples and delivers every frame they complete.
+    // Returns the offset just past the frame a consumer stopped at, or -1
+    // once all of them were used.
+    int process(const qint16 *samples, int count);
+
+    void reset();
+
+private:
+    Q_DISABLE_COPY(FeatureExtractor)
+
+    void analyze();
+    void updateFeatures();
+
+    int m_sampleRate;
+    int m_frameLength;
+    int m_hop;
+
+    Fft m_fft;
+    QVector<float> m_window;
+    QVector<int> m_filterStart;
+    QVector<int> m_filterLength;
+    QVector<int> m_filterOffset;
+    QVector<float> m_filterWeights;
+    QVector<float> m_dct;
+
+    // [windowed | re | im | power | mel | mfcc] for the current frame.
+    QVector<float> m_block;
+    float *m_windowed;
+    float *m_re;
+    float *m_im;
+    float *m_power;
+    float *m_mel;
+    float *m_mfcc;
+    FeatureFrame m_frame;
+
+    QVector<float> m_history;
+    int m_historyFill;
+
+    QVector<FeatureConsumer *> m_consumers;
+    QVector<int> m_consumerFeatures;
+    int m_features;
+};
+
+#endif // FEATUREEXTRACTOR_H
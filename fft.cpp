@@ -0,0 +1,158 @@
+#include "fft.h"
+
+#include <math.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+Fft::Fft(int size) :
+    m_size(size),
+    m_half(size / 2),
+    m_bitReverse(size / 2),
+    m_stageCos(qMax(1, size / 2 - 1)),
+    m_stageSin(qMax(1, size / 2 - 1)),
+    m_postCos(size / 2 + 1),
+    m_postSin(size / 2 + 1),
+    m_re(size / 2),
+    m_im(size / 2)
+{
+    int bits = 0;
+    while ((1 << bits) < m_half)
+        ++bits;
+    for (int i = 0; i < m_half; ++i) {
+        int reversed = 0;
+        for (int b = 0; b < bits; ++b)
+            reversed |= ((i >> b) & 1) << (bits - 1 - b);
+        m_bitReverse[i] = reversed;
+    }
+
+    // Twiddles for the stage with half-length h start at offset h - 1.
+    for (int h = 1; h < m_half; h <<= 1) {
+        for (int k = 0; k < h; ++k) {
+            const double angle = M_PI * k / h;
+            m_stageCos[h - 1 + k] = float(cos(angle));
+            m_stageSin[h - 1 + k] = float(-sin(angle));
+        }
+    }
+
+    for (int k = 0; k <= m_half; ++k) {
+        const double angle = 2.0 * M_PI * k / m_size;
+        m_postCos[k] = float(cos(angle));
+        m_postSin[k] = float(sin(angle));
+    }
+}
+
+int Fft::size() const
+{
+    return m_size;
+}
+
+void Fft::transform(float *re, float *im, bool inverse)
+{
+    for (int i = 0; i < m_half; ++i) {
+        const int j = m_bitReverse[i];
+        if (j > i) {
+            qSwap(re[i], re[j]);
+            qSwap(im[i], im[j]);
+        }
+    }
+
+    const float sign = inverse ? -1.0f : 1.0f;
+    for (int h = 1; h < m_half; h <<= 1) {
+        const float *wr = m_stageCos.constData() + h - 1;
+        const float *wi = m_stageSin.constData() + h - 1;
+
+        for (int start = 0; start < m_half; start += 2 * h) {
+            float *ar = re + start;
+            float *ai = im + start;
+            float *br = ar + h;
+            float *bi = ai + h;
+            int k = 0;
+#ifdef __SSE2__
+            const __m128 vsign = _mm_set1_ps(sign);
+            for (; k + 4 <= h; k += 4) {
+                const __m128 c = _mm_loadu_ps(wr + k);
+                const __m128 s = _mm_mul_ps(_mm_loadu_ps(wi + k), vsign);
+                const __m128 xr = _mm_loadu_ps(br + k);
+                const __m128 xi = _mm_loadu_ps(bi + k);
+                const __m128 tr = _mm_sub_ps(_mm_mul_ps(xr, c), _mm_mul_ps(xi, s));
+                const __m128 ti = _mm_add_ps(_mm_mul_ps(xr, s), _mm_mul_ps(xi, c));
+                const __m128 yr = _mm_loadu_ps(ar + k);
+                const __m128 yi = _mm_loadu_ps(ai + k);
+                _mm_storeu_ps(ar + k, _mm_add_ps(yr, tr));
+                _mm_storeu_ps(ai + k, _mm_add_ps(yi, ti));
+                _mm_storeu_ps(br + k, _mm_sub_ps(yr, tr));
+                _mm_storeu_ps(bi + k, _mm_sub_ps(yi, ti));
+            }
+#endif
+            for (; k < h; ++k) {
+                const float c = wr[k];
+                const float s = wi[k] * sign;
+                const float tr = br[k] * c - bi[k] * s;
+                const float ti = br[k] * s + bi[k] * c;
+                br[k] = ar[k] - tr;
+                bi[k] = ai[k] - ti;
+                ar[k] += tr;
+                ai[k] += ti;
+            }
+        }
+    }
+}
+
+void Fft::forward(const float *input, float *re, float *im)
+{
+    float *zr = m_re.data();
+    float *zi = m_im.data();
+    for (int m = 0; m < m_half; ++m) {
+        zr[m] = input[2 * m];
+        zi[m] = input[2 * m + 1];
+    }
+
+    transform(zr, zi, false);
+
+    // Split the packed transform into the spectra of the even and odd
+    // samples and recombine them into the real signal's spectrum.
+    for (int k = 0; k <= m_half; ++k) {
+        const int a = k == m_half ? 0 : k;
+        const int b = k == 0 ? 0 : m_half - k;
+        const float er = 0.5f * (zr[a] + zr[b]);
+        const float ei = 0.5f * (zi[a] - zi[b]);
+        const float orr = 0.5f * (zi[a] + zi[b]);
+        const float oi = -0.5f * (zr[a] - zr[b]);
+        const float c = m_postCos[k];
+        const float s = m_postSin[k];
+        re[k] = er + c * orr + s * oi;
+        im[k] = ei + c * oi - s * orr;
+    }
+}
+
+void Fft::inverse(const float *re, const float *im, float *output)
+{
+    float *zr = m_re.data();
+    float *zi = m_im.data();
+    for (int k = 0; k < m_half; ++k) {
+        const float xr = re[k];
+        const float xi = im[k];
+        const float yr = re[m_half - k];
+        const float yi = -im[m_half - k];
+        const float er = 0.5f * (xr + yr);
+        const float ei = 0.5f * (xi + yi);
+        const float dr = 0.5f * (xr - yr);
+        const float di = 0.5f * (xi - yi);
+        const float c = m_postCos[k];
+        const float s = m_postSin[k];
+        const float orr = dr * c - di * s;
+        const float oi = dr * s + di * c;
+        zr[k] = er - oi;
+        zi[k] = ei + orr;
+    }
+
+    transform(zr, zi, true);
+
+    const float scale = 1.0f / m_half;
+    for (int m = 0; m < m_half; ++m) {
+        output[2 * m] = zr[m] * scale;
+        output[2 * m + 1] = zi[m] * scale;
+    }
+}
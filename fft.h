@@ -0,0 +1,36 @@
+#ifndef FFT_H
+#define FFT_H
+
+#include <QVector>
+
+// Radix-2 FFT on split real/imaginary arrays. Real input of size n is packed
+// into an n/2-point complex transform; the butterflies run four at a time
+// with SSE2 where available. Not thread-safe: each user owns its instance.
+class Fft
+{
+public:
+    explicit Fft(int size);
+
+    int size() const;
+
+    // n real samples in, n/2 + 1 bins out.
+    void forward(const float *input, float *re, float *im);
+
+    // n/2 + 1 bins in, n real samples out; inverse(forward(x)) == x.
+    void inverse(const float *re, const float *im, float *output);
+
+private:
+    void transform(float *re, float *im, bool inverse);
+
+    int m_size;
+    int m_half;
+    QVector<int> m_bitReverse;
+    QVector<float> m_stageCos;
+    QVector<float> m_stageSin;
+    QVector<float> m_postCos;
+    QVector<float> m_postSin;
+    QVector<float> m_re;
+    QVector<float> m_im;
+};
+
+#endif // FFT_H
@@ -0,0 +1,565 @@
+#include "flacencoder.h"
+#include "dspkernels.h"
+
+#include <math.h>
+#include <string.h>
+
+namespace {
+
+const int kMaxLpcOrder = 8;
+const int kLpcPrecision = 12;
+const int kMaxPartitionOrder = 6;
+const int kMaxRiceParameter = 14;
+
+quint8 crc8Table[256];
+quint16 crc16Table[256];
+
+void initCrcTables()
+{
+    static bool initialized = false;
+    if (initialized)
+        return;
+
+    for (int i = 0; i < 256; ++i) {
+        quint8 c8 = quint8(i);
+        quint16 c16 = quint16(i << 8);
+        for (int bit = 0; bit < 8; ++bit) {
+            c8 = quint8((c8 & 0x80) ? (c8 << 1) ^ 0x07 : (c8 << 1));
+            c16 = quint16((c16 & 0x8000) ? (c16 << 1) ^ 0x8005 : (c16 << 1));
+        }
+        crc8Table[i] = c8;
+        crc16Table[i] = c16;
+    }
+    initialized = true;
+}
+
+quint8 crc8(const char *data, int size)
+{
+    quint8 crc = 0;
+    for (int i = 0; i < size; ++i)
+        crc = crc8Table[crc ^ quint8(data[i])];
+    return crc;
+}
+
+quint16 crc16(const char *data, int size)
+{
+    quint16 crc = 0;
+    for (int i = 0; i < size; ++i)
+        crc = quint16((crc << 8) ^ crc16Table[(crc >> 8) ^ quint8(data[i])]);
+    return crc;
+}
+
+// MSB-first bit packer appending to a QByteArray.
+class BitWriter
+{
+public:
+    explicit BitWriter(QByteArray *out) : m_out(out), m_acc(0), m_bits(0) {}
+
+    void write(quint32 value, int bits)
+    {
+        if (bits == 0)
+            return;
+        m_acc = (m_acc << bits) | (quint64(value) & ((quint64(1) << bits) - 1));
+        m_bits += bits;
+        while (m_bits >= 8) {
+            m_bits -= 8;
+            m_out->append(char(m_acc >> m_bits));
+        }
+        m_acc &= (quint64(1) << m_bits) - 1;
+    }
+
+    void writeSigned(qint32 value, int bits)
+    {
+        write(quint32(value), bits);
+    }
+
+    void writeUnary(quint32 zeros)
+    {
+        while (zeros >= 32) {
+            write(0, 32);
+            zeros -= 32;
+        }
+        write(1, zeros + 1);
+    }
+
+    void writeRice(qint32 value, int parameter)
+    {
+        const quint32 folded = (quint32(value) << 1) ^ quint32(value >> 31);
+        writeUnary(folded >> parameter);
+        write(folded, parameter);
+    }
+
+    void writeUtf8(quint32 value)
+    {
+        if (value < 0x80) {
+            write(value, 8);
+            return;
+        }
+        int bytes = 2;
+        while (bytes < 6 && value >= (quint32(1) << (5 * bytes + 1)))
+            ++bytes;
+        write(((0xff00 >> bytes) & 0xff) | (value >> (6 * (bytes - 1))), 8);
+        for (int i = bytes - 2; i >= 0; --i)
+            write(0x80 | ((value >> (6 * i)) & 0x3f), 8);
+    }
+
+    void align()
+    {
+        if (m_bits)
+            write(0, 8 - m_bits);
+    }
+
+private:
+    QByteArray *m_out;
+    quint64 m_acc;
+    int m_bits;
+};
+
+struct RicePlan
+{
+    int order;
+    int parameters[1 << kMaxPartitionOrder];
+    quint64 bits;
+};
+
+int riceParameterFor(quint64 sum, int count, quint64 *bits)
+{
+    int k = 0;
+    if (count > 0) {
+        const quint64 mean = sum / quint64(count);
+        while (k < kMaxRiceParameter && (quint64(1) << (k + 1)) <= mean)
+            ++k;
+    }
+
+    quint64 best = quint64(count) * (k + 1) + (sum >> k);
+    int bestK = k;
+    for (int candidate = qMax(0, k - 1); candidate <= qMin(kMaxRiceParameter, k + 1); ++candidate) {
+        const quint64 estimate = quint64(count) * (candidate + 1) + (sum >> candidate);
+        if (estimate < best) {
+            best = estimate;
+            bestK = candidate;
+        }
+    }
+    *bits = best;
+    return bestK;
+}
+
+// Picks the partition order and per-partition Rice parameters for the
+// residual of a block of |n| samples predicted with |predictorOrder|.
+void planResidual(const qint32 *residual, int n, int predictorOrder, RicePlan *plan)
+{
+    int maxOrder = 0;
+    while (maxOrder < kMaxPartitionOrder && (n % (2 << maxOrder)) == 0
+           && (n >> (maxOrder + 1)) > predictorOrder)
+        ++maxOrder;
+
+    // Sums at the finest partitioning, merged pairwise for coarser ones.
+    quint64 sums[1 << kMaxPartitionOrder];
+    const int partitions = 1 << maxOrder;
+    const int partitionSize = n >> maxOrder;
+    for (int p = 0; p < partitions; ++p) {
+        const int start = p == 0 ? predictorOrder : p * partitionSize;
+        const int end = (p + 1) * partitionSize;
+        sums[p] = Dsp::foldedSum(residual + start, end - start);
+    }
+
+    plan->bits = ~quint64(0);
+    for (int order = maxOrder; order >= 0; --order) {
+        const int count = 1 << order;
+        const int size = n >> order;
+        quint64 bits = 0;
+        int parameters[1 << kMaxPartitionOrder];
+        for (int p = 0; p < count; ++p) {
+            quint64 partitionBits;
+            parameters[p] = riceParameterFor(sums[p], p == 0 ? size - predictorOrder : size,
+                                             &partitionBits);
+            bits += 4 + partitionBits;
+        }
+        if (bits < plan->bits) {
+            plan->bits = bits;
+            plan->order = order;
+            memcpy(plan->parameters, parameters, count * sizeof(int));
+        }
+        for (int p = 0; p < count / 2; ++p)
+            sums[p] = sums[2 * p] + sums[2 * p + 1];
+    }
+    plan->bits += 2 + 4;
+}
+
+void writeResidual(BitWriter *bw, const qint32 *residual, int n, int predictorOrder,
+                   const RicePlan &plan)
+{
+    bw->write(0, 2);
+    bw->write(plan.order, 4);
+
+    const int size = n >> plan.order;
+    for (int p = 0; p < (1 << plan.order); ++p) {
+        const int k = plan.parameters[p];
+        bw->write(k, 4);
+        const int start = p == 0 ? predictorOrder : p * size;
+        const int end = (p + 1) * size;
+        for (int i = start; i < end; ++i)
+            bw->writeRice(residual[i], k);
+    }
+}
+
+int blockSizeCode(int blockSize)
+{
+    switch (blockSize) {
+    case 192: return 1;
+    case 576: return 2;
+    case 1152: return 3;
+    case 2304: return 4;
+    case 4608: return 5;
+    case 256: return 8;
+    case 512: return 9;
+    case 1024: return 10;
+    case 2048: return 11;
+    case 4096: return 12;
+    case 8192: return 13;
+    case 16384: return 14;
+    case 32768: return 15;
+    default: return blockSize <= 256 ? 6 : 7;
+    }
+}
+
+int sampleRateCode(int sampleRate)
+{
+    switch (sampleRate) {
+    case 88200: return 1;
+    case 176400: return 2;
+    case 192000: return 3;
+    case 8000: return 4;
+    case 16000: return 5;
+    case 22050: return 6;
+    case 24000: return 7;
+    case 32000: return 8;
+    case 44100: return 9;
+    case 48000: return 10;
+    case 96000: return 11;
+    default: return 0; // taken from STREAMINFO
+    }
+}
+
+// Levinson-Durbin recursion. Fills lpc[order - 1][0..order) with predictor
+// coefficients and error[order - 1] with the prediction error for each order.
+int computeLpc(const double *autoc, int maxOrder, double lpc[][kMaxLpcOrder], double *error)
+{
+    double a[kMaxLpcOrder];
+    double err = autoc[0];
+
+    for (int i = 0; i < maxOrder; ++i) {
+        double r = -autoc[i + 1];
+        for (int j = 0; j < i; ++j)
+            r -= a[j] * autoc[i - j];
+        r /= err;
+
+        a[i] = r;
+        int j = 0;
+        for (; j < (i >> 1); ++j) {
+            const double tmp = a[j];
+            a[j] += r * a[i - 1 - j];
+            a[i - 1 - j] += r * tmp;
+        }
+        if (i & 1)
+            a[j] += a[j] * r;
+
+        err *= (1.0 - r * r);
+        for (j = 0; j <= i; ++j)
+            lpc[i][j] = -a[j];
+        error[i] = err;
+
+        if (err <= 0.0)
+            return i + 1;
+    }
+    return maxOrder;
+}
+
+// Quantizes |lpc| to |precision| bits with error feedback. Returns false if
+// the coefficients would need a negative shift, which FLAC does not allow.
+bool quantizeLpc(const double *lpc, int order, int precision, qint32 *qlp, int *shift)
+{
+    const qint32 qmax = (1 << (precision - 1)) - 1;
+    const qint32 qmin = -(1 << (precision - 1));
+
+    double cmax = 0.0;
+    for (int i = 0; i < order; ++i)
+        cmax = qMax(cmax, fabs(lpc[i]));
+    if (cmax <= 0.0)
+        return false;
+
+    int log2cmax;
+    frexp(cmax, &log2cmax);
+    *shift = qMin(15, precision - log2cmax - 1);
+    if (*shift < 0)
+        return false;
+
+    double error = 0.0;
+    for (int i = 0; i < order; ++i) {
+        error += lpc[i] * (1 << *shift);
+        qint32 q = qint32(floor(error + 0.5));
+        q = qBound(qmin, q, qmax);
+        error -= q;
+        qlp[i] = q;
+    }
+    return true;
+}
+
+}
+
+FlacEncoder::FlacEncoder(int sampleRate, int blockSize) :
+    m_sampleRate(sampleRate),
+    m_blockSize(blockSize),
+    m_pending(blockSize),
+    m_pendingCount(0),
+    m_windowed(blockSize),
+    m_residual(blockSize),
+    m_bestResidual(blockSize),
+    m_samplesEncoded(0),
+    m_framesEncoded(0)
+{
+    initCrcTables();
+}
+
+int FlacEncoder::sampleRate() const
+{
+    return m_sampleRate;
+}
+
+int FlacEncoder::blockSize() const
+{
+    return m_blockSize;
+}
+
+qint64 FlacEncoder::samplesEncoded() const
+{
+    return m_samplesEncoded;
+}
+
+int FlacEncoder::framesEncoded() const
+{
+    return m_framesEncoded;
+}
+
+QByteArray FlacEncoder::streamHeader() const
+{
+    QByteArray out("fLaC");
+    BitWriter bw(&out);
+
+    bw.write(1, 1);             // last metadata block
+    bw.write(0, 7);             // STREAMINFO
+    bw.write(34, 24);
+    bw.write(m_blockSize, 16);  // minimum block size
+    bw.write(m_blockSize, 16);  // maximum block size
+    bw.write(0, 24);            // minimum frame size: unknown
+    bw.write(0, 24);            // maximum frame size: unknown
+    bw.write(m_sampleRate, 20);
+    bw.write(0, 3);             // mono
+    bw.write(15, 5);            // 16 bits per sample
+    bw.write(0, 4);             // total samples: unknown
+    bw.write(0, 32);
+    for (int i = 0; i < 4; ++i) // MD5: unknown
+        bw.write(0, 32);
+
+    return out;
+}
+
+bool FlacEncoder::readStreamInfo(const QByteArray &data, int *sampleRate, qint64 *samples)
+{
+    // STREAMINFO always comes first; the sample rate is 20 bits at byte 18
+    // and the total sample count the low 36 bits of the next five bytes.
+    if (data.size() < 42 || !data.startsWith("fLaC") || (data.at(4) & 0x7f) != 0)
+        return false;
+
+    const uchar *info = reinterpret_cast<const uchar *>(data.constData()) + 18;
+    const int rate = (info[0] << 12) | (info[1] << 4) | (info[2] >> 4);
+    if (rate <= 0)
+        return false;
+
+    *sampleRate = rate;
+    *samples = (qint64(info[3] & 0x0f) << 32) | (quint32(info[4]) << 24)
+            | (quint32(info[5]) << 16) | (quint32(info[6]) << 8) | quint32(info[7]);
+    return true;
+}
+
+QByteArray FlacEncoder::encode(const qint16 *samples, int count)
+{
+    QByteArray out;
+    while (count > 0) {
+        const int take = qMin(count, m_blockSize - m_pendingCount);
+        qint32 *pending = m_pending.data() + m_pendingCount;
+        for (int i = 0; i < take; ++i)
+            pending[i] = samples[i];
+        m_pendingCount += take;
+        samples += take;
+        count -= take;
+
+        if (m_pendingCount == m_blockSize) {
+            encodeFrame(m_pending.constData(), m_blockSize, &out);
+            m_pendingCount = 0;
+        }
+    }
+    return out;
+}
+
+QByteArray FlacEncoder::finish()
+{
+    QByteArray out;
+    if (m_pendingCount > 0) {
+        encodeFrame(m_pending.constData(), m_pendingCount, &out);
+        m_pendingCount = 0;
+    }
+    return out;
+}
+
+void FlacEncoder::encodeFrame(const qint32 *x, int n, QByteArray *out)
+{
+    const int start = out->size();
+    BitWriter bw(out);
+
+    // Frame header
+    const int blockCode = n == m_blockSize ? blockSizeCode(n) : (n <= 256 ? 6 : 7);
+    const int rateCode = sampleRateCode(m_sampleRate);
+    bw.write(0x3ffe, 14);
+    bw.write(0, 1);
+    bw.write(0, 1);             // fixed block size
+    bw.write(blockCode, 4);
+    bw.write(rateCode, 4);
+    bw.write(0, 4);             // mono
+    bw.write(4, 3);             // 16 bits per sample
+    bw.write(0, 1);
+    bw.writeUtf8(quint32(m_framesEncoded));
+    if (blockCode == 6)
+        bw.write(n - 1, 8);
+    else if (blockCode == 7)
+        bw.write(n - 1, 16);
+    bw.write(crc8(out->constData() + start, out->size() - start), 8);
+
+    // Subframe
+    bool constant = true;
+    for (int i = 1; i < n && constant; ++i)
+        constant = x[i] == x[0];
+
+    if (constant) {
+        bw.write(0, 8);         // CONSTANT
+        bw.writeSigned(x[0], 16);
+    } else {
+        enum { Verbatim, Fixed, Lpc } type = Verbatim;
+        quint64 bestBits = quint64(n) * 16;
+        int bestOrder = 0;
+        RicePlan bestPlan;
+        qint32 bestCoeffs[kMaxLpcOrder];
+        int bestShift = 0;
+        RicePlan plan;
+
+        static const qint32 fixedCoeffs[5][4] = {
+            { 0, 0, 0, 0 }, { 1, 0, 0, 0 }, { 2, -1, 0, 0 }, { 3, -3, 1, 0 }, { 4, -6, 4, -1 }
+        };
+        for (int order = 0; order <= 4 && order < n; ++order) {
+            Dsp::lpcResidual(x, n, fixedCoeffs[order], order, 0, m_residual.data());
+            planResidual(m_residual.constData(), n, order, &plan);
+            const quint64 bits = quint64(order) * 16 + plan.bits;
+            if (bits < bestBits) {
+                bestBits = bits;
+                type = Fixed;
+                bestOrder = order;
+                bestPlan = plan;
+                m_bestResidual.swap(m_residual);
+            }
+        }
+
+        const int maxOrder = qMin(kMaxLpcOrder, n / 4);
+        if (maxOrder > 0) {
+            // Tukey(0.5) window for the analysis only; prediction runs on
+            // the raw samples.
+            if (m_window.size() != n) {
+                m_window.resize(n);
+                const int taper = n / 4;
+                for (int i = 0; i < n; ++i) {
+                    float w = 1.0f;
+                    if (i < taper)
+                        w = 0.5f - 0.5f * cosf(float(M_PI) * i / taper);
+                    else if (i >= n - taper)
+                        w = 0.5f - 0.5f * cosf(float(M_PI) * (n - 1 - i) / taper);
+                    m_window[i] = w;
+                }
+            }
+            float *windowed = m_windowed.data();
+            for (int i = 0; i < n; ++i)
+                windowed[i] = float(x[i]) * m_window[i];
+
+            double autoc[kMaxLpcOrder + 1];
+            Dsp::autocorrelation(windowed, n, maxOrder, autoc);
+
+            if (autoc[0] > 0.0) {
+                double lpc[kMaxLpcOrder][kMaxLpcOrder];
+                double error[kMaxLpcOrder];
+                const int orders = computeLpc(autoc, maxOrder, lpc, error);
+
+                // Estimate the best order from the prediction error, then
+                // code only that one.
+                int order = 0;
+                double bestEstimate = 0.0;
+                for (int i = 0; i < orders; ++i) {
+                    const double scaled = 0.5 * error[i] / n;
+                    const double bps = scaled > 1.0 ? 0.5 * log(scaled) / M_LN2 : 0.0;
+                    const double estimate = bps * (n - i - 1) + (i + 1) * (kLpcPrecision + 16);
+                    if (order == 0 || estimate < bestEstimate) {
+                        bestEstimate = estimate;
+                        order = i + 1;
+                    }
+                }
+
+                qint32 qlp[kMaxLpcOrder];
+                int shift;
+                if (quantizeLpc(lpc[order - 1], order, kLpcPrecision, qlp, &shift)) {
+                    Dsp::lpcResidual(x, n, qlp, order, shift, m_residual.data());
+                    planResidual(m_residual.constData(), n, order, &plan);
+                    const quint64 bits = quint64(order) * (16 + kLpcPrecision) + 4 + 5 + plan.bits;
+                    if (bits < bestBits) {
+                        bestBits = bits;
+                        type = Lpc;
+                        bestOrder = order;
+                        bestPlan = plan;
+                        bestShift = shift;
+                        memcpy(bestCoeffs, qlp, order * sizeof(qint32));
+                        m_bestResidual.swap(m_residual);
+                    }
+                }
+            }
+        }
+
+        switch (type) {
+        case Verbatim:
+            bw.write(0x02, 8);
+            for (int i = 0; i < n; ++i)
+                bw.writeSigned(x[i], 16);
+            break;
+        case Fixed:
+            bw.write((0x08 | bestOrder) << 1, 8);
+            for (int i = 0; i < bestOrder; ++i)
+                bw.writeSigned(x[i], 16);
+            writeResidual(&bw, m_bestResidual.constData(), n, bestOrder, bestPlan);
+            break;
+        case Lpc:
+            bw.write((0x20 | (bestOrder - 1)) << 1, 8);
+            for (int i = 0; i < bestOrder; ++i)
+                bw.writeSigned(x[i], 16);
+            bw.write(kLpcPrecision - 1, 4);
+            bw.writeSigned(bestShift, 5);
+            for (int i = 0; i < bestOrder; ++i)
+                bw.writeSigned(bestCoeffs[i], kLpcPrecision);
+            writeResidual(&bw, m_bestResidual.constData(), n, bestOrder, bestPlan);
+            break;
+        }
+    }
+
+    // Frame footer
+    bw.align();
+    const quint16 crc = crc16(out->constData() + start, out->size() - start);
+    out->append(char(crc >> 8));
+    out->append(char(crc & 0xff));
+
+    m_samplesEncoded += n;
+    ++m_framesEncoded;
+}
@@ -0,0 +1,53 @@
+#ifndef FLACENCODER_H
+#define FLACENCODER_H
+
+#include <QByteArray>
+#include <QVector>
+
+// In-process FLAC encoder for 16-bit mono PCM. Output is produced one frame
+// at a time as soon as a block of samples is complete, so it can be uploaded
+// while recording continues. The stream header leaves the total sample count
+// and MD5 signature unset, as allowed for streams of unknown length.
+class FlacEncoder
+{
+public:
+    explicit FlacEncoder(int sampleRate, int blockSize = 1024);
+
+    int sampleRate() const;
+    int blockSize() const;
+
+    // "fLaC" marker followed by the STREAMINFO block.
+    QByteArray streamHeader() const;
+
+    // Reads the sample rate and total sample count (0 if unknown) from the
+    // start of a FLAC stream; false if |data| does not begin with one.
+    static bool readStreamInfo(const QByteArray &data, int *sampleRate, qint64 *samples);
+
+    // Consumes |count| samples and returns every frame completed by them.
+    QByteArray encode(const qint16 *samples, int count);
+
+    // Encodes whatever remains as a final, shorter frame.
+    QByteArray finish();
+
+    qint64 samplesEncoded() const;
+    int framesEncoded() const;
+
+private:
+    void encodeFrame(const qint32 *samples, int count, QByteArray *out);
+
+    int m_sampleRate;
+    int m_blockSize;
+
+    QVector<qint32> m_pending;
+    int m_pendingCount;
+
+    QVector<float> m_window;
+    QVector<float> m_windowed;
+    QVector<qint32> m_residual;
+    QVector<qint32> m_bestResidual;
+
+    qint64 m_samplesEncoded;
+    int m_framesEncoded;
+};
+
+#endif // FLACENCODER_H
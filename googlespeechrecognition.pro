@@ -1,23 +1,38 @@
 TEMPLATE = lib
 TARGET = GoogleSpeechRecognition
-QT += qml quick multimedia core
+QT += qml quick multimedia network core
 CONFIG += qt plugin
 
 TARGET = $$qtLibraryTarget($$TARGET)
 uri = GoogleSpeech
 
+include(speechcore.pri)
+
 # Input
 SOURCES += \
     googlespeechrecognition_plugin.cpp \
     googlespeech.cpp \
     qtrecorder.cpp \
-    speechrecognition.cpp
+    audiocapture.cpp \
+    levelmeter.cpp \
+    fft.cpp \
+    featureextractor.cpp \
+    voiceactivitydetector.cpp \
+    noisesuppressor.cpp \
+    keywordspotter.cpp
 
 HEADERS += \
     googlespeechrecognition_plugin.h \
     googlespeech.h \
     qtrecorder.h \
-    speechrecognition.h
+    audiocapture.h \
+    levelmeter.h \
+    ringbuffer.h \
+    fft.h \
+    featureextractor.h \
+    voiceactivitydetector.h \
+    noisesuppressor.h \
+    keywordspotter.h
 
 OTHER_FILES = qmldir
 
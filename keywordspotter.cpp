@@ -0,0 +1,297 @@
+#include "keywordspotter.h"
+
+#include <QDataStream>
+#include <QFile>
+
+#include <math.h>
+#include <string.h>
+
+namespace {
+
+// The MFCCs FeatureExtractor delivers, c1..c12.
+const int kCoefficients = 12;
+
+// Templates shorter than 200 ms match too much of everything.
+const int kMinTemplateFrames = 20;
+// Template frames more than 25 dB below the loudest one are trimmed off
+// either end (natural log of power).
+const float kTrimRange = 5.76f;
+// Frames a match must stop improving for before it is reported, so it is
+// taken at the end of the keyword rather than at its first good frame.
+const int kSettleFrames = 3;
+// Used until there are two templates to measure the spread between.
+const qreal kDefaultThreshold = 1.2;
+// Accept anything up to this much further off than the templates are from
+// one another.
+const qreal kThresholdMargin = 1.5;
+
+const quint32 kFileMagic = 0x4b575331; // "KWS1"
+const float kInfinity = 1e30f;
+
+float distance(const float *a, const float *b)
+{
+    float sum = 0.0f;
+    for (int i = 0; i < kCoefficients; ++i) {
+        const float d = a[i] - b[i];
+        sum += d * d;
+    }
+    return sqrtf(sum);
+}
+
+// Collects the MFCCs and energies of a whole example.
+class ExampleCollector : public FeatureConsumer
+{
+public:
+    bool consumeFrame(const FeatureFrame &frame)
+    {
+        features.resize(features.size() + kCoefficients);
+        memcpy(features.data() + features.size() - kCoefficients, frame.mfcc,
+               kCoefficients * sizeof(float));
+        energies.append(frame.energy);
+        return false;
+    }
+
+    QVector<float> features;
+    QVector<float> energies;
+};
+
+// Mean frame distance of the best alignment of all of |a| with all of |b|.
+float alignmentCost(const QVector<float> &a, const QVector<float> &b)
+{
+    const int rows = a.size() / kCoefficients;
+    const int columns = b.size() / kCoefficients;
+    QVector<float> cost(columns);
+    QVector<int> steps(columns);
+
+    for (int i = 0; i < rows; ++i) {
+        const float *x = a.constData() + i * kCoefficients;
+        float diagCost = i == 0 ? 0.0f : kInfinity;
+        int diagSteps = 0;
+        for (int j = 0; j < columns; ++j) {
+            const float d = distance(x, b.constData() + j * kCoefficients);
+            float fromCost = diagCost;
+            int fromSteps = diagSteps;
+            if (i > 0 && (cost[j] + d) / (steps[j] + 1) < (fromCost + d) / (fromSteps + 1)) {
+                fromCost = cost[j];
+                fromSteps = steps[j];
+            }
+            if (j > 0 && (cost[j - 1] + d) / (steps[j - 1] + 1) < (fromCost + d) / (fromSteps + 1)) {
+                fromCost = cost[j - 1];
+                fromSteps = steps[j - 1];
+            }
+            diagCost = i == 0 ? kInfinity : cost[j];
+            diagSteps = i == 0 ? 0 : steps[j];
+            cost[j] = fromCost + d;
+            steps[j] = fromSteps + 1;
+        }
+    }
+    return cost[columns - 1] / steps[columns - 1];
+}
+
+}
+
+KeywordSpotter::KeywordSpotter(int sampleRate) :
+    m_sampleRate(sampleRate),
+    m_threshold(0),
+    m_derivedThreshold(kDefaultThreshold)
+{
+    reset();
+}
+
+int KeywordSpotter::sampleRate() const
+{
+    return m_sampleRate;
+}
+
+qreal KeywordSpotter::threshold() const
+{
+    return m_threshold > 0 ? m_threshold : m_derivedThreshold;
+}
+
+void KeywordSpotter::setThreshold(qreal threshold)
+{
+    m_threshold = threshold;
+}
+
+int KeywordSpotter::templateCount() const
+{
+    return m_templates.size();
+}
+
+void KeywordSpotter::clearTemplates()
+{
+    m_templates.clear();
+    deriveThreshold();
+    reset();
+}
+
+void KeywordSpotter::reset()
+{
+    m_best = kInfinity;
+    m_settle = 0;
+    for (int i = 0; i < m_templates.size(); ++i)
+        resetTemplate(&m_templates[i]);
+}
+
+void KeywordSpotter::resetTemplate(Template *keyword)
+{
+    keyword->cost.fill(kInfinity, keyword->frames);
+    keyword->steps.fill(1, keyword->frames);
+    keyword->start.fill(0, keyword->frames);
+}
+
+bool KeywordSpotter::addTemplate(const qint16 *samples, int count)
+{
+    FeatureExtractor extractor(m_sampleRate);
+    ExampleCollector example;
+    extractor.addConsumer(&example, FeatureExtractor::Mfcc);
+    extractor.process(samples, count);
+    const QVector<float> &features = example.features;
+    const QVector<float> &energies = example.energies;
+    if (energies.isEmpty())
+        return false;
+
+    float peak = energies[0];
+    for (int i = 1; i < energies.size(); ++i)
+        peak = qMax(peak, energies[i]);
+    int first = 0;
+    int last = energies.size() - 1;
+    while (first < last && energies[first] < peak - kTrimRange)
+        ++first;
+    while (last > first && energies[last] < peak - kTrimRange)
+        --last;
+    if (last - first + 1 < kMinTemplateFrames)
+        return false;
+
+    Template keyword;
+    keyword.frames = last - first + 1;
+    keyword.features = features.mid(first * kCoefficients, keyword.frames * kCoefficients);
+    resetTemplate(&keyword);
+    m_templates.append(keyword);
+    deriveThreshold();
+    return true;
+}
+
+void KeywordSpotter::deriveThreshold()
+{
+    if (m_templates.size() < 2) {
+        m_derivedThreshold = kDefaultThreshold;
+        return;
+    }
+
+    float spread = 0.0f;
+    for (int i = 0; i < m_templates.size(); ++i) {
+        for (int j = i + 1; j < m_templates.size(); ++j)
+            spread = qMax(spread, alignmentCost(m_templates[i].features, m_templates[j].features));
+    }
+    m_derivedThreshold = spread * kThresholdMargin;
+}
+
+bool KeywordSpotter::load(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QDataStream in(&file);
+    quint32 magic;
+    qint32 coefficients;
+    qint32 count;
+    in >> magic >> coefficients >> count;
+    if (in.status() != QDataStream::Ok || magic != kFileMagic
+            || coefficients != kCoefficients || count < 0)
+        return false;
+
+    QVector<Template> templates;
+    for (int i = 0; i < count; ++i) {
+        Template keyword;
+        in >> keyword.features;
+        keyword.frames = keyword.features.size() / kCoefficients;
+        if (in.status() != QDataStream::Ok || keyword.frames < kMinTemplateFrames
+                || keyword.features.size() % kCoefficients != 0)
+            return false;
+        templates.append(keyword);
+    }
+
+    m_templates = templates;
+    deriveThreshold();
+    reset();
+    return true;
+}
+
+bool KeywordSpotter::save(const QString &fileName) const
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+
+    QDataStream out(&file);
+    out << kFileMagic << qint32(kCoefficients) << qint32(m_templates.size());
+    foreach (const Template &keyword, m_templates)
+        out << keyword.features;
+    return out.status() == QDataStream::Ok;
+}
+
+bool KeywordSpotter::consumeFrame(const FeatureFrame &frame)
+{
+    if (m_templates.isEmpty() || !advance(frame.mfcc, frame.index))
+        return false;
+    reset();
+    return true;
+}
+
+// Extends every template's alignments by one input frame. An alignment may
+// start at any frame, and each step advances the input, the template or
+// both, whichever keeps the mean distance lowest. Matches faster than half
+// or slower than twice the template's pace are not counted.
+bool KeywordSpotter::advance(const float *features, qint64 index)
+{
+    float score = kInfinity;
+    for (int i = 0; i < m_templates.size(); ++i) {
+        Template &keyword = m_templates[i];
+        const float *reference = keyword.features.constData();
+        float *cost = keyword.cost.data();
+        int *steps = keyword.steps.data();
+        qint64 *start = keyword.start.data();
+
+        // The diagonal predecessor; before the first template frame, a new
+        // alignment starting here.
+        float diagCost = 0.0f;
+        int diagSteps = 0;
+        qint64 diagStart = index;
+        for (int j = 0; j < keyword.frames; ++j) {
+            const float d = distance(features, reference + j * kCoefficients);
+            float fromCost = diagCost;
+            int fromSteps = diagSteps;
+            qint64 fromStart = diagStart;
+            if ((cost[j] + d) / (steps[j] + 1) < (fromCost + d) / (fromSteps + 1)) {
+                fromCost = cost[j];
+                fromSteps = steps[j];
+                fromStart = start[j];
+            }
+            if (j > 0 && (cost[j - 1] + d) / (steps[j - 1] + 1) < (fromCost + d) / (fromSteps + 1)) {
+                fromCost = cost[j - 1];
+                fromSteps = steps[j - 1];
+                fromStart = start[j - 1];
+            }
+            diagCost = cost[j];
+            diagSteps = steps[j];
+            diagStart = start[j];
+            cost[j] = fromCost + d;
+            steps[j] = fromSteps + 1;
+            start[j] = fromStart;
+        }
+
+        const int last = keyword.frames - 1;
+        const qint64 duration = index - start[last] + 1;
+        if (2 * duration >= keyword.frames && duration <= 2 * keyword.frames)
+            score = qMin(score, cost[last] / steps[last]);
+    }
+
+    if (score < threshold() && score < m_best) {
+        m_best = score;
+        m_settle = 0;
+        return false;
+    }
+    return m_best < kInfinity && ++m_settle >= kSettleFrames;
+}
@@ -0,0 +1,67 @@
+#ifndef KEYWORDSPOTTER_H
+#define KEYWORDSPOTTER_H
+
+#include <QString>
+#include <QVector>
+
+#include "featureextractor.h"
+
+// Listens for a spoken keyword by aligning the incoming audio against a few
+// recordings of it. It consumes the MFCCs of a FeatureExtractor with the
+// default 25 ms frames and 10 ms hop, and matches each template with
+// subsequence dynamic time warping, updated one frame at a time, so the
+// cost per frame is a pass over the templates.
+class KeywordSpotter : public FeatureConsumer
+{
+public:
+    // |sampleRate| is that of the examples passed to addTemplate().
+    explicit KeywordSpotter(int sampleRate);
+
+    int sampleRate() const;
+
+    // Mean distance per aligned frame below which a match counts. 0 derives
+    // it from how far the templates are from each other.
+    qreal threshold() const;
+    void setThreshold(qreal threshold);
+
+    // Adds a recording of the keyword on its own; silence around it is
+    // trimmed. Returns false if too little of it is left.
+    bool addTemplate(const qint16 *samples, int count);
+    int templateCount() const;
+    void clearTemplates();
+
+    bool load(const QString &fileName);
+    bool save(const QString &fileName) const;
+
+    // Asks the extractor to stop at the frame where a keyword was
+    // recognized, and starts a fresh search from the next one.
+    bool consumeFrame(const FeatureFrame &frame);
+
+    void reset();
+
+private:
+    struct Template {
+        QVector<float> features;
+        int frames;
+        // Alignment ending at each template frame: its cost, its length in
+        // steps and the input frame it started at.
+        QVector<float> cost;
+        QVector<int> steps;
+        QVector<qint64> start;
+    };
+
+    bool advance(const float *features, qint64 index);
+    void resetTemplate(Template *keyword);
+    void deriveThreshold();
+
+    int m_sampleRate;
+    QVector<Template> m_templates;
+    qreal m_threshold;
+    qreal m_derivedThreshold;
+
+    // Best score of the match being followed, and frames since it improved.
+    float m_best;
+    int m_settle;
+};
+
+#endif // KEYWORDSPOTTER_H
@@ -0,0 +1,101 @@
+#include "latencytrace.h"
+
+#include <QElapsedTimer>
+
+namespace {
+
+struct Clock
+{
+    Clock() { timer.start(); }
+    QElapsedTimer timer;
+};
+
+}
+
+LatencyTrace::LatencyTrace()
+{
+    for (int i = 0; i < StageCount; ++i)
+        m_timestamps[i] = -1;
+}
+
+qint64 LatencyTrace::now()
+{
+    static Clock clock;
+    return clock.timer.nsecsElapsed();
+}
+
+const char *LatencyTrace::stageName(Stage stage)
+{
+    switch (stage) {
+    case RecordStart: return "recordStart";
+    case FirstFrame: return "firstFrame";
+    case RecordStop: return "recordStop";
+    case EncoderFinalized: return "encoderFinalized";
+    case RequestPosted: return "requestPosted";
+    case UploadComplete: return "uploadComplete";
+    case FirstResponseByte: return "firstResponseByte";
+    case ParseDone: return "parseDone";
+    default: return "";
+    }
+}
+
+void LatencyTrace::mark(Stage stage)
+{
+    if (!has(stage))
+        m_timestamps[stage] = now();
+}
+
+void LatencyTrace::mark(Stage stage, qint64 timestamp)
+{
+    if (!has(stage))
+        m_timestamps[stage] = timestamp;
+}
+
+bool LatencyTrace::has(Stage stage) const
+{
+    return m_timestamps[stage] >= 0;
+}
+
+qint64 LatencyTrace::timestamp(Stage stage) const
+{
+    return m_timestamps[stage];
+}
+
+qreal LatencyTrace::elapsed(Stage from, Stage to) const
+{
+    if (!has(from) || !has(to))
+        return -1;
+    return (m_timestamps[to] - m_timestamps[from]) / 1e6;
+}
+
+void LatencyTrace::merge(const LatencyTrace &other)
+{
+    for (int i = 0; i < StageCount; ++i) {
+        if (m_timestamps[i] < 0)
+            m_timestamps[i] = other.m_timestamps[i];
+    }
+}
+
+QVariantMap LatencyTrace::toVariantMap() const
+{
+    QVariantMap map;
+    qint64 first = -1;
+    qint64 last = -1;
+    for (int i = 0; i < StageCount; ++i) {
+        const qint64 t = m_timestamps[i];
+        if (t < 0)
+            continue;
+        if (first < 0 || t < first)
+            first = t;
+        last = qMax(last, t);
+    }
+    if (first < 0)
+        return map;
+
+    for (int i = 0; i < StageCount; ++i) {
+        if (m_timestamps[i] >= 0)
+            map.insert(stageName(Stage(i)), (m_timestamps[i] - first) / 1e6);
+    }
+    map.insert("total", (last - first) / 1e6);
+    return map;
+}
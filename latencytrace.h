@@ -0,0 +1,53 @@
+#ifndef LATENCYTRACE_H
+#define LATENCYTRACE_H
+
+#include <QMetaType>
+#include <QVariantMap>
+
+// Monotonic timestamps for the stages one utterance goes through, from the
+// start of recording to the parsed result. Stages that did not happen, such
+// as the recorder stages of a file upload, stay unset.
+class LatencyTrace
+{
+public:
+    enum Stage {
+        RecordStart,
+        FirstFrame,
+        RecordStop,
+        EncoderFinalized,
+        RequestPosted,
+        UploadComplete,
+        FirstResponseByte,
+        ParseDone,
+        StageCount
+    };
+
+    LatencyTrace();
+
+    // Nanoseconds on a process-wide monotonic clock.
+    static qint64 now();
+    static const char *stageName(Stage stage);
+
+    // Records |stage| at the current time unless it has already been seen.
+    void mark(Stage stage);
+    void mark(Stage stage, qint64 timestamp);
+
+    bool has(Stage stage) const;
+    qint64 timestamp(Stage stage) const;
+    // Milliseconds between two recorded stages, or -1.
+    qreal elapsed(Stage from, Stage to) const;
+
+    // Takes every stage set in |other| that is unset here.
+    void merge(const LatencyTrace &other);
+
+    // Stage names mapped to milliseconds since the earliest recorded stage,
+    // plus "total" for the whole span; unset stages are left out.
+    QVariantMap toVariantMap() const;
+
+private:
+    qint64 m_timestamps[StageCount];
+};
+
+Q_DECLARE_METATYPE(LatencyTrace)
+
+#endif // LATENCYTRACE_H
@@ -0,0 +1,61 @@
+#include "levelmeter.h"
+#include "dspkernels.h"
+
+#include <math.h>
+
+namespace {
+
+// Snapshot layout: RMS in bits 0-14, peak in bits 15-29, clipping in bit
+// 30 and bit 31 set whenever the word holds a measurement.
+const quint32 kFieldMask = 0x7fff;
+const int kPeakShift = 15;
+const quint32 kClipping = 1u << 30;
+const quint32 kFresh = 1u << 31;
+
+}
+
+LevelMeter::LevelMeter()
+{
+}
+
+void LevelMeter::process(const qint16 *samples, int count)
+{
+    if (count <= 0)
+        return;
+
+    float sumSquares;
+    int peak;
+    int clipped;
+    Dsp::signalLevels(samples, count, &sumSquares, &peak, &clipped);
+    const quint32 rms = quint32(qMin(int(sqrtf(sumSquares / count) + 0.5f), 32767));
+
+    forever {
+        const quint32 old = quint32(m_snapshot.loadAcquire());
+        const quint32 oldRms = old & kFieldMask;
+        const quint32 oldPeak = (old >> kPeakShift) & kFieldMask;
+        const quint32 merged = kFresh
+                | qMax(rms, oldRms)
+                | (qMax(quint32(peak), oldPeak) << kPeakShift)
+                | (clipped ? kClipping : 0)
+                | (old & kClipping);
+        if (m_snapshot.testAndSetRelease(int(old), int(merged)))
+            return;
+    }
+}
+
+bool LevelMeter::take(Levels *levels)
+{
+    const quint32 snapshot = quint32(m_snapshot.fetchAndStoreAcquire(0));
+    if (!(snapshot & kFresh))
+        return false;
+
+    levels->rms = (snapshot & kFieldMask) / 32767.0;
+    levels->peak = ((snapshot >> kPeakShift) & kFieldMask) / 32767.0;
+    levels->clipping = snapshot & kClipping;
+    return true;
+}
+
+void LevelMeter::reset()
+{
+    m_snapshot.storeRelease(0);
+}
@@ -0,0 +1,35 @@
+#ifndef LEVELMETER_H
+#define LEVELMETER_H
+
+#include <QAtomicInt>
+
+// Input levels measured on the audio thread and picked up by the GUI
+// thread. Each buffer is folded into one packed 32-bit word with a
+// compare-and-swap, and the reader swaps that word for zero, so neither
+// side ever waits for the other and no peak between two reads is lost.
+class LevelMeter
+{
+public:
+    struct Levels {
+        // Linear, relative to full scale.
+        qreal rms;
+        qreal peak;
+        bool clipping;
+    };
+
+    LevelMeter();
+
+    // Writer side; called for every captured buffer.
+    void process(const qint16 *samples, int count);
+
+    // Reader side: the loudest levels since the last call, or false if no
+    // audio has been measured since then.
+    bool take(Levels *levels);
+
+    void reset();
+
+private:
+    QAtomicInt m_snapshot;
+};
+
+#endif // LEVELMETER_H
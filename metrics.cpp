@@ -0,0 +1,233 @@
+#include "metrics.h"
+
+#include <QAtomicInt>
+#include <QList>
+#include <QMutex>
+#include <QThreadStorage>
+
+#include <string.h>
+
+namespace {
+
+// In SpeechRecognition::Result order.
+const char *const kResultNames[] = {
+    "success", "aborted", "audio", "network", "no_speech", "no_match", "bad_grammar"
+};
+const int kResultCount = sizeof(kResultNames) / sizeof(kResultNames[0]);
+
+struct CounterInfo {
+    const char *name;
+    const char *help;
+};
+
+const CounterInfo kCounters[Metrics::CounterCount] = {
+    { "speech_requests_total", "Recognition requests sent." },
+    { "speech_uploaded_bytes_total", "Bytes of audio uploaded." },
+    { "speech_cache_hits_total", "Recognitions answered from the result cache." },
+    { "speech_cache_misses_total", "Recognitions the result cache could not answer." }
+};
+
+const CounterInfo kHistograms[Metrics::HistogramCount] = {
+    { "speech_request_duration_seconds", "Time from posting a request to its parsed result." },
+    { "speech_upload_duration_seconds", "Time taken to upload a request's audio." },
+    { "speech_parse_duration_seconds", "Time from the first reply byte to the parsed result." }
+};
+
+// Upper bounds in seconds, shared by every histogram: parsing takes well
+// under a millisecond, a slow recognition tens of seconds.
+const double kBuckets[] = {
+    0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1.0, 2.5, 5.0, 10.0, 30.0
+};
+const int kBucketCount = sizeof(kBuckets) / sizeof(kBuckets[0]);
+
+struct Values
+{
+    qint64 counters[Metrics::CounterCount];
+    qint64 results[kResultCount];
+    // Per histogram, the count in each bucket with +Inf last, not yet
+    // cumulative, and the sum of the observations.
+    qint64 buckets[Metrics::HistogramCount][kBucketCount + 1];
+    double sums[Metrics::HistogramCount];
+
+    Values()
+    {
+        memset(counters, 0, sizeof(counters));
+        memset(results, 0, sizeof(results));
+        memset(buckets, 0, sizeof(buckets));
+        for (int h = 0; h < Metrics::HistogramCount; ++h)
+            sums[h] = 0.0;
+    }
+
+    void addTo(Values *total) const
+    {
+        for (int c = 0; c < Metrics::CounterCount; ++c)
+            total->counters[c] += counters[c];
+        for (int r = 0; r < kResultCount; ++r)
+            total->results[r] += results[r];
+        for (int h = 0; h < Metrics::HistogramCount; ++h) {
+            for (int b = 0; b <= kBucketCount; ++b)
+                total->buckets[h][b] += buckets[h][b];
+            total->sums[h] += sums[h];
+        }
+    }
+};
+
+struct Shard
+{
+    QMutex mutex;
+    Values values;
+};
+
+struct Registry
+{
+    QMutex mutex;
+    QList<Shard *> shards;
+    // What threads that have exited recorded.
+    Values retired;
+};
+
+Q_GLOBAL_STATIC(Registry, registry)
+
+// Outstanding setEnabled(true) calls.
+QAtomicInt enabled;
+
+// Owned by the thread's storage; retires the shard when the thread exits.
+struct ShardOwner
+{
+    Shard *shard;
+
+    ShardOwner() : shard(new Shard)
+    {
+        QMutexLocker locker(&registry()->mutex);
+        registry()->shards.append(shard);
+    }
+
+    ~ShardOwner()
+    {
+        if (!registry.isDestroyed()) {
+            Registry *r = registry();
+            QMutexLocker locker(&r->mutex);
+            r->shards.removeOne(shard);
+            shard->values.addTo(&r->retired);
+        }
+        delete shard;
+    }
+};
+
+Shard *localShard()
+{
+    static QThreadStorage<ShardOwner *> owners;
+    if (!owners.hasLocalData())
+        owners.setLocalData(new ShardOwner);
+    return owners.localData()->shard;
+}
+
+void appendHeader(QByteArray *out, const CounterInfo &info, const char *type)
+{
+    *out += "# HELP ";
+    *out += info.name;
+    *out += ' ';
+    *out += info.help;
+    *out += "\n# TYPE ";
+    *out += info.name;
+    *out += ' ';
+    *out += type;
+    *out += '\n';
+}
+
+}
+
+namespace Metrics {
+
+bool isEnabled()
+{
+    return enabled.load() > 0;
+}
+
+void setEnabled(bool on)
+{
+    if (on)
+        enabled.ref();
+    else
+        enabled.deref();
+}
+
+void add(Counter counter, qint64 value)
+{
+    if (!enabled.load())
+        return;
+    Shard *shard = localShard();
+    QMutexLocker locker(&shard->mutex);
+    shard->values.counters[counter] += value;
+}
+
+void addResult(int result)
+{
+    if (!enabled.load() || result < 0 || result >= kResultCount)
+        return;
+    Shard *shard = localShard();
+    QMutexLocker locker(&shard->mutex);
+    ++shard->values.results[result];
+}
+
+void observe(Histogram histogram, qreal seconds)
+{
+    if (!enabled.load())
+        return;
+    int bucket = 0;
+    while (bucket < kBucketCount && seconds > kBuckets[bucket])
+        ++bucket;
+    Shard *shard = localShard();
+    QMutexLocker locker(&shard->mutex);
+    ++shard->values.buckets[histogram][bucket];
+    shard->values.sums[histogram] += seconds;
+}
+
+QByteArray exposition()
+{
+    Values total;
+    {
+        Registry *r = registry();
+        QMutexLocker locker(&r->mutex);
+        r->retired.addTo(&total);
+        foreach (Shard *shard, r->shards) {
+            QMutexLocker shardLocker(&shard->mutex);
+            shard->values.addTo(&total);
+        }
+    }
+
+    QByteArray out;
+    for (int c = 0; c < CounterCount; ++c) {
+        appendHeader(&out, kCounters[c], "counter");
+        out += kCounters[c].name;
+        out += ' ' + QByteArray::number(total.counters[c]) + '\n';
+    }
+
+    const CounterInfo results = {
+        "speech_results_total", "Finished recognition requests by result."
+    };
+    appendHeader(&out, results, "counter");
+    for (int r = 0; r < kResultCount; ++r) {
+        out += results.name;
+        out += "{result=\"";
+        out += kResultNames[r];
+        out += "\"} " + QByteArray::number(total.results[r]) + '\n';
+    }
+
+    for (int h = 0; h < HistogramCount; ++h) {
+        const QByteArray name = kHistograms[h].name;
+        appendHeader(&out, kHistograms[h], "histogram");
+        qint64 count = 0;
+        for (int b = 0; b <= kBucketCount; ++b) {
+            count += total.buckets[h][b];
+            const QByteArray bound = b < kBucketCount
+                    ? QByteArray::number(kBuckets[b], 'g', 6) : QByteArray("+Inf");
+            out += name + "_bucket{le=\"" + bound + "\"} " + QByteArray::number(count) + '\n';
+        }
+        out += name + "_sum " + QByteArray::number(total.sums[h], 'g', 12) + '\n';
+        out += name + "_count " + QByteArray::number(count) + '\n';
+    }
+    return out;
+}
+
+}
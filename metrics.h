@@ -0,0 +1,51 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <QByteArray>
+
+// Process-wide counters and histograms of recognition traffic, exported in
+// the Prometheus text format; see MetricsExporter. Every thread that
+// records gets a shard of its own, so the GUI thread and the network
+// worker never write the same cache lines. A shard's lock is only ever
+// contended by a scrape, which makes recording cost about one atomic
+// operation. Until recording is enabled every call returns after a single
+// relaxed load. Shards of threads that exit are folded into the totals.
+namespace Metrics {
+
+enum Counter {
+    // Recognition requests sent to the network.
+    Requests,
+    // Bytes of audio handed to uploads.
+    UploadedBytes,
+    CacheHits,
+    CacheMisses,
+    CounterCount
+};
+
+enum Histogram {
+    // From a request being posted to its result being parsed.
+    RequestLatency,
+    // From a request being posted, or a stream being finished, until the
+    // last byte was sent.
+    UploadTime,
+    // From the first byte of the reply to the parsed result.
+    ParseTime,
+    HistogramCount
+};
+
+// Recording is on while any setEnabled(true) has not yet been matched by a
+// setEnabled(false), so independent users can turn it on and off.
+bool isEnabled();
+void setEnabled(bool enabled);
+
+void add(Counter counter, qint64 value = 1);
+// Counts a finished request under its SpeechRecognition::Result.
+void addResult(int result);
+void observe(Histogram histogram, qreal seconds);
+
+// Every metric summed over all shards, in text exposition format 0.0.4.
+QByteArray exposition();
+
+}
+
+#endif // METRICS_H
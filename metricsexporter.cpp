@@ -0,0 +1,150 @@
+#include "metricsexporter.h"
+#include "metrics.h"
+
+#include <QHostAddress>
+#include <QSaveFile>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
+
+namespace {
+
+const char kContentType[] = "text/plain; version=0.0.4; charset=utf-8";
+// Scrape requests are a line and a few headers; anything longer is not one.
+const int kMaxRequestSize = 8192;
+
+QByteArray httpResponse(const QByteArray &status, const QByteArray &body)
+{
+    return "HTTP/1.1 " + status + "\r\n"
+           "Content-Type: " + QByteArray(kContentType) + "\r\n"
+           "Content-Length: " + QByteArray::number(body.size()) + "\r\n"
+           "Connection: close\r\n"
+           "\r\n" + body;
+}
+
+}
+
+MetricsExporter::MetricsExporter(QObject *parent) :
+    QObject(parent),
+    m_server(0)
+{
+    m_timer = new QTimer(this);
+    connect(m_timer, SIGNAL(timeout()), this, SLOT(writeFile()));
+    Metrics::setEnabled(true);
+}
+
+MetricsExporter::~MetricsExporter()
+{
+    Metrics::setEnabled(false);
+}
+
+bool MetricsExporter::listen(quint16 port)
+{
+    if (!m_server) {
+        m_server = new QTcpServer(this);
+        connect(m_server, SIGNAL(newConnection()), this, SLOT(_q_newConnection()));
+    }
+    m_server->close();
+    if (!m_server->listen(QHostAddress::LocalHost, port)) {
+        m_errorString = m_server->errorString();
+        return false;
+    }
+    return true;
+}
+
+void MetricsExporter::close()
+{
+    if (m_server)
+        m_server->close();
+}
+
+quint16 MetricsExporter::port() const
+{
+    return m_server ? m_server->serverPort() : 0;
+}
+
+QString MetricsExporter::errorString() const
+{
+    return m_errorString;
+}
+
+bool MetricsExporter::setFile(const QString &path, int interval)
+{
+    m_file = path;
+    if (m_file.isEmpty()) {
+        m_timer->stop();
+        return true;
+    }
+    m_timer->start(qMax(1000, interval));
+    return writeFile();
+}
+
+QString MetricsExporter::file() const
+{
+    return m_file;
+}
+
+bool MetricsExporter::writeFile()
+{
+    if (m_file.isEmpty())
+        return false;
+    QSaveFile file(m_file);
+    if (!file.open(QIODevice::WriteOnly)) {
+        m_errorString = file.errorString();
+        return false;
+    }
+    file.write(Metrics::exposition());
+    if (!file.commit()) {
+        m_errorString = file.errorString();
+        return false;
+    }
+    return true;
+}
+
+void MetricsExporter::_q_newConnection()
+{
+    while (QTcpSocket *socket = m_server->nextPendingConnection()) {
+        connect(socket, SIGNAL(readyRead()), this, SLOT(_q_readyRead()));
+        connect(socket, SIGNAL(disconnected()), this, SLOT(_q_disconnected()));
+        m_requests.insert(socket, QByteArray());
+    }
+}
+
+void MetricsExporter::_q_readyRead()
+{
+    QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+    if (!socket || !m_requests.contains(socket))
+        return;
+
+    QByteArray &request = m_requests[socket];
+    request += socket->readAll();
+    const int end = request.indexOf("\r\n\r\n");
+    if (end < 0 && request.size() < kMaxRequestSize)
+        return;
+
+    // Only the request line matters; the body of a GET is empty.
+    const QList<QByteArray> line = request.left(request.indexOf("\r\n")).split(' ');
+    m_requests.remove(socket);
+    disconnect(socket, SIGNAL(readyRead()), this, SLOT(_q_readyRead()));
+
+    QByteArray response;
+    if (end < 0 || line.size() < 2)
+        response = httpResponse("400 Bad Request", QByteArray());
+    else if (line.at(0) != "GET")
+        response = httpResponse("405 Method Not Allowed", QByteArray());
+    else if (line.at(1) != "/metrics" && line.at(1) != "/")
+        response = httpResponse("404 Not Found", QByteArray());
+    else
+        response = httpResponse("200 OK", Metrics::exposition());
+    socket->write(response);
+    socket->disconnectFromHost();
+}
+
+void MetricsExporter::_q_disconnected()
+{
+    QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+    if (!socket)
+        return;
+    m_requests.remove(socket);
+    socket->deleteLater();
+}
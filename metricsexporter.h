@@ -0,0 +1,57 @@
+#ifndef METRICSEXPORTER_H
+#define METRICSEXPORTER_H
+
+#include <QObject>
+#include <QHash>
+#include <QByteArray>
+#include <QString>
+
+class QTcpServer;
+class QTcpSocket;
+class QTimer;
+
+// Publishes Metrics for a Prometheus scraper, either over HTTP on a local
+// port or as a stats file rewritten at an interval, as node_exporter's
+// textfile collector reads it; both may run at once. Metric recording is on
+// for the whole process while any exporter exists. The exposition is only
+// built when it is scraped or written, never on the recognition path.
+class MetricsExporter : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit MetricsExporter(QObject *parent = 0);
+    ~MetricsExporter();
+
+    // Serves GET /metrics on 127.0.0.1:|port|; 0 picks a free port.
+    bool listen(quint16 port);
+    void close();
+    quint16 port() const;
+    QString errorString() const;
+
+    // Replaces |path| with the current metrics every |interval|
+    // milliseconds, atomically, so a reader never sees half a file, and
+    // returns whether the first write succeeded. An empty path stops
+    // writing.
+    bool setFile(const QString &path, int interval = 15000);
+    QString file() const;
+
+public Q_SLOTS:
+    // Writes the file now, as well as on the next tick; returns false if
+    // it could not be written.
+    bool writeFile();
+
+private Q_SLOTS:
+    void _q_newConnection();
+    void _q_readyRead();
+    void _q_disconnected();
+
+private:
+    QTcpServer *m_server;
+    QHash<QTcpSocket *, QByteArray> m_requests;
+    QString m_file;
+    QTimer *m_timer;
+    QString m_errorString;
+};
+
+#endif // METRICSEXPORTER_H
@@ -0,0 +1,234 @@
+#include "noisesuppressor.h"
+#include "dspkernels.h"
+
+#include <math.h>
+#include <string.h>
+
+namespace {
+
+const int kFrameMsecs = 32;
+// The spectral high-pass corner and the DC blocker's, in hertz.
+const float kHighPass = 80.0f;
+const float kDcCorner = 20.0f;
+
+// A fresh estimate is a blend of the last frames; its minimum sits a few
+// dB below the mean noise power, which the bias makes up for. The floor
+// can rise about 4 dB a second, enough to follow a fan spinning up
+// without creeping up during a word.
+const float kPowerSmoothing = 0.7f;
+const float kNoiseBias = 1.5f;
+const float kNoiseRise = 1.015f;
+// Ephraim-Malah's weighting, and the most a bin is ever attenuated,
+// about 16 dB: stronger suppression costs the recognizer more in
+// distorted speech than it gains in removed noise.
+const float kPriorSmoothing = 0.98f;
+const float kGainFloor = 0.15f;
+
+// Frames this far above the noise count as speech for the level.
+const float kSpeechRatio = 3.0f;
+// Speech is brought to an RMS of -20 dBFS, with at most 20 dB of gain;
+// peaks are held below full scale.
+const float kTargetLevel = 3277.0f;
+const float kMaxGain = 10.0f;
+const float kMinGain = 0.25f;
+const float kCeiling = 29491.0f;
+const float kLevelSmoothing = 0.1f;
+const float kGainRelease = 0.05f;
+
+int nextPowerOfTwo(int value)
+{
+    int result = 1;
+    while (result < value)
+        result <<= 1;
+    return result;
+}
+
+}
+
+NoiseSuppressor::NoiseSuppressor(int sampleRate) :
+    m_sampleRate(sampleRate),
+    m_frameLength(nextPowerOfTwo(sampleRate * kFrameMsecs / 1000)),
+    m_hop(m_frameLength / 2),
+    m_bins(m_frameLength / 2 + 1),
+    m_cutoff(int(ceilf(kHighPass * m_frameLength / sampleRate))),
+    m_dcPole(float(exp(-2.0 * M_PI * kDcCorner / sampleRate))),
+    m_fft(m_frameLength),
+    m_window(m_frameLength),
+    m_input(m_frameLength),
+    m_overlap(m_frameLength / 2),
+    m_frame(m_frameLength),
+    m_re(m_frameLength / 2 + 1),
+    m_im(m_frameLength / 2 + 1),
+    m_power(m_frameLength / 2 + 1),
+    m_gain(m_frameLength / 2 + 1),
+    m_smoothed(m_frameLength / 2 + 1),
+    m_noise(m_frameLength / 2 + 1),
+    m_clean(m_frameLength / 2 + 1),
+    m_automaticGain(true)
+{
+    // Periodic, so analysis times synthesis sums to one across the overlap.
+    for (int i = 0; i < m_frameLength; ++i)
+        m_window[i] = float(sqrt(0.5 - 0.5 * cos(2.0 * M_PI * i / m_frameLength)));
+    reset();
+}
+
+int NoiseSuppressor::sampleRate() const
+{
+    return m_sampleRate;
+}
+
+int NoiseSuppressor::latency() const
+{
+    return m_hop;
+}
+
+bool NoiseSuppressor::automaticGain() const
+{
+    return m_automaticGain;
+}
+
+void NoiseSuppressor::setAutomaticGain(bool automaticGain)
+{
+    m_automaticGain = automaticGain;
+}
+
+void NoiseSuppressor::reset()
+{
+    // The first frame starts half a frame before the input, on silence.
+    m_input.fill(0.0f);
+    m_fill = m_frameLength - m_hop;
+    m_overlap.fill(0.0f);
+    m_smoothed.fill(0.0f);
+    // Above anything real, so the first frames set it.
+    m_noise.fill(1e30f);
+    m_clean.fill(0.0f);
+    m_dcInput = 0.0f;
+    m_dcOutput = 0.0f;
+    m_primed = false;
+    m_pending = 0;
+    m_level = 0.0f;
+    m_currentGain = 1.0f;
+}
+
+void NoiseSuppressor::process(const qint16 *samples, int count, QVector<qint16> *out)
+{
+    m_pending += count;
+    int offset = 0;
+    while (offset < count) {
+        const int take = qMin(count - offset, m_frameLength - m_fill);
+        float *input = m_input.data() + m_fill;
+        Dsp::toFloat(samples + offset, take, input);
+        removeDc(input, take);
+        m_fill += take;
+        offset += take;
+        if (m_fill < m_frameLength)
+            break;
+
+        processFrame(out);
+        memmove(m_input.data(), m_input.constData() + m_hop,
+                (m_frameLength - m_hop) * sizeof(float));
+        m_fill = m_frameLength - m_hop;
+    }
+}
+
+void NoiseSuppressor::flush(QVector<qint16> *out)
+{
+    // Silence pushes the held samples out; what it adds past them is cut.
+    const int pending = m_pending;
+    const int start = out->size();
+    const QVector<qint16> silence(m_hop, 0);
+    while (out->size() - start < pending)
+        process(silence.constData(), silence.size(), out);
+    out->resize(start + pending);
+    reset();
+}
+
+// y[i] = x[i] - x[i - 1] + pole * y[i - 1]; recursive, so it stays scalar.
+void NoiseSuppressor::removeDc(float *samples, int count)
+{
+    float input = m_dcInput;
+    float output = m_dcOutput;
+    for (int i = 0; i < count; ++i) {
+        const float x = samples[i];
+        output = x - input + m_dcPole * output;
+        input = x;
+        samples[i] = output;
+    }
+    m_dcInput = input;
+    m_dcOutput = output;
+}
+
+void NoiseSuppressor::processFrame(QVector<qint16> *out)
+{
+    float *frame = m_frame.data();
+    float *re = m_re.data();
+    float *im = m_im.data();
+    float *power = m_power.data();
+    float *gain = m_gain.data();
+
+    Dsp::multiply(m_input.constData(), m_window.constData(), m_frameLength, frame);
+    m_fft.forward(frame, re, im);
+    Dsp::powerSpectrum(re, im, m_bins, power);
+    Dsp::trackNoise(power, m_bins, kPowerSmoothing, kNoiseBias, kNoiseRise,
+                    m_smoothed.data(), m_noise.data());
+    Dsp::wienerGain(power, m_noise.constData(), m_bins, kPriorSmoothing, kGainFloor,
+                    m_clean.data(), gain);
+
+    float signal = 0.0f;
+    float noise = 0.0f;
+    for (int k = 0; k < m_bins; ++k) {
+        if (k < m_cutoff) {
+            gain[k] = 0.0f;
+        } else {
+            signal += power[k];
+            noise += m_noise[k];
+        }
+    }
+    Dsp::multiply(re, gain, m_bins, re);
+    Dsp::multiply(im, gain, m_bins, im);
+    m_fft.inverse(re, im, frame);
+
+    // The first half completes the previous frame's second half.
+    float *block = m_overlap.data();
+    Dsp::multiplyAdd(frame, m_window.constData(), m_hop, block);
+    if (m_primed) {
+        if (m_automaticGain)
+            applyGain(block, m_hop, signal > kSpeechRatio * noise);
+        const int size = out->size();
+        out->resize(size + m_hop);
+        Dsp::toInt16(block, m_hop, out->data() + size);
+        m_pending -= m_hop;
+    } else {
+        // That half lies before the input.
+        m_primed = true;
+    }
+    Dsp::multiply(frame + m_hop, m_window.constData() + m_hop, m_hop, block);
+}
+
+void NoiseSuppressor::applyGain(float *samples, int count, bool speech)
+{
+    if (speech) {
+        const float meanSquare = Dsp::dotProduct(samples, samples, count) / count;
+        m_level = m_level > 0.0f ? m_level + kLevelSmoothing * (meanSquare - m_level)
+                                 : meanSquare;
+    }
+
+    float target = m_currentGain;
+    if (m_level > 0.0f)
+        target = qBound(kMinGain, kTargetLevel / sqrtf(m_level), kMaxGain);
+    float peak = 0.0f;
+    for (int i = 0; i < count; ++i)
+        peak = qMax(peak, fabsf(samples[i]));
+    if (peak * target > kCeiling)
+        target = kCeiling / peak;
+
+    // Down at once; up slowly, ramped across the block so the change is
+    // not heard as a click.
+    const float from = qMin(target, m_currentGain);
+    const float next = target < m_currentGain
+            ? target : m_currentGain + kGainRelease * (target - m_currentGain);
+    const float step = (next - from) / count;
+    for (int i = 0; i < count; ++i)
+        samples[i] *= from + step * (i + 1);
+    m_currentGain = next;
+}
@@ -0,0 +1,82 @@
+#ifndef NOISESUPPRESSOR_H
+#define NOISESUPPRESSOR_H
+
+#include <QVector>
+
+#include "fft.h"
+
+// Streaming clean-up of 16-bit mono PCM ahead of encoding. A one-pole DC
+// blocker comes first. The signal is then cut into half-overlapping
+// square-root Hann frames of about 32 ms, each transformed with Fft, and
+// every bin is scaled by a decision-directed Wiener gain against a
+// minimum-tracking estimate of the background noise; bins below the
+// high-pass corner are dropped. The frames are overlap-added back, and an
+// automatic gain control brings speech towards a fixed level, cutting the
+// gain at once when a frame would clip and raising it slowly. Output lags
+// input by exactly half a frame, and every half frame costs one forward
+// and one inverse FFT, so the work per sample is fixed.
+class NoiseSuppressor
+{
+public:
+    explicit NoiseSuppressor(int sampleRate);
+
+    int sampleRate() const;
+    // Samples by which output lags input.
+    int latency() const;
+
+    bool automaticGain() const;
+    void setAutomaticGain(bool automaticGain);
+
+    // Appends to |out| every output sample that |count| more input samples
+    // complete.
+    void process(const qint16 *samples, int count, QVector<qint16> *out);
+    // Pushes the held samples through, for the end of a stream.
+    void flush(QVector<qint16> *out);
+    void reset();
+
+private:
+    Q_DISABLE_COPY(NoiseSuppressor)
+
+    void removeDc(float *samples, int count);
+    void processFrame(QVector<qint16> *out);
+    void applyGain(float *samples, int count, bool speech);
+
+    int m_sampleRate;
+    int m_frameLength;
+    int m_hop;
+    int m_bins;
+    int m_cutoff;
+    float m_dcPole;
+
+    Fft m_fft;
+    QVector<float> m_window;
+
+    QVector<float> m_input;
+    int m_fill;
+    // The second half of the previous frame, waiting for the first half of
+    // the next one.
+    QVector<float> m_overlap;
+    QVector<float> m_frame;
+    QVector<float> m_re;
+    QVector<float> m_im;
+    QVector<float> m_power;
+    QVector<float> m_gain;
+
+    // Per-bin state carried between frames.
+    QVector<float> m_smoothed;
+    QVector<float> m_noise;
+    QVector<float> m_clean;
+
+    float m_dcInput;
+    float m_dcOutput;
+    bool m_primed;
+    // Input samples not yet output.
+    int m_pending;
+
+    bool m_automaticGain;
+    // Mean square of recent speech frames, 0 until one was seen.
+    float m_level;
+    float m_currentGain;
+};
+
+#endif // NOISESUPPRESSOR_H
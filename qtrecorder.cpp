@@ -15,12 +15,76 @@
 */
 
 #include "qtrecorder.h"
+#include "audiostream.h"
+#include "audiocapture.h"
+#include "flacencoder.h"
+#include "speexencoder.h"
+#include "voiceactivitydetector.h"
+#include "noisesuppressor.h"
+#include "audiosegmenter.h"
+#include "featureextractor.h"
+#include "keywordspotter.h"
+#include "dspkernels.h"
+#include "resampler.h"
+#include "levelmeter.h"
+#include <QAudioProbe>
 #include <QFile>
+#include <QTimer>
+#include <QThread>
+
+#include <string.h>
+
+namespace {
+
+// Levels are published at roughly the display's refresh rate; clipping
+// stays lit for half a second.
+const int kLevelInterval = 33;
+const int kClipHoldTicks = 15;
+// Longest keyword example kept during enrollment, in milliseconds.
+const int kMaxEnrollment = 3000;
+
+}
+
 Recorder::Recorder(QObject *parent) :
     QObject(parent),
     m_codec("audio/FLAC"),
     m_quality(0),
     m_volume(100),
+    m_streaming(false),
+    m_backend(MediaRecorderBackend),
+    m_encoder(0),
+    m_speex(0),
+    m_vad(0),
+    m_suppressor(0),
+    m_segmenter(0),
+    m_resampler(0),
+    m_preRollBuffer(0),
+    m_preRollSamples(0),
+    m_preRoll(0),
+    m_warm(false),
+    m_captureOpen(false),
+    m_extractor(0),
+    m_spotter(0),
+    m_keywordSpotting(false),
+    m_keywordThreshold(0),
+    m_triggered(false),
+    m_starting(false),
+    m_enrolling(false),
+    m_voiceDetection(false),
+    m_noiseSuppression(false),
+    m_autoStop(false),
+    m_stopPending(false),
+    m_hangover(800),
+    m_uploadRate(16000),
+    m_bitrate(16800),
+    m_segmentLength(0),
+    m_captureRate(16000),
+    m_sampleRate(16000),
+    m_samples(0),
+    m_duration(0),
+    m_level(0),
+    m_peakLevel(0),
+    m_clipHold(0),
     m_state(QMediaRecorder::StoppedState),
     m_error(QMediaRecorder::ResourceError)
 {
@@ -32,6 +96,33 @@ Recorder::Recorder(QObject *parent) :
             SLOT(_q_stateChanged()));
     connect(audioRecorder, SIGNAL(error(QMediaRecorder::Error)), this,
             SLOT(_q_error()));
+    connect(audioRecorder, SIGNAL(statusChanged(QMediaRecorder::Status)), this,
+            SLOT(_q_statusChanged()));
+
+    m_meter = new LevelMeter;
+    m_probe = new QAudioProbe(this);
+    m_probe->setSource(audioRecorder);
+    connect(m_probe, SIGNAL(audioBufferProbed(QAudioBuffer)), this,
+            SLOT(_q_audioBufferProbed(QAudioBuffer)));
+
+    m_levelTimer = new QTimer(this);
+    m_levelTimer->setInterval(kLevelInterval);
+    connect(m_levelTimer, SIGNAL(timeout()), this, SLOT(_q_updateLevels()));
+
+    m_tailTimer = new QTimer(this);
+    m_tailTimer->setInterval(50);
+    connect(m_tailTimer, SIGNAL(timeout()), this, SLOT(_q_tail()));
+
+    // Two seconds of headroom at the highest capture rate.
+    m_ring = new RingBuffer<qint16>(2 * 88200);
+    m_capture = new AudioCapture(m_ring);
+    m_capture->setLevelMeter(m_meter);
+    // Started by openCapture(), so MediaRecorderBackend users never pay
+    // for an idle time-critical thread.
+    m_captureThread = 0;
+    connect(m_capture, SIGNAL(dataAvailable()), this, SLOT(_q_drain()));
+    connect(m_capture, SIGNAL(stateChanged(int)), this, SLOT(_q_captureStateChanged(int)));
+    connect(m_capture, SIGNAL(error(int)), this, SLOT(_q_captureError(int)));
 }
 
 void Recorder::_q_error()
@@ -53,13 +144,25 @@ QString Recorder::errorString() const
 }
 
 void Recorder::_q_stateChanged()
+{
+    setState(audioRecorder->state());
+}
+
+void Recorder::setState(QMediaRecorder::State state)
 {
     const QMediaRecorder::State oldState = m_state;
-    const QMediaRecorder::State state = audioRecorder->state();
 
-    m_state = audioRecorder->state();
+    m_state = state;
 
     if (state != oldState) {
+        if (state == QMediaRecorder::RecordingState) {
+            m_meter->reset();
+            m_levelTimer->start();
+        } else {
+            m_levelTimer->stop();
+            resetLevels();
+        }
+
         switch (state) {
             case QMediaRecorder::StoppedState:
                 emit stopped();
@@ -141,6 +244,261 @@ void Recorder::setVolume(const qreal &volume)
     emit volumeChanged();
 }
 
+Recorder::Backend Recorder::backend() const
+{
+    return m_backend;
+}
+
+void Recorder::setBackend(const Backend &backend)
+{
+    if (m_backend == backend)
+        return;
+
+    m_backend = backend;
+    emit backendChanged();
+    updateWarm();
+}
+
+int Recorder::preRoll() const
+{
+    return m_preRoll;
+}
+
+void Recorder::setPreRoll(const int &preRoll)
+{
+    if (m_preRoll == preRoll)
+        return;
+
+    m_preRoll = preRoll;
+    emit preRollChanged();
+    if (m_captureOpen)
+        resizePreRoll();
+    updateWarm();
+}
+
+bool Recorder::voiceDetection() const
+{
+    return m_voiceDetection;
+}
+
+void Recorder::setVoiceDetection(const bool &voiceDetection)
+{
+    if (m_voiceDetection == voiceDetection)
+        return;
+
+    m_voiceDetection = voiceDetection;
+    emit voiceDetectionChanged();
+}
+
+bool Recorder::autoStop() const
+{
+    return m_autoStop;
+}
+
+void Recorder::setAutoStop(const bool &autoStop)
+{
+    if (m_autoStop == autoStop)
+        return;
+
+    m_autoStop = autoStop;
+    emit autoStopChanged();
+}
+
+int Recorder::hangover() const
+{
+    return m_hangover;
+}
+
+void Recorder::setHangover(const int &hangover)
+{
+    if (m_hangover == hangover)
+        return;
+
+    m_hangover = hangover;
+    if (m_vad)
+        m_vad->setHangover(m_hangover);
+    emit hangoverChanged();
+}
+
+bool Recorder::noiseSuppression() const
+{
+    return m_noiseSuppression;
+}
+
+void Recorder::setNoiseSuppression(const bool &noiseSuppression)
+{
+    if (m_noiseSuppression == noiseSuppression)
+        return;
+
+    m_noiseSuppression = noiseSuppression;
+    emit noiseSuppressionChanged();
+}
+
+int Recorder::uploadRate() const
+{
+    return m_uploadRate;
+}
+
+void Recorder::setUploadRate(const int &uploadRate)
+{
+    if (m_uploadRate == uploadRate)
+        return;
+
+    m_uploadRate = uploadRate;
+    emit uploadRateChanged();
+}
+
+int Recorder::bitrate() const
+{
+    return m_bitrate;
+}
+
+void Recorder::setBitrate(const int &bitrate)
+{
+    if (m_bitrate == bitrate)
+        return;
+
+    m_bitrate = bitrate;
+    emit bitrateChanged();
+}
+
+int Recorder::segmentLength() const
+{
+    return m_segmentLength;
+}
+
+void Recorder::setSegmentLength(const int &segmentLength)
+{
+    const int length = qMax(0, segmentLength);
+    if (m_segmentLength == length)
+        return;
+
+    m_segmentLength = length;
+    emit segmentLengthChanged();
+}
+
+bool Recorder::keywordSpotting() const
+{
+    return m_keywordSpotting;
+}
+
+void Recorder::setKeywordSpotting(const bool &keywordSpotting)
+{
+    if (m_keywordSpotting == keywordSpotting)
+        return;
+
+    m_keywordSpotting = keywordSpotting;
+    emit keywordSpottingChanged();
+    if (m_captureOpen) {
+        resizePreRoll();
+        createSpotter();
+    }
+    updateWarm();
+}
+
+QString Recorder::keywordModel() const
+{
+    return m_keywordModel;
+}
+
+void Recorder::setKeywordModel(const QString &keywordModel)
+{
+    if (m_keywordModel == keywordModel)
+        return;
+
+    m_keywordModel = keywordModel;
+    emit keywordModelChanged();
+    if (m_spotter) {
+        if (!m_spotter->load(m_keywordModel))
+            m_spotter->clearTemplates();
+        emit keywordTemplatesChanged();
+    }
+}
+
+qreal Recorder::keywordThreshold() const
+{
+    return m_keywordThreshold;
+}
+
+void Recorder::setKeywordThreshold(const qreal &keywordThreshold)
+{
+    if (m_keywordThreshold == keywordThreshold)
+        return;
+
+    m_keywordThreshold = keywordThreshold;
+    if (m_spotter)
+        m_spotter->setThreshold(m_keywordThreshold);
+    emit keywordThresholdChanged();
+}
+
+int Recorder::keywordTemplates() const
+{
+    return m_spotter ? m_spotter->templateCount() : 0;
+}
+
+void Recorder::startKeywordEnrollment()
+{
+    if (!m_spotter)
+        return;
+
+    // What came before is still searched, and may itself start a recording.
+    _q_drain();
+    if (m_state != QMediaRecorder::StoppedState)
+        return;
+    m_enrollment.clear();
+    m_enrolling = true;
+}
+
+bool Recorder::finishKeywordEnrollment()
+{
+    if (!m_enrolling)
+        return false;
+
+    _q_drain();
+    m_enrolling = false;
+    const bool added = m_spotter->addTemplate(m_enrollment.constData(), m_enrollment.size());
+    m_enrollment.clear();
+    m_extractor->reset();
+    m_spotter->reset();
+    if (!added)
+        return false;
+
+    if (!m_keywordModel.isEmpty())
+        m_spotter->save(m_keywordModel);
+    emit keywordTemplatesChanged();
+    return true;
+}
+
+void Recorder::clearKeywordTemplates()
+{
+    if (!m_spotter)
+        return;
+
+    m_spotter->clearTemplates();
+    if (!m_keywordModel.isEmpty())
+        m_spotter->save(m_keywordModel);
+    emit keywordTemplatesChanged();
+}
+
+bool Recorder::streaming() const
+{
+    return m_streaming;
+}
+
+void Recorder::setStreaming(const bool &streaming)
+{
+    if (m_streaming == streaming)
+        return;
+
+    m_streaming = streaming;
+    emit streamingChanged();
+}
+
+AudioStream *Recorder::audioStream() const
+{
+    return m_stream;
+}
+
 qint64 Recorder::duration() const
 {
     return m_duration;
@@ -152,13 +510,108 @@ void Recorder::_q_durationChanged()
     emit durationChanged();
 }
 
+qreal Recorder::level() const
+{
+    return m_level;
+}
+
+qreal Recorder::peakLevel() const
+{
+    return m_peakLevel;
+}
+
+bool Recorder::clipping() const
+{
+    return m_clipHold > 0;
+}
+
+// Runs on the recorder's thread at a fixed rate, independent of how often
+// the audio thread delivers buffers.
+void Recorder::_q_updateLevels()
+{
+    LevelMeter::Levels levels;
+    if (!m_meter->take(&levels)) {
+        // Nothing captured since the last tick; let clipping expire.
+        if (m_clipHold > 0 && --m_clipHold == 0)
+            emit levelsChanged();
+        return;
+    }
+
+    m_level = levels.rms;
+    m_peakLevel = levels.peak;
+    if (levels.clipping)
+        m_clipHold = kClipHoldTicks;
+    else if (m_clipHold > 0)
+        --m_clipHold;
+    emit levelsChanged();
+}
+
+void Recorder::resetLevels()
+{
+    if (m_level == 0 && m_peakLevel == 0 && m_clipHold == 0)
+        return;
+
+    m_level = 0;
+    m_peakLevel = 0;
+    m_clipHold = 0;
+    emit levelsChanged();
+}
+
+// MediaRecorderBackend only; the capture thread measures its own buffers.
+void Recorder::_q_audioBufferProbed(const QAudioBuffer &buffer)
+{
+    const QAudioFormat format = buffer.format();
+    if (format.sampleSize() != 16 || format.sampleType() != QAudioFormat::SignedInt
+            || format.byteOrder() != QAudioFormat::LittleEndian)
+        return;
+
+    m_meter->process(buffer.constData<qint16>(), buffer.sampleCount());
+}
+
 Recorder::~Recorder()
 {
+    if (m_captureThread) {
+        QMetaObject::invokeMethod(m_capture, "stop", Qt::BlockingQueuedConnection);
+        m_captureThread->quit();
+        m_captureThread->wait();
+    } else {
+        delete m_capture;
+    }
+    delete m_ring;
+    delete m_preRollBuffer;
+    delete m_spotter;
+    delete m_extractor;
+    delete m_meter;
+    delete m_encoder;
+    delete m_speex;
+    delete m_vad;
+    delete m_suppressor;
+    delete m_segmenter;
+    delete m_resampler;
+
     delete audioRecorder;
 }
 
-void Recorder::start() //TODO: reduce noise settings
+int Recorder::sampleRateForQuality() const
+{
+    switch (m_quality) {
+    case 0: return 8000;
+    case 1: return 16000;
+    case 2: return 22050;
+    case 3: return 44100;
+    case 4: return 88200;
+    default: return -1;
+    }
+}
+
+void Recorder::start()
 {
+    if (m_backend == AudioInputBackend) {
+        if (m_state == QMediaRecorder::StoppedState)
+            startCapture();
+        return;
+    }
+
     if (audioRecorder->state() == QMediaRecorder::StoppedState) {
         QAudioEncoderSettings audioSettings;
 
@@ -170,22 +623,7 @@ void Recorder::start() //TODO: reduce noise settings
         audioSettings.setQuality(QMultimedia::EncodingQuality(m_quality));
 
         if (audioSettings.codec() == "audio/PCM" || "audio/FLAC") {
-            audioSettings.setSampleRate(-1);
-
-            if (m_quality == 0)
-                {audioSettings.setSampleRate(8000);}
-
-            if (m_quality == 1)
-                {audioSettings.setSampleRate(16000);}
-
-            if (m_quality == 2)
-                {audioSettings.setSampleRate(22050);}
-
-            if (m_quality == 3)
-                {audioSettings.setSampleRate(44100);}
-
-            if (m_quality == 4)
-                {audioSettings.setSampleRate(88200);}
+            audioSettings.setSampleRate(sampleRateForQuality());
             }
 
         audioRecorder->setEncodingSettings(audioSettings);
@@ -206,10 +644,497 @@ void Recorder::start() //TODO: reduce noise settings
 
         audioRecorder->setOutputLocation(QUrl(cPath));
 
+        if (m_streaming) {
+            // The previous stream is still ours if nobody picked it up.
+            if (!m_stream.isNull() && m_stream->parent() == this)
+                m_stream->deleteLater();
+
+            m_stream = new AudioStream(this);
+            m_stream->mark(LatencyTrace::RecordStart);
+            m_stream->setContentType(QString("audio/x-flac; rate=%1")
+                                     .arg(audioSettings.sampleRate()).toLatin1());
+
+            m_tailFile.close();
+            m_tailFile.setFileName(cPath);
+            QFile::remove(cPath);
+            m_tailTimer->start();
+        }
+
         audioRecorder->record();
     }
 }
 
+// Forwards whatever the backend has appended to the output file since the
+// last tick, so the upload runs behind the encoder by at most one interval.
+void Recorder::_q_tail()
+{
+    if (m_stream.isNull()) {
+        m_tailTimer->stop();
+        return;
+    }
+
+    if (!m_tailFile.isOpen() && !m_tailFile.open(QIODevice::ReadOnly))
+        return;
+
+    const QByteArray data = m_tailFile.readAll();
+    if (!data.isEmpty()) {
+        m_stream->mark(LatencyTrace::FirstFrame);
+        m_stream->write(data);
+    }
+}
+
+void Recorder::_q_statusChanged()
+{
+    if (!m_tailTimer->isActive() || audioRecorder->state() != QMediaRecorder::StoppedState)
+        return;
+
+    switch (audioRecorder->status()) {
+    case QMediaRecorder::LoadedStatus:
+    case QMediaRecorder::UnloadedStatus:
+    case QMediaRecorder::UnavailableStatus:
+        // The encoder has flushed the file; send the tail and close the stream.
+        _q_tail();
+        m_tailTimer->stop();
+        m_tailFile.close();
+        if (!m_stream.isNull()) {
+            m_stream->mark(LatencyTrace::EncoderFinalized);
+            m_stream->finish();
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+void Recorder::startCapture()
+{
+    m_stopPending = false;
+    if (!m_stream.isNull() && m_stream->parent() == this)
+        m_stream->deleteLater();
+
+    m_sampleRate = m_uploadRate > 0 ? m_uploadRate : sampleRateForQuality();
+    if (m_sampleRate <= 0)
+        m_sampleRate = 16000;
+    // A warm device keeps the rate it was opened with.
+    if (!m_captureOpen)
+        configureCapture();
+    m_enrolling = false;
+    if (m_spotter) {
+        m_extractor->reset();
+        m_spotter->reset();
+    }
+
+    delete m_resampler;
+    m_resampler = new Resampler(m_captureRate, m_sampleRate);
+
+    delete m_vad;
+    m_vad = 0;
+    if (m_voiceDetection) {
+        m_vad = new VoiceActivityDetector(m_sampleRate);
+        m_vad->setHangover(m_hangover);
+        connect(m_vad, SIGNAL(speechStarted()), this, SIGNAL(speechStarted()));
+        connect(m_vad, SIGNAL(endOfSpeech()), this, SLOT(_q_endOfSpeech()));
+    }
+
+    delete m_suppressor;
+    m_suppressor = 0;
+    if (m_noiseSuppression)
+        m_suppressor = new NoiseSuppressor(m_sampleRate);
+
+    delete m_segmenter;
+    m_segmenter = 0;
+    if (m_segmentLength > 0)
+        m_segmenter = new AudioSegmenter(m_sampleRate, m_segmentLength);
+
+    openStream();
+
+    m_samples = 0;
+    m_duration = 0;
+    emit durationChanged();
+
+    if (m_warm) {
+        openCapture();
+        // Top up the pre-roll with what arrived since the last drain, then
+        // record from its start. An end of speech found in it stops the
+        // recording on the next drain. A keyword in it must not start
+        // another recording from inside this one.
+        m_starting = true;
+        drain();
+        m_starting = false;
+        flushPreRoll();
+        setState(QMediaRecorder::RecordingState);
+        return;
+    }
+
+    openCapture();
+}
+
+// Starts a new stream and the encoder feeding it.
+void Recorder::openStream()
+{
+    delete m_encoder;
+    m_encoder = 0;
+    delete m_speex;
+    m_speex = 0;
+
+    m_stream = new AudioStream(this);
+    m_stream->mark(LatencyTrace::RecordStart);
+    if (m_codec == "audio/FLAC") {
+        // Encode in-process rather than relying on the multimedia backend.
+        m_encoder = new FlacEncoder(m_sampleRate);
+        m_stream->setContentType(QString("audio/x-flac; rate=%1").arg(m_sampleRate).toLatin1());
+        m_stream->write(m_encoder->streamHeader());
+    } else if (m_codec == "audio/speex" && SpeexEncoder::isAvailable()) {
+        m_speex = new SpeexEncoder(m_sampleRate, m_bitrate);
+        m_stream->setContentType(SpeexEncoder::contentType(m_sampleRate));
+    } else {
+        m_stream->setContentType(QString("audio/l16; rate=%1").arg(m_sampleRate).toLatin1());
+    }
+}
+
+void Recorder::configureCapture()
+{
+    m_captureRate = AudioCapture::nativeSampleRate();
+
+    QAudioFormat format = m_capture->format();
+    format.setSampleRate(m_captureRate);
+    m_capture->setFormat(format);
+    resizePreRoll();
+    createSpotter();
+}
+
+// Drops the pre-roll collected so far.
+void Recorder::resizePreRoll()
+{
+    delete m_preRollBuffer;
+    m_preRollBuffer = 0;
+    m_preRollSamples = int(qint64(qMax(0, m_preRoll)) * m_captureRate / 1000);
+    // With keyword spotting it also holds what follows the keyword until
+    // the recording has started.
+    int capacity = m_preRollSamples;
+    if (m_keywordSpotting)
+        capacity = qMax(capacity, m_captureRate / 2);
+    if (capacity > 0)
+        m_preRollBuffer = new RingBuffer<qint16>(capacity);
+}
+
+// The spotter runs at the capture rate, so it is rebuilt with the device
+// and its templates reloaded from the model file.
+void Recorder::createSpotter()
+{
+    delete m_spotter;
+    m_spotter = 0;
+    delete m_extractor;
+    m_extractor = 0;
+    m_enrolling = false;
+    if (m_keywordSpotting) {
+        m_spotter = new KeywordSpotter(m_captureRate);
+        m_spotter->setThreshold(m_keywordThreshold);
+        if (!m_keywordModel.isEmpty())
+            m_spotter->load(m_keywordModel);
+        m_extractor = new FeatureExtractor(m_captureRate);
+        m_extractor->addConsumer(m_spotter, FeatureExtractor::Mfcc);
+    }
+    emit keywordTemplatesChanged();
+}
+
+void Recorder::openCapture()
+{
+    if (m_captureOpen)
+        return;
+
+    if (!m_captureThread) {
+        m_captureThread = new QThread(this);
+        m_capture->moveToThread(m_captureThread);
+        connect(m_captureThread, SIGNAL(finished()), m_capture, SLOT(deleteLater()));
+        m_captureThread->start(QThread::TimeCriticalPriority);
+    }
+
+    m_captureOpen = true;
+    m_ring->clear();
+    QMetaObject::invokeMethod(m_capture, "start", Qt::QueuedConnection);
+}
+
+// Opens the device while idle when the pre-roll or keyword spotting is
+// wanted, and closes it once neither is.
+void Recorder::updateWarm()
+{
+    m_warm = (m_preRoll > 0 || m_keywordSpotting) && m_backend == AudioInputBackend;
+    if (m_state != QMediaRecorder::StoppedState)
+        return;
+
+    if (m_warm) {
+        if (!m_captureOpen)
+            configureCapture();
+        openCapture();
+    } else if (m_captureOpen) {
+        m_captureOpen = false;
+        QMetaObject::invokeMethod(m_capture, "stop", Qt::QueuedConnection);
+    }
+}
+
+// Runs on the recorder's thread whenever the capture thread has pushed new
+// PCM into the ring buffer.
+void Recorder::_q_drain()
+{
+    drain();
+
+    // An auto-stop raised by the VAD waits for the loop to return: stopping
+    // from inside it would finish the stream it is still writing to.
+    if (m_stopPending) {
+        m_stopPending = false;
+        stop();
+    }
+}
+
+// Feeds whatever the capture thread has queued through the pipeline.
+void Recorder::drain()
+{
+    m_capture->acknowledge();
+
+    qint16 block[1024];
+    int count;
+    while ((count = m_ring->read(block, 1024)) > 0) {
+        if (m_state == QMediaRecorder::RecordingState)
+            processPcm(block, count);
+        else if (m_warm)
+            listen(block, count);
+        else if (m_state == QMediaRecorder::PausedState)
+            processPcm(block, count);
+        // Otherwise the device is closing with no recording to take it.
+    }
+}
+
+// Takes what a warm device captures while not recording: an enrollment
+// example, or else pre-roll and the keyword search.
+void Recorder::listen(const qint16 *samples, int count)
+{
+    if (m_enrolling) {
+        const int size = m_enrollment.size();
+        const int take = qMin(count, int(qint64(kMaxEnrollment) * m_captureRate / 1000) - size);
+        if (take > 0) {
+            m_enrollment.resize(size + take);
+            memcpy(m_enrollment.data() + size, samples, take * sizeof(qint16));
+        }
+        return;
+    }
+
+    int keyword = -1;
+    if (m_spotter && !m_triggered && !m_starting && m_state == QMediaRecorder::StoppedState)
+        keyword = m_extractor->process(samples, count);
+    if (keyword >= 0) {
+        // Nothing up to the end of the keyword is recorded.
+        m_triggered = true;
+        m_preRollBuffer->clear();
+        samples += keyword;
+        count -= keyword;
+    }
+
+    if (m_preRollBuffer && (m_preRoll > 0 || m_triggered))
+        keepPreRoll(samples, count);
+
+    if (keyword >= 0) {
+        start();
+        m_triggered = false;
+        emit keywordDetected();
+    }
+}
+
+void Recorder::keepPreRoll(const qint16 *samples, int count)
+{
+    // Between a keyword and the start of the recording nothing is dropped.
+    const int limit = m_triggered ? m_preRollBuffer->capacity() : m_preRollSamples;
+    if (count >= limit) {
+        m_preRollBuffer->clear();
+        samples += count - limit;
+        count = limit;
+    }
+
+    const int excess = m_preRollBuffer->readAvailable() + count - limit;
+    if (excess > 0)
+        m_preRollBuffer->discard(excess);
+    m_preRollBuffer->write(samples, count);
+}
+
+void Recorder::flushPreRoll()
+{
+    if (!m_preRollBuffer)
+        return;
+
+    qint16 block[1024];
+    int count;
+    while ((count = m_preRollBuffer->read(block, 1024)) > 0)
+        processPcm(block, count);
+}
+
+void Recorder::processPcm(const qint16 *samples, int count)
+{
+    if (m_samples == 0 && !m_stream.isNull())
+        m_stream->mark(LatencyTrace::FirstFrame);
+
+    if (m_resampler->isPassThrough()) {
+        processResampled(samples, count);
+    } else {
+        m_resampled.resize(0);
+        m_resampler->process(samples, count, &m_resampled);
+        processResampled(m_resampled.constData(), m_resampled.size());
+    }
+
+    m_samples += count;
+    const qint64 duration = m_samples * 1000 / m_captureRate;
+    if (duration != m_duration) {
+        m_duration = duration;
+        emit durationChanged();
+    }
+}
+
+void Recorder::processResampled(const qint16 *samples, int count)
+{
+    if (m_suppressor) {
+        m_suppressed.resize(0);
+        m_suppressor->process(samples, count, &m_suppressed);
+        detectVoice(m_suppressed.constData(), m_suppressed.size());
+    } else {
+        detectVoice(samples, count);
+    }
+}
+
+void Recorder::detectVoice(const qint16 *samples, int count)
+{
+    if (m_vad) {
+        m_voiced.resize(0);
+        m_vad->process(samples, count, &m_voiced);
+        encodePcm(m_voiced.constData(), m_voiced.size());
+    } else {
+        encodePcm(samples, count);
+    }
+}
+
+void Recorder::encodePcm(const qint16 *samples, int count)
+{
+    while (m_segmenter && count > 0) {
+        const int cut = m_segmenter->process(samples, count);
+        if (cut < 0)
+            break;
+        writePcm(samples, cut);
+        samples += cut;
+        count -= cut;
+
+        // The segment's stream was handed out when it started; if nobody
+        // took it then, nobody will.
+        finishStream();
+        if (!m_stream.isNull() && m_stream->parent() == this)
+            m_stream->deleteLater();
+        openStream();
+        m_stream->mark(LatencyTrace::FirstFrame);
+        emit segmentStarted();
+    }
+    writePcm(samples, count);
+}
+
+void Recorder::writePcm(const qint16 *samples, int count)
+{
+    if (count <= 0)
+        return;
+
+    if (m_encoder || m_speex) {
+        const QByteArray frames = m_encoder ? m_encoder->encode(samples, count)
+                                            : m_speex->encode(samples, count);
+        if (!frames.isEmpty() && !m_stream.isNull())
+            m_stream->write(frames);
+    } else if (!m_stream.isNull()) {
+        QByteArray data(count * int(sizeof(qint16)), Qt::Uninitialized);
+        Dsp::toBigEndian(samples, count, reinterpret_cast<uchar *>(data.data()));
+        m_stream->write(data);
+    }
+}
+
+void Recorder::_q_endOfSpeech()
+{
+    emit endOfSpeech();
+
+    if (m_autoStop)
+        m_stopPending = true;
+}
+
+void Recorder::_q_captureStateChanged(int state)
+{
+    switch (QAudio::State(state)) {
+    case QAudio::ActiveState:
+    case QAudio::IdleState:
+        // A warm device runs while idle; start() changes the state itself.
+        if (!m_warm)
+            setState(QMediaRecorder::RecordingState);
+        break;
+    case QAudio::SuspendedState:
+        setState(QMediaRecorder::PausedState);
+        break;
+    case QAudio::StoppedState:
+        m_captureOpen = false;
+        // A warm device closed while idle, or one whose warmth was just
+        // switched off; there is no recording to finish.
+        if (m_state == QMediaRecorder::StoppedState)
+            break;
+        drain();
+        finishRecording();
+        setState(QMediaRecorder::StoppedState);
+        break;
+    }
+}
+
+// Flushes every stage of the AudioInputBackend pipeline and ends the stream.
+void Recorder::finishRecording()
+{
+    if (m_resampler && !m_resampler->isPassThrough()) {
+        m_resampled.resize(0);
+        m_resampler->flush(&m_resampled);
+        processResampled(m_resampled.constData(), m_resampled.size());
+    }
+    if (m_suppressor) {
+        m_suppressed.resize(0);
+        m_suppressor->flush(&m_suppressed);
+        detectVoice(m_suppressed.constData(), m_suppressed.size());
+    }
+    if (m_vad) {
+        m_voiced.resize(0);
+        m_vad->flush(&m_voiced);
+        encodePcm(m_voiced.constData(), m_voiced.size());
+    }
+    // Already stopping; the flush may have ended speech once more.
+    m_stopPending = false;
+    finishStream();
+}
+
+void Recorder::finishStream()
+{
+    if (m_encoder && !m_stream.isNull())
+        m_stream->write(m_encoder->finish());
+    if (m_speex && !m_stream.isNull())
+        m_stream->write(m_speex->finish());
+    if (!m_stream.isNull()) {
+        m_stream->mark(LatencyTrace::EncoderFinalized);
+        m_stream->finish();
+    }
+}
+
+void Recorder::_q_captureError(int error)
+{
+    m_error = QMediaRecorder::ResourceError;
+    switch (QAudio::Error(error)) {
+    case QAudio::OpenError:
+        m_errorString = tr("Could not open the audio input device");
+        break;
+    case QAudio::IOError:
+        m_errorString = tr("Error reading from the audio input device");
+        break;
+    default:
+        m_errorString = tr("Audio input error");
+        break;
+    }
+
+    emit errorChanged();
+}
+
 QString Recorder::getFilePath()
 {
     return cPath;
@@ -217,6 +1142,23 @@ QString Recorder::getFilePath()
 
 void Recorder::stop()
 {
+    if (!m_stream.isNull() && m_state != QMediaRecorder::StoppedState)
+        m_stream->mark(LatencyTrace::RecordStop);
+
+    if (m_backend == AudioInputBackend) {
+        if (m_state == QMediaRecorder::StoppedState)
+            return;
+        if (m_warm && m_captureOpen) {
+            // Leave the device running for the next pre-roll.
+            drain();
+            finishRecording();
+            setState(QMediaRecorder::StoppedState);
+        } else {
+            QMetaObject::invokeMethod(m_capture, "stop", Qt::QueuedConnection);
+        }
+        return;
+    }
+
     if (audioRecorder->state() == QMediaRecorder::RecordingState ||
             audioRecorder->state() == QMediaRecorder::PausedState) {
 
@@ -226,6 +1168,16 @@ void Recorder::stop()
 
 void  Recorder::pause()
 {
+    if (m_backend == AudioInputBackend) {
+        if (m_state != QMediaRecorder::RecordingState)
+            return;
+        if (m_warm)
+            setState(QMediaRecorder::PausedState);
+        else
+            QMetaObject::invokeMethod(m_capture, "suspend", Qt::QueuedConnection);
+        return;
+    }
+
     if (audioRecorder->state() == QMediaRecorder::RecordingState) {
         audioRecorder->pause();
     }
@@ -233,55 +1185,65 @@ void  Recorder::pause()
 
 void Recorder::resume()
 {
+    if (m_backend == AudioInputBackend) {
+        if (m_state != QMediaRecorder::PausedState)
+            return;
+        if (m_warm) {
+            // What was said while paused is not part of the recording.
+            _q_drain();
+            if (m_preRollBuffer)
+                m_preRollBuffer->clear();
+            setState(QMediaRecorder::RecordingState);
+        } else {
+            QMetaObject::invokeMethod(m_capture, "resume", Qt::QueuedConnection);
+        }
+        return;
+    }
+
     if (audioRecorder->state() == QMediaRecorder::PausedState) {
         audioRecorder->record();
     }
 }
 
-// It parses codec name to get the corrisponding container
-QString Recorder::getContainerFromCodec(QString codec)
-{
-    QString container = "";
-
-    if (codec == "audio/vorbis")
-        { container = "ogg";}
+namespace {
 
-    if (codec == "audio/PCM")
-        { container = "wav";}
+struct CodecFormat {
+    const char *codec;
+    const char *container;
+    const char *extension;
+};
 
-    if (codec == "audio/FLAC")
-        { container = "raw";}
+const CodecFormat kCodecFormats[] = {
+    { "audio/vorbis", "ogg", ".ogg" },
+    { "audio/PCM", "wav", ".wav" },
+    { "audio/FLAC", "raw", ".flac" },
+    { "audio/AMR", "amr", ".amr" },
+    { "audio/mpeg", "raw", ".mp3" }
+};
 
-    if (codec == "audio/AMR")
-        { container = "amr";}
+const CodecFormat *findCodecFormat(const QString &codec)
+{
+    for (size_t i = 0; i < sizeof(kCodecFormats) / sizeof(kCodecFormats[0]); ++i) {
+        if (codec == QLatin1String(kCodecFormats[i].codec))
+            return &kCodecFormats[i];
+    }
+    return 0;
+}
 
-    if (codec == "audio/mpeg")
-        { container = "raw";}
+}
 
-    return container;
+// It parses codec name to get the corrisponding container
+QString Recorder::getContainerFromCodec(const QString &codec)
+{
+    const CodecFormat *format = findCodecFormat(codec);
+    return format ? QString::fromLatin1(format->container) : QString();
 }
 
 // It parses codec name to get the corrisponding extension
-QString Recorder::getExtensionFromCodec(QString codec)
+QString Recorder::getExtensionFromCodec(const QString &codec)
 {
-    QString extension = "";
-
-    if (codec == "audio/vorbis")
-        { extension = ".ogg";}
-
-    if (codec == "audio/PCM")
-        { extension = ".wav";}
-
-    if (codec == "audio/FLAC")
-        { extension = ".flac";}
-
-    if (codec == "audio/AMR")
-        { extension = ".amr";}
-
-    if (codec == "audio/mpeg")
-        { extension = ".mp3";}
-
-    return extension;
+    const CodecFormat *format = findCodecFormat(codec);
+    return format ? QString::fromLatin1(format->extension) : QString();
 }
 
 QStringList Recorder::getSupportedCodecs()
@@ -302,6 +1264,10 @@ QStringList Recorder::getSupportedCodecs()
             {codecsList << codec;}
     }
 
+    // Encoded in-process, so only AudioInputBackend can record it.
+    if (SpeexEncoder::isAvailable())
+        codecsList << "audio/speex";
+
     return codecsList;
 }
 
@@ -3,9 +3,30 @@
 #include <QtQml/qqmlparserstatus.h>
 #include <QtQml/qqml.h>
 #include <QAudioRecorder>
+#include <QAudioBuffer>
 #include <QMediaRecorder>
 #include <QMultimedia>
 #include <QUrl>
+#include <QFile>
+#include <QPointer>
+#include <QVector>
+
+#include "ringbuffer.h"
+
+class QTimer;
+class QThread;
+class AudioStream;
+class AudioCapture;
+class FlacEncoder;
+class SpeexEncoder;
+class VoiceActivityDetector;
+class NoiseSuppressor;
+class AudioSegmenter;
+class FeatureExtractor;
+class KeywordSpotter;
+class Resampler;
+class LevelMeter;
+class QAudioProbe;
 
 class Recorder : public QObject
 {
@@ -14,12 +35,30 @@ class Recorder : public QObject
     Q_PROPERTY  (QString    codec           READ codec           WRITE setCodec      NOTIFY codecChanged)
     Q_PROPERTY  (int        quality         READ quality         WRITE setQuality    NOTIFY qualityChanged)
     Q_PROPERTY  (qreal      volume          READ volume          WRITE setVolume     NOTIFY volumeChanged)
+    Q_PROPERTY  (bool       streaming       READ streaming       WRITE setStreaming  NOTIFY streamingChanged)
+    Q_PROPERTY  (Backend    backend         READ backend         WRITE setBackend    NOTIFY backendChanged)
+    Q_PROPERTY  (bool       voiceDetection  READ voiceDetection  WRITE setVoiceDetection NOTIFY voiceDetectionChanged)
+    Q_PROPERTY  (bool       noiseSuppression READ noiseSuppression WRITE setNoiseSuppression NOTIFY noiseSuppressionChanged)
+    Q_PROPERTY  (bool       autoStop        READ autoStop        WRITE setAutoStop   NOTIFY autoStopChanged)
+    Q_PROPERTY  (int        hangover        READ hangover        WRITE setHangover   NOTIFY hangoverChanged)
+    Q_PROPERTY  (int        uploadRate      READ uploadRate      WRITE setUploadRate NOTIFY uploadRateChanged)
+    Q_PROPERTY  (int        preRoll         READ preRoll         WRITE setPreRoll    NOTIFY preRollChanged)
+    Q_PROPERTY  (int        bitrate         READ bitrate         WRITE setBitrate    NOTIFY bitrateChanged)
+    Q_PROPERTY  (int        segmentLength   READ segmentLength   WRITE setSegmentLength NOTIFY segmentLengthChanged)
+    Q_PROPERTY  (bool       keywordSpotting READ keywordSpotting WRITE setKeywordSpotting NOTIFY keywordSpottingChanged)
+    Q_PROPERTY  (QString    keywordModel    READ keywordModel    WRITE setKeywordModel NOTIFY keywordModelChanged)
+    Q_PROPERTY  (qreal      keywordThreshold READ keywordThreshold WRITE setKeywordThreshold NOTIFY keywordThresholdChanged)
+    Q_PROPERTY  (int        keywordTemplates READ keywordTemplates                   NOTIFY keywordTemplatesChanged)
     Q_PROPERTY  (qint64     duration        READ duration                            NOTIFY durationChanged)
+    Q_PROPERTY  (qreal      level           READ level                               NOTIFY levelsChanged)
+    Q_PROPERTY  (qreal      peakLevel       READ peakLevel                           NOTIFY levelsChanged)
+    Q_PROPERTY  (bool       clipping        READ clipping                            NOTIFY levelsChanged)
     Q_PROPERTY  (Error      error           READ error                               NOTIFY errorChanged)
     Q_PROPERTY  (QString    errorString     READ errorString                         NOTIFY errorChanged)
     Q_PROPERTY  (State      state           READ state                               NOTIFY stateChanged)
     Q_ENUMS(Error)
     Q_ENUMS(State)
+    Q_ENUMS(Backend)
 
 public:
     enum Error
@@ -37,6 +76,15 @@ public:
         PausedState = QAudioRecorder::PausedState
     };
 
+    // MediaRecorderBackend encodes through QAudioRecorder into a file.
+    // AudioInputBackend captures PCM with QAudioInput into memory and always
+    // streams; nothing touches the filesystem.
+    enum Backend
+    {
+        MediaRecorderBackend,
+        AudioInputBackend
+    };
+
     Recorder(QObject *parent = 0);
     ~Recorder();
 
@@ -52,8 +100,93 @@ public:
     qreal volume() const;
     void setVolume(const qreal &volume);
 
+    Backend backend() const;
+    void setBackend(const Backend &backend);
+
+    bool streaming() const;
+    void setStreaming(const bool &streaming);
+
+    // Voice activity detection, AudioInputBackend only: trims silence before
+    // encoding and reports endOfSpeech(); with autoStop the recording ends
+    // there once |hangover| milliseconds of silence have passed.
+    bool voiceDetection() const;
+    void setVoiceDetection(const bool &voiceDetection);
+
+    bool autoStop() const;
+    void setAutoStop(const bool &autoStop);
+
+    int hangover() const;
+    void setHangover(const int &hangover);
+
+    // Noise suppression, AudioInputBackend only: ahead of voice detection
+    // and encoding, the audio is high-passed, cleared of steady background
+    // noise and brought to an even level; see NoiseSuppressor. It holds
+    // back 16 ms of audio at 16 kHz. Takes effect on the next start().
+    bool noiseSuppression() const;
+    void setNoiseSuppression(const bool &noiseSuppression);
+
+    // AudioInputBackend captures at the device's native rate and resamples
+    // to this rate before encoding, so the capture rate never changes what
+    // is uploaded. 0 or less uses the rate implied by |quality|.
+    int uploadRate() const;
+    void setUploadRate(const int &uploadRate);
+
+    // Always-warm capture, AudioInputBackend only: with a pre-roll of more
+    // than 0 milliseconds the input device stays open between recordings
+    // and keeps that much of the most recent audio, which start() prepends
+    // to the recording. Recording then starts at once, without reopening
+    // the device, and the first syllable spoken just before start() is
+    // kept. Pausing only stops feeding the encoder.
+    int preRoll() const;
+    void setPreRoll(const int &preRoll);
+
+    // Target bits per second for "audio/speex", which AudioInputBackend
+    // encodes in-process when built with Speex; see
+    // SpeechRecognition::recommendedBitrate(). Takes effect on the next
+    // start().
+    int bitrate() const;
+    void setBitrate(const int &bitrate);
+
+    // Long recordings, AudioInputBackend only: with a segment length of
+    // more than 0 milliseconds the recording is split at pauses into
+    // streams no longer than that. Each stream is finished at its cut and a
+    // new audioStream() takes over, announced by segmentStarted(), so every
+    // segment can be recognized while the next is recorded; see
+    // SpeechRecognition::addSegment(). Takes effect on the next start().
+    int segmentLength() const;
+    void setSegmentLength(const int &segmentLength);
+
+    // Hands-free start, AudioInputBackend only: the input device stays warm
+    // while idle and is searched for a spoken keyword. When it is heard the
+    // recording starts by itself, holding only what was said after it, and
+    // keywordDetected() follows. The keyword is learned from a few examples
+    // recorded between startKeywordEnrollment() and
+    // finishKeywordEnrollment(), and kept in the |keywordModel| file.
+    bool keywordSpotting() const;
+    void setKeywordSpotting(const bool &keywordSpotting);
+
+    QString keywordModel() const;
+    void setKeywordModel(const QString &keywordModel);
+
+    // How close a match has to be; 0 derives it from the examples.
+    qreal keywordThreshold() const;
+    void setKeywordThreshold(const qreal &keywordThreshold);
+
+    int keywordTemplates() const;
+
+    // In streaming mode, the encoded audio of the current recording; it is
+    // written while recording and finished once the encoder has flushed.
+    AudioStream *audioStream() const;
+
     qint64 duration() const;
 
+    // Input levels while recording, linear in 0..1 of full scale and updated
+    // at a fixed rate; |level| is the RMS and |peakLevel| the largest sample
+    // since the previous update. |clipping| is held briefly so it is seen.
+    qreal level() const;
+    qreal peakLevel() const;
+    bool clipping() const;
+
     Error error() const;
     QString errorString() const;
 
@@ -62,6 +195,16 @@ public:
     Q_INVOKABLE QStringList getSupportedCodecs();
     Q_INVOKABLE QString getFilePath();
 
+    // Records one example of the keyword while stopped. Returns false when
+    // it was too short or too quiet to use.
+    Q_INVOKABLE void startKeywordEnrollment();
+    Q_INVOKABLE bool finishKeywordEnrollment();
+    Q_INVOKABLE void clearKeywordTemplates();
+
+    // Container and file extension for a codec name, or empty if unknown.
+    static QString getContainerFromCodec(const QString &codec);
+    static QString getExtensionFromCodec(const QString &codec);
+
 public Q_SLOTS:
     void start();
     void stop();
@@ -74,14 +217,33 @@ Q_SIGNALS:
     void codecChanged();
     void qualityChanged();
     void volumeChanged();
+    void streamingChanged();
+    void backendChanged();
+    void voiceDetectionChanged();
+    void autoStopChanged();
+    void hangoverChanged();
+    void noiseSuppressionChanged();
+    void uploadRateChanged();
+    void bitrateChanged();
+    void segmentLengthChanged();
+    void preRollChanged();
+    void keywordSpottingChanged();
+    void keywordModelChanged();
+    void keywordThresholdChanged();
+    void keywordTemplatesChanged();
 
     void durationChanged();
+    void levelsChanged();
 
     void stateChanged();
     void recording();
     void stopped();
     void paused();
     void resumed();
+    void speechStarted();
+    void endOfSpeech();
+    void keywordDetected();
+    void segmentStarted();
 
     void errorChanged();
 
@@ -89,6 +251,14 @@ private Q_SLOTS:
     void _q_stateChanged();
     void _q_error();
     void _q_durationChanged();
+    void _q_statusChanged();
+    void _q_tail();
+    void _q_captureStateChanged(int state);
+    void _q_captureError(int error);
+    void _q_drain();
+    void _q_endOfSpeech();
+    void _q_updateLevels();
+    void _q_audioBufferProbed(const QAudioBuffer &buffer);
 
 private:
     QAudioRecorder *audioRecorder;
@@ -98,16 +268,86 @@ private:
     QString m_codec;
     int m_quality;
     qreal m_volume;
+    bool m_streaming;
+
+    QPointer<AudioStream> m_stream;
+    QFile m_tailFile;
+    QTimer *m_tailTimer;
+
+    Backend m_backend;
+    RingBuffer<qint16> *m_ring;
+    AudioCapture *m_capture;
+    QThread *m_captureThread;
+    FlacEncoder *m_encoder;
+    SpeexEncoder *m_speex;
+    VoiceActivityDetector *m_vad;
+    NoiseSuppressor *m_suppressor;
+    AudioSegmenter *m_segmenter;
+    Resampler *m_resampler;
+    QVector<qint16> m_resampled;
+    QVector<qint16> m_suppressed;
+    QVector<qint16> m_voiced;
+    RingBuffer<qint16> *m_preRollBuffer;
+    int m_preRollSamples;
+    int m_preRoll;
+    bool m_warm;
+    bool m_captureOpen;
+    FeatureExtractor *m_extractor;
+    KeywordSpotter *m_spotter;
+    bool m_keywordSpotting;
+    QString m_keywordModel;
+    qreal m_keywordThreshold;
+    bool m_triggered;
+    bool m_starting;
+    bool m_enrolling;
+    QVector<qint16> m_enrollment;
+    bool m_voiceDetection;
+    bool m_noiseSuppression;
+    bool m_autoStop;
+    bool m_stopPending;
+    int m_hangover;
+    int m_uploadRate;
+    int m_bitrate;
+    int m_segmentLength;
+    int m_captureRate;
+    int m_sampleRate;
+    qint64 m_samples;
 
     qint64 m_duration;
 
+    LevelMeter *m_meter;
+    QAudioProbe *m_probe;
+    QTimer *m_levelTimer;
+    qreal m_level;
+    qreal m_peakLevel;
+    int m_clipHold;
+
     QMediaRecorder::State m_state;
 
     QMediaRecorder::Error m_error;
     QString m_errorString;
 
-    QString getContainerFromCodec(QString codec);
-    QString getExtensionFromCodec(QString codec);
+    void setState(QMediaRecorder::State state);
+    void resetLevels();
+    int sampleRateForQuality() const;
+    void startCapture();
+    void openStream();
+    void finishStream();
+    void configureCapture();
+    void resizePreRoll();
+    void updateWarm();
+    void openCapture();
+    void drain();
+    void createSpotter();
+    void listen(const qint16 *samples, int count);
+    void keepPreRoll(const qint16 *samples, int count);
+    void flushPreRoll();
+    void finishRecording();
+    void processPcm(const qint16 *samples, int count);
+    void processResampled(const qint16 *samples, int count);
+    void detectVoice(const qint16 *samples, int count);
+    void encodePcm(const qint16 *samples, int count);
+    void writePcm(const qint16 *samples, int count);
 
 };
 #endif // LIBRECORDER_H
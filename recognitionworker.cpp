@@ -0,0 +1,374 @@
+#include "recognitionworker.h"
+#include "audiostream.h"
+#include "metrics.h"
+#include "responseparser.h"
+#include "streamingupload.h"
+
+#include <QIODevice>
+#include <QMetaType>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QSsl>
+#include <QSslSocket>
+#include <QDebug>
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+#include <QHttp2Configuration>
+#endif
+
+namespace {
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+// Replies are small; the windows only have to cover many of them arriving
+// at once, without a window update per reply.
+const int kHttp2SessionWindow = 4 * 1024 * 1024;
+const int kHttp2StreamWindow = 256 * 1024;
+#endif
+// A spare connection older than this may be closed by the server just as
+// an upload starts on it, so a fresh one is opened instead.
+const int kMaxSpareAge = 20000;
+
+bool sameOrigin(const QUrl &a, const QUrl &b)
+{
+    return a.scheme() == b.scheme() && a.host() == b.host() && a.port() == b.port();
+}
+
+}
+
+RecognitionWorker::RecognitionWorker(QObject *parent) :
+    QObject(parent),
+    m_http2(false),
+    m_spare(0)
+{
+    // A child, so it follows the worker to whichever thread it is moved to.
+    m_network = new QNetworkAccessManager(this);
+    connect(m_network, SIGNAL(finished(QNetworkReply*)),
+            this, SLOT(_q_replyFinished(QNetworkReply*)));
+
+    m_sslConfiguration = QSslConfiguration::defaultConfiguration();
+    m_sslConfiguration.setSslOption(QSsl::SslOptionDisableSessionTickets, false);
+    m_sslConfiguration.setSslOption(QSsl::SslOptionDisableSessionPersistence, false);
+}
+
+RecognitionWorker::~RecognitionWorker()
+{
+    foreach (Transfer *transfer, m_replies)
+        delete transfer->parser;
+    qDeleteAll(m_replies);
+    foreach (Transfer *transfer, m_uploads)
+        delete transfer->parser;
+    qDeleteAll(m_uploads);
+}
+
+void RecognitionWorker::registerMetaTypes()
+{
+    qRegisterMetaType<QIODevice *>("QIODevice*");
+    qRegisterMetaType<LatencyTrace>("LatencyTrace");
+    qRegisterMetaType<SpeechRecognition::Hypotheses>("SpeechRecognition::Hypotheses");
+}
+
+bool RecognitionWorker::isHttp2Available()
+{
+#if QT_VERSION >= QT_VERSION_CHECK(5, 8, 0)
+    return true;
+#else
+    return false;
+#endif
+}
+
+void RecognitionWorker::setHttp2(bool http2)
+{
+    m_http2 = http2;
+}
+
+void RecognitionWorker::allowHttp2(QNetworkRequest *request) const
+{
+    if (!m_http2)
+        return;
+    const bool encrypted = request->url().scheme() == "https";
+    Q_UNUSED(encrypted);
+#if QT_VERSION >= QT_VERSION_CHECK(5, 8, 0)
+    if (encrypted)
+        request->setAttribute(QNetworkRequest::HTTP2AllowedAttribute, true);
+#endif
+#if QT_VERSION >= QT_VERSION_CHECK(5, 11, 0)
+    if (!encrypted)
+        request->setAttribute(QNetworkRequest::Http2DirectAttribute, true);
+#endif
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+    QHttp2Configuration configuration;
+    configuration.setSessionReceiveWindowSize(kHttp2SessionWindow);
+    configuration.setStreamReceiveWindowSize(kHttp2StreamWindow);
+    request->setHttp2Configuration(configuration);
+#endif
+}
+
+RecognitionWorker::Transfer *RecognitionWorker::newTransfer(int id)
+{
+    Transfer *transfer = new Transfer;
+    transfer->id = id;
+    // Parse the response as it arrives instead of after the last byte.
+    transfer->parser = new ResponseParser;
+    transfer->stream = 0;
+    transfer->upload = 0;
+    transfer->bytes = 0;
+    transfer->started = LatencyTrace::now();
+    transfer->nsecs = 0;
+    return transfer;
+}
+
+void RecognitionWorker::uploadComplete(Transfer *transfer)
+{
+    if (transfer->trace.has(LatencyTrace::UploadComplete))
+        return;
+    transfer->trace.mark(LatencyTrace::UploadComplete);
+    transfer->nsecs = transfer->trace.timestamp(LatencyTrace::UploadComplete) - transfer->started;
+    Metrics::observe(Metrics::UploadTime, transfer->nsecs / 1e9);
+}
+
+void RecognitionWorker::warmUp(const QUrl &url)
+{
+    if (url.scheme() == "https")
+        m_network->connectToHostEncrypted(url.host(), quint16(url.port(443)), m_sslConfiguration);
+    else
+        m_network->connectToHost(url.host(), quint16(url.port(80)));
+
+    QSslSocket *spare = takeSpare(url);
+    if (!spare) {
+        spare = StreamingUpload::connectTo(url, m_sslConfiguration, this);
+        m_spareAge.start();
+    }
+    m_spare = spare;
+    m_spareUrl = url;
+}
+
+// Hands over the spare socket if it is still usable for |url|; any other
+// spare is dropped.
+QSslSocket *RecognitionWorker::takeSpare(const QUrl &url)
+{
+    QSslSocket *spare = m_spare;
+    m_spare = 0;
+    if (!spare)
+        return 0;
+    if (!sameOrigin(url, m_spareUrl)
+            || spare->state() == QAbstractSocket::UnconnectedState
+            || m_spareAge.elapsed() > kMaxSpareAge) {
+        spare->abort();
+        spare->deleteLater();
+        return 0;
+    }
+    return spare;
+}
+
+void RecognitionWorker::keepSession(const QSslConfiguration &configuration)
+{
+    const QByteArray ticket = configuration.sessionTicket();
+    if (!ticket.isEmpty())
+        m_sslConfiguration.setSessionTicket(ticket);
+}
+
+void RecognitionWorker::post(int id, const QUrl &url, const QByteArray &contentType,
+                             QIODevice *audio)
+{
+    Transfer *transfer = newTransfer(id);
+
+    QNetworkRequest request(url);
+    if (url.scheme() == "https")
+        request.setSslConfiguration(m_sslConfiguration);
+    request.setHeader(QNetworkRequest::ContentTypeHeader, contentType);
+    request.setAttribute(QNetworkRequest::DoNotBufferUploadDataAttribute, false);
+    request.setAttribute(QNetworkRequest::CacheLoadControlAttribute,
+                         QNetworkRequest::AlwaysNetwork);
+    allowHttp2(&request);
+    Metrics::add(Metrics::UploadedBytes, audio->size());
+    QNetworkReply *reply = m_network->post(request, audio);
+    audio->setParent(reply);
+    connect(reply, SIGNAL(readyRead()), this, SLOT(_q_replyReadyRead()));
+    connect(reply, SIGNAL(encrypted()), this, SLOT(_q_replyEncrypted()));
+    connect(reply, SIGNAL(uploadProgress(qint64,qint64)),
+            this, SLOT(_q_replyUploadProgress(qint64,qint64)));
+    m_replies.insert(reply, transfer);
+}
+
+void RecognitionWorker::openStream(int id, const QUrl &url, const QByteArray &contentType)
+{
+    Transfer *transfer = newTransfer(id);
+    // A local copy of the caller's stream, so the upload never reads a
+    // buffer another thread is writing.
+    transfer->stream = new AudioStream;
+    transfer->stream->setContentType(contentType);
+
+    StreamingUpload *upload = new StreamingUpload(url, transfer->stream, this);
+    QSslSocket *spare = takeSpare(url);
+    if (spare)
+        upload->setSocket(spare);
+    else
+        upload->setSslConfiguration(m_sslConfiguration);
+    transfer->upload = upload;
+    transfer->stream->setParent(upload);
+    connect(upload, SIGNAL(bodySent()), this, SLOT(_q_uploadBodySent()));
+    connect(upload, SIGNAL(responseStarted()), this, SLOT(_q_uploadResponseStarted()));
+    connect(upload, SIGNAL(finished()), this, SLOT(_q_uploadFinished()));
+    m_uploads.insert(upload, transfer);
+    m_streams.insert(id, transfer);
+    upload->start();
+}
+
+void RecognitionWorker::appendStream(int id, const QByteArray &data)
+{
+    Transfer *transfer = m_streams.value(id);
+    if (!transfer)
+        return;
+    Metrics::add(Metrics::UploadedBytes, data.size());
+    transfer->stream->write(data);
+}
+
+void RecognitionWorker::finishStream(int id)
+{
+    Transfer *transfer = m_streams.value(id);
+    if (!transfer)
+        return;
+    transfer->stream->finish();
+    // Whatever is still queued now goes out as fast as the network allows,
+    // unlike the rest, which was paced by the recorder.
+    transfer->bytes = transfer->upload->bytesPending();
+    transfer->started = LatencyTrace::now();
+}
+
+void RecognitionWorker::abort(int id)
+{
+    for (QHash<QNetworkReply *, Transfer *>::iterator it = m_replies.begin();
+         it != m_replies.end(); ++it) {
+        if (it.value()->id != id)
+            continue;
+        QNetworkReply *reply = it.key();
+        Transfer *transfer = it.value();
+        m_replies.erase(it);
+        delete transfer->parser;
+        delete transfer;
+        // Removed first, so the finished() this triggers is ignored.
+        reply->abort();
+        reply->deleteLater();
+        return;
+    }
+
+    for (QHash<StreamingUpload *, Transfer *>::iterator it = m_uploads.begin();
+         it != m_uploads.end(); ++it) {
+        if (it.value()->id != id)
+            continue;
+        StreamingUpload *upload = it.key();
+        Transfer *transfer = it.value();
+        m_uploads.erase(it);
+        m_streams.remove(id);
+        delete transfer->parser;
+        delete transfer;
+        upload->abort();
+        upload->deleteLater();
+        return;
+    }
+}
+
+void RecognitionWorker::_q_replyReadyRead()
+{
+    QNetworkReply *reply = qobject_cast<QNetworkReply *>(sender());
+    Transfer *transfer = m_replies.value(reply);
+    if (!transfer)
+        return;
+    transfer->trace.mark(LatencyTrace::FirstResponseByte);
+    transfer->parser->feed(reply);
+}
+
+void RecognitionWorker::_q_replyEncrypted()
+{
+    QNetworkReply *reply = qobject_cast<QNetworkReply *>(sender());
+    if (reply)
+        keepSession(reply->sslConfiguration());
+}
+
+void RecognitionWorker::_q_replyUploadProgress(qint64 sent, qint64 total)
+{
+    Transfer *transfer = m_replies.value(qobject_cast<QNetworkReply *>(sender()));
+    if (transfer && total > 0 && sent == total) {
+        transfer->bytes = total;
+        uploadComplete(transfer);
+    }
+}
+
+void RecognitionWorker::_q_replyFinished(QNetworkReply *reply)
+{
+    Transfer *transfer = m_replies.take(reply);
+    if (!transfer)
+        return;
+
+    const bool ok = reply->error() == QNetworkReply::NoError;
+    if (ok) {
+        uploadComplete(transfer);
+        transfer->trace.mark(LatencyTrace::FirstResponseByte);
+        transfer->parser->feed(reply);
+    } else {
+        qDebug() << "ERROR \n" << reply->errorString();
+    }
+    reply->deleteLater();
+    complete(transfer, ok);
+}
+
+void RecognitionWorker::_q_uploadBodySent()
+{
+    Transfer *transfer = m_uploads.value(qobject_cast<StreamingUpload *>(sender()));
+    if (transfer)
+        uploadComplete(transfer);
+}
+
+void RecognitionWorker::_q_uploadResponseStarted()
+{
+    Transfer *transfer = m_uploads.value(qobject_cast<StreamingUpload *>(sender()));
+    if (transfer)
+        transfer->trace.mark(LatencyTrace::FirstResponseByte);
+}
+
+void RecognitionWorker::_q_uploadFinished()
+{
+    StreamingUpload *upload = qobject_cast<StreamingUpload *>(sender());
+    Transfer *transfer = m_uploads.take(upload);
+    if (!transfer)
+        return;
+    m_streams.remove(transfer->id);
+
+    const bool ok = !upload->hasError();
+    if (ok) {
+        if (upload->isEncrypted())
+            keepSession(upload->sslConfiguration());
+        const QByteArray body = upload->body();
+        transfer->parser->feed(body.constData(), body.size());
+    } else {
+        qDebug() << "ERROR \n" << upload->errorString();
+    }
+    upload->deleteLater();
+    complete(transfer, ok);
+}
+
+void RecognitionWorker::complete(Transfer *transfer, bool ok)
+{
+    int result = SpeechRecognition::Result_ErrorNetwork;
+    SpeechRecognition::Hypotheses hypotheses;
+    if (ok) {
+        const int status = transfer->parser->status();
+        if (status >= 0)
+            result = status;
+        if (result == SpeechRecognition::Result_Success)
+            hypotheses = transfer->parser->hypotheses();
+        transfer->trace.mark(LatencyTrace::ParseDone);
+        const qreal parse = transfer->trace.elapsed(LatencyTrace::FirstResponseByte,
+                                                    LatencyTrace::ParseDone);
+        if (parse >= 0)
+            Metrics::observe(Metrics::ParseTime, parse / 1000);
+    }
+
+    const int id = transfer->id;
+    const LatencyTrace trace = transfer->trace;
+    const qint64 nsecs = transfer->nsecs;
+    const qint64 bytes = nsecs > 0 ? transfer->bytes : 0;
+    delete transfer->parser;
+    delete transfer;
+    emit finished(id, result, hypotheses, trace, bytes, nsecs);
+}
@@ -0,0 +1,118 @@
+#ifndef RECOGNITIONWORKER_H
+#define RECOGNITIONWORKER_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QSslConfiguration>
+#include <QUrl>
+
+#include "latencytrace.h"
+#include "speechrecognition.h"
+
+class QIODevice;
+class QNetworkAccessManager;
+class QNetworkReply;
+class QNetworkRequest;
+class QSslSocket;
+class AudioStream;
+class ResponseParser;
+class StreamingUpload;
+
+// The network side of SpeechRecognition: owns the QNetworkAccessManager
+// and the streaming uploads, and parses replies as they arrive. It only
+// talks to the recognizer through queued-safe slots and finished(), so it
+// can be moved to a worker thread to keep TLS handshakes, upload pumping
+// and JSON parsing off the caller's thread.
+class RecognitionWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit RecognitionWorker(QObject *parent = 0);
+    ~RecognitionWorker();
+
+    // Registers the types carried across threads by the slots and signals.
+    static void registerMetaTypes();
+
+    // Whether this Qt can send posts over HTTP/2; plain HTTP endpoints need
+    // Qt 5.11 or later as well.
+    static bool isHttp2Available();
+
+public Q_SLOTS:
+    // Opens a connection to |url|'s host ahead of the next request; for
+    // HTTPS the handshake is done too. The network manager reuses one for
+    // posts, and the next streamed upload adopts a spare socket of its own,
+    // since it does not go through the manager.
+    void warmUp(const QUrl &url);
+
+    // Sends later posts over HTTP/2, multiplexed on one connection per
+    // host: negotiated through ALPN for HTTPS, falling back to HTTP/1.1
+    // keep-alive connections if the server declines, and with prior
+    // knowledge for plain HTTP. Streamed uploads stay on HTTP/1.1.
+    void setHttp2(bool http2);
+
+    // POSTs all of |audio|, which must have no parent and already belong to
+    // this object's thread; the worker takes ownership.
+    void post(int id, const QUrl &url, const QByteArray &contentType, QIODevice *audio);
+
+    // Starts a chunked upload fed by appendStream() until finishStream().
+    void openStream(int id, const QUrl &url, const QByteArray &contentType);
+    void appendStream(int id, const QByteArray &data);
+    void finishStream(int id);
+
+    // Drops transfer |id| without reporting it.
+    void abort(int id);
+
+Q_SIGNALS:
+    // |trace| holds the network stages only. |bytes| were uploaded in
+    // |nsecs|, measured from the post, or for a stream from the moment it
+    // was finished, to the last byte leaving; both are 0 when unknown.
+    void finished(int id, int result, const SpeechRecognition::Hypotheses &hypotheses,
+                  const LatencyTrace &trace, qint64 bytes, qint64 nsecs);
+
+private Q_SLOTS:
+    void _q_replyReadyRead();
+    void _q_replyUploadProgress(qint64 sent, qint64 total);
+    void _q_replyFinished(QNetworkReply *reply);
+    void _q_replyEncrypted();
+    void _q_uploadBodySent();
+    void _q_uploadResponseStarted();
+    void _q_uploadFinished();
+
+private:
+    struct Transfer {
+        int id;
+        ResponseParser *parser;
+        AudioStream *stream;
+        StreamingUpload *upload;
+        LatencyTrace trace;
+        qint64 bytes;
+        qint64 started;
+        qint64 nsecs;
+    };
+
+    static Transfer *newTransfer(int id);
+    static void uploadComplete(Transfer *transfer);
+
+    void complete(Transfer *transfer, bool ok);
+    void keepSession(const QSslConfiguration &configuration);
+    void allowHttp2(QNetworkRequest *request) const;
+    QSslSocket *takeSpare(const QUrl &url);
+
+    QNetworkAccessManager *m_network;
+    // Carries the latest TLS session ticket, so new connections resume the
+    // session instead of doing a full handshake.
+    QSslConfiguration m_sslConfiguration;
+    bool m_http2;
+    // Warmed up for the next streamed upload to |m_spareUrl|'s host.
+    QSslSocket *m_spare;
+    QUrl m_spareUrl;
+    QElapsedTimer m_spareAge;
+    QHash<QNetworkReply *, Transfer *> m_replies;
+    QHash<StreamingUpload *, Transfer *> m_uploads;
+    QHash<int, Transfer *> m_streams;
+};
+
+#endif // RECOGNITIONWORKER_H
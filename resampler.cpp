@@ -0,0 +1,154 @@
+#include "resampler.h"
+#include "dspkernels.h"
+
+#include <math.h>
+#include <string.h>
+
+namespace {
+
+int greatestCommonDivisor(int a, int b)
+{
+    while (b) {
+        const int t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// Zeroth-order modified Bessel function of the first kind.
+double besselI0(double x)
+{
+    double sum = 1.0;
+    double term = 1.0;
+    for (int k = 1; k < 50; ++k) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if (term < sum * 1e-12)
+            break;
+    }
+    return sum;
+}
+
+}
+
+Resampler::Resampler(int inputRate, int outputRate, int tapsPerPhase) :
+    m_inputRate(inputRate),
+    m_outputRate(outputRate),
+    m_taps(qMax(4, tapsPerPhase))
+{
+    const int gcd = greatestCommonDivisor(inputRate, outputRate);
+    m_up = outputRate / gcd;
+    m_down = inputRate / gcd;
+    // When decimating, the filter has to be as sharp relative to the output
+    // rate, which takes proportionally more taps at the input rate.
+    if (m_down > m_up)
+        m_taps *= (m_down + m_up - 1) / m_up;
+
+    if (isPassThrough()) {
+        m_taps = 1;
+        m_coeffs.fill(1.0f, 1);
+    } else {
+        // Cut off a little below the lower Nyquist frequency; the Kaiser
+        // window with beta 8 gives about 80 dB of stopband rejection.
+        const int length = m_up * m_taps;
+        const double cutoff = 0.45 / qMax(m_up, m_down);
+        const double beta = 8.0;
+        const double center = (length - 1) / 2.0;
+        const double norm = besselI0(beta);
+
+        m_coeffs.resize(length);
+        for (int n = 0; n < length; ++n) {
+            const double t = n - center;
+            const double x = 2.0 * cutoff * t;
+            const double sinc = t == 0.0 ? 1.0 : sin(M_PI * x) / (M_PI * x);
+            const double r = t / center;
+            const double window = besselI0(beta * sqrt(qMax(0.0, 1.0 - r * r))) / norm;
+            // The gain of m_up makes up for the zeros stuffed between inputs.
+            const double h = m_up * 2.0 * cutoff * sinc * window;
+
+            const int phase = n % m_up;
+            const int tap = n / m_up;
+            m_coeffs[phase * m_taps + (m_taps - 1 - tap)] = float(h);
+        }
+    }
+
+    reset();
+}
+
+int Resampler::inputRate() const
+{
+    return m_inputRate;
+}
+
+int Resampler::outputRate() const
+{
+    return m_outputRate;
+}
+
+bool Resampler::isPassThrough() const
+{
+    return m_up == m_down;
+}
+
+void Resampler::reset()
+{
+    // Start from silence so the first outputs have a full history.
+    m_input.fill(0.0f, m_taps - 1);
+    m_index = m_taps - 1;
+    m_phase = 0;
+}
+
+void Resampler::process(const qint16 *samples, int count, QVector<qint16> *out)
+{
+    if (count <= 0)
+        return;
+
+    if (isPassThrough()) {
+        const int size = out->size();
+        out->resize(size + count);
+        memcpy(out->data() + size, samples, count * sizeof(qint16));
+        return;
+    }
+
+    const int history = m_input.size();
+    m_input.resize(history + count);
+    Dsp::toFloat(samples, count, m_input.data() + history);
+
+    // Output sample k sits at input position k * M / L: its integer part
+    // picks the newest input sample, the remainder picks the phase.
+    const int available = m_input.size();
+    m_output.resize(0);
+    m_output.reserve(int(qint64(count) * m_up / m_down) + 2);
+    const float *input = m_input.constData();
+    while (m_index < available) {
+        m_output.append(Dsp::dotProduct(m_coeffs.constData() + m_phase * m_taps,
+                                        input + m_index - m_taps + 1, m_taps));
+        m_phase += m_down;
+        m_index += m_phase / m_up;
+        m_phase %= m_up;
+    }
+
+    // Keep the history the next output needs; when decimating hard, the
+    // next output may lie past everything buffered so far.
+    const int drop = qMin(m_index - (m_taps - 1), available);
+    if (drop > 0) {
+        m_input.remove(0, drop);
+        m_index -= drop;
+    }
+
+    const int size = out->size();
+    out->resize(size + m_output.size());
+    Dsp::toInt16(m_output.constData(), m_output.size(), out->data() + size);
+}
+
+void Resampler::flush(QVector<qint16> *out)
+{
+    if (isPassThrough())
+        return;
+
+    // The filter is linear phase with a delay of half its length.
+    const QVector<qint16> silence((m_taps + 1) / 2, 0);
+    process(silence.constData(), silence.size(), out);
+    reset();
+}
@@ -0,0 +1,47 @@
+#ifndef RESAMPLER_H
+#define RESAMPLER_H
+
+#include <QVector>
+
+// Rational-ratio polyphase resampler for 16-bit mono PCM. The rate change
+// is reduced to L/M; a Kaiser-windowed sinc low-pass designed at L times
+// the input rate is split into L phases, and each output sample is one dot
+// product of a phase against the most recent input, so only the samples
+// that are kept are ever computed.
+class Resampler
+{
+public:
+    // |tapsPerPhase| is scaled up by the decimation factor when
+    // downsampling.
+    Resampler(int inputRate, int outputRate, int tapsPerPhase = 32);
+
+    int inputRate() const;
+    int outputRate() const;
+    // True when the rates are equal and samples pass through unchanged.
+    bool isPassThrough() const;
+
+    // Appends to |out| every output sample that |count| more input samples
+    // complete.
+    void process(const qint16 *samples, int count, QVector<qint16> *out);
+    // Pushes the filter's delay line through, for the end of a stream.
+    void flush(QVector<qint16> *out);
+    void reset();
+
+private:
+    int m_inputRate;
+    int m_outputRate;
+    int m_up;
+    int m_down;
+    int m_taps;
+
+    // m_up phases of m_taps coefficients each, stored in reverse so every
+    // phase lines up with ascending input.
+    QVector<float> m_coeffs;
+
+    QVector<float> m_input;
+    QVector<float> m_output;
+    int m_index;
+    int m_phase;
+};
+
+#endif // RESAMPLER_H
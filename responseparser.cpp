@@ -0,0 +1,280 @@
+#include "responseparser.h"
+
+#include <QIODevice>
+
+ResponseParser::ResponseParser()
+{
+    m_token.reserve(256);
+    reset();
+}
+
+void ResponseParser::reset()
+{
+    m_lexer = Normal;
+    m_expect = ExpectValue;
+    m_isKey = false;
+    m_escape = false;
+    m_unicodeDigits = 0;
+    m_unicode = 0;
+    m_highSurrogate = 0;
+    m_depth = 0;
+    m_token.resize(0);
+    m_complete = false;
+    m_error = false;
+    m_status = -1;
+    m_hasUtterance = false;
+    m_hasConfidence = false;
+    m_hypotheses.clear();
+    m_hypotheses.reserve(8);
+}
+
+bool ResponseParser::isComplete() const
+{
+    return m_complete;
+}
+
+bool ResponseParser::hasError() const
+{
+    return m_error;
+}
+
+int ResponseParser::status() const
+{
+    return m_status;
+}
+
+const SpeechRecognition::Hypotheses &ResponseParser::hypotheses() const
+{
+    return m_hypotheses;
+}
+
+void ResponseParser::feed(QIODevice *device)
+{
+    char buffer[4096];
+    qint64 size;
+    while ((size = device->read(buffer, sizeof(buffer))) > 0)
+        feed(buffer, int(size));
+}
+
+void ResponseParser::feed(const char *data, int size)
+{
+    for (int i = 0; i < size && !m_error && !m_complete; ++i)
+        consume(data[i]);
+}
+
+void ResponseParser::consume(char c)
+{
+    switch (m_lexer) {
+    case InString:
+        if (m_unicodeDigits > 0) {
+            int digit;
+            if (c >= '0' && c <= '9')
+                digit = c - '0';
+            else if (c >= 'a' && c <= 'f')
+                digit = c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F')
+                digit = c - 'A' + 10;
+            else {
+                m_error = true;
+                return;
+            }
+            m_unicode = (m_unicode << 4) | uint(digit);
+            if (--m_unicodeDigits == 0) {
+                if (m_unicode >= 0xd800 && m_unicode < 0xdc00) {
+                    m_highSurrogate = m_unicode;
+                } else if (m_unicode >= 0xdc00 && m_unicode < 0xe000 && m_highSurrogate) {
+                    appendUtf8(0x10000 + ((m_highSurrogate - 0xd800) << 10) + (m_unicode - 0xdc00));
+                    m_highSurrogate = 0;
+                } else {
+                    appendUtf8(m_unicode);
+                }
+            }
+        } else if (m_escape) {
+            m_escape = false;
+            switch (c) {
+            case 'b': m_token.append('\b'); break;
+            case 'f': m_token.append('\f'); break;
+            case 'n': m_token.append('\n'); break;
+            case 'r': m_token.append('\r'); break;
+            case 't': m_token.append('\t'); break;
+            case 'u': m_unicodeDigits = 4; m_unicode = 0; break;
+            default: m_token.append(c); break;
+            }
+        } else if (c == '\\') {
+            m_escape = true;
+        } else if (c == '"') {
+            m_lexer = Normal;
+            finishString();
+        } else {
+            m_token.append(c);
+        }
+        return;
+
+    case InNumber:
+        if ((c >= '0' && c <= '9') || c == '.' || c == 'e' || c == 'E' || c == '+' || c == '-') {
+            m_token.append(c);
+            return;
+        }
+        m_lexer = Normal;
+        finishNumber();
+        break;
+
+    case InLiteral:
+        if (c >= 'a' && c <= 'z')
+            return;
+        m_lexer = Normal;
+        endValue();
+        break;
+
+    case Normal:
+        break;
+    }
+
+    if (m_error || m_complete)
+        return;
+
+    switch (c) {
+    case ' ':
+    case '\t':
+    case '\r':
+    case '\n':
+        return;
+
+    case '{':
+    case '[':
+        beginValue();
+        if (m_depth == kMaxDepth) {
+            m_error = true;
+            return;
+        }
+        if (c == '{' && m_depth == 2 && m_keys[0] == HypothesesKey && m_containers[1] == '[') {
+            m_current = SpeechRecognition::Hypothesis();
+            m_current.confidence = 0.0;
+            m_hasUtterance = false;
+            m_hasConfidence = false;
+        }
+        m_containers[m_depth] = c;
+        m_keys[m_depth] = OtherKey;
+        ++m_depth;
+        m_expect = c == '{' ? ExpectKey : ExpectValue;
+        return;
+
+    case '}':
+    case ']':
+        if (m_depth == 0 || m_containers[m_depth - 1] != (c == '}' ? '{' : '[')) {
+            m_error = true;
+            return;
+        }
+        if (c == '}' && m_depth == 3 && m_keys[0] == HypothesesKey && m_containers[1] == '['
+                && m_hasUtterance && m_hasConfidence)
+            m_hypotheses << m_current;
+        --m_depth;
+        endValue();
+        return;
+
+    case ':':
+        if (m_expect != ExpectColon)
+            m_error = true;
+        m_expect = ExpectValue;
+        return;
+
+    case ',':
+        if (m_expect != ExpectComma || m_depth == 0)
+            m_error = true;
+        else
+            m_expect = m_containers[m_depth - 1] == '{' ? ExpectKey : ExpectValue;
+        return;
+
+    case '"':
+        m_isKey = m_expect == ExpectKey;
+        if (!m_isKey)
+            beginValue();
+        m_token.resize(0);
+        m_lexer = InString;
+        return;
+
+    default:
+        if (c == '-' || (c >= '0' && c <= '9')) {
+            beginValue();
+            m_token.resize(0);
+            m_token.append(c);
+            m_lexer = InNumber;
+        } else if (c >= 'a' && c <= 'z') {
+            beginValue();
+            m_lexer = InLiteral;
+        } else {
+            m_error = true;
+        }
+        return;
+    }
+}
+
+void ResponseParser::beginValue()
+{
+    if (m_expect != ExpectValue)
+        m_error = true;
+}
+
+void ResponseParser::endValue()
+{
+    m_expect = ExpectComma;
+    if (m_depth == 0)
+        m_complete = true;
+}
+
+void ResponseParser::finishString()
+{
+    if (m_isKey) {
+        Key key = OtherKey;
+        if (m_depth == 1) {
+            if (m_token == "status")
+                key = StatusKey;
+            else if (m_token == "hypotheses")
+                key = HypothesesKey;
+        } else if (m_depth == 3) {
+            if (m_token == "utterance")
+                key = UtteranceKey;
+            else if (m_token == "confidence")
+                key = ConfidenceKey;
+        }
+        m_keys[m_depth - 1] = key;
+        m_expect = ExpectColon;
+        return;
+    }
+
+    if (m_depth == 3 && m_keys[0] == HypothesesKey && m_keys[2] == UtteranceKey) {
+        m_current.utterance = QString::fromUtf8(m_token.constData(), m_token.size());
+        m_hasUtterance = true;
+    }
+    endValue();
+}
+
+void ResponseParser::finishNumber()
+{
+    if (m_depth == 1 && m_keys[0] == StatusKey) {
+        m_status = m_token.toInt();
+    } else if (m_depth == 3 && m_keys[0] == HypothesesKey && m_keys[2] == ConfidenceKey) {
+        m_current.confidence = m_token.toDouble();
+        m_hasConfidence = true;
+    }
+    endValue();
+}
+
+void ResponseParser::appendUtf8(uint codePoint)
+{
+    if (codePoint < 0x80) {
+        m_token.append(char(codePoint));
+    } else if (codePoint < 0x800) {
+        m_token.append(char(0xc0 | (codePoint >> 6)));
+        m_token.append(char(0x80 | (codePoint & 0x3f)));
+    } else if (codePoint < 0x10000) {
+        m_token.append(char(0xe0 | (codePoint >> 12)));
+        m_token.append(char(0x80 | ((codePoint >> 6) & 0x3f)));
+        m_token.append(char(0x80 | (codePoint & 0x3f)));
+    } else {
+        m_token.append(char(0xf0 | (codePoint >> 18)));
+        m_token.append(char(0x80 | ((codePoint >> 12) & 0x3f)));
+        m_token.append(char(0x80 | ((codePoint >> 6) & 0x3f)));
+        m_token.append(char(0x80 | (codePoint & 0x3f)));
+    }
+}
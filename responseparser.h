@@ -0,0 +1,68 @@
+#ifndef RESPONSEPARSER_H
+#define RESPONSEPARSER_H
+
+#include <QByteArray>
+
+#include "speechrecognition.h"
+
+// Incremental reader for the recognizer's JSON reply. Bytes can be fed in
+// arbitrary chunks as they arrive; only "status" and the "utterance" and
+// "confidence" of each entry in "hypotheses" are extracted, straight into
+// preallocated storage, and everything else is skipped without building a
+// document.
+class ResponseParser
+{
+public:
+    ResponseParser();
+
+    void reset();
+    void feed(const char *data, int size);
+    // Reads everything currently available from |device|.
+    void feed(QIODevice *device);
+
+    // True once the top-level object has been closed.
+    bool isComplete() const;
+    bool hasError() const;
+
+    // -1 until a status has been seen.
+    int status() const;
+    const SpeechRecognition::Hypotheses &hypotheses() const;
+
+private:
+    enum Lexer { Normal, InString, InNumber, InLiteral };
+    enum Expect { ExpectValue, ExpectKey, ExpectColon, ExpectComma };
+    enum Key { OtherKey, StatusKey, HypothesesKey, UtteranceKey, ConfidenceKey };
+
+    static const int kMaxDepth = 32;
+
+    void consume(char c);
+    void beginValue();
+    void endValue();
+    void finishString();
+    void finishNumber();
+    void appendUtf8(uint codePoint);
+
+    Lexer m_lexer;
+    Expect m_expect;
+    bool m_isKey;
+    bool m_escape;
+    int m_unicodeDigits;
+    uint m_unicode;
+    uint m_highSurrogate;
+
+    int m_depth;
+    char m_containers[kMaxDepth];
+    Key m_keys[kMaxDepth];
+    QByteArray m_token;
+
+    bool m_complete;
+    bool m_error;
+    int m_status;
+
+    SpeechRecognition::Hypothesis m_current;
+    bool m_hasUtterance;
+    bool m_hasConfidence;
+    SpeechRecognition::Hypotheses m_hypotheses;
+};
+
+#endif // RESPONSEPARSER_H
@@ -0,0 +1,277 @@
+#include "resultcache.h"
+
+#include <QtEndian>
+#include <string.h>
+
+namespace {
+
+const char kMagic[8] = { 'G', 'S', 'R', 'C', 0, 0, 0, 1 };
+const int kHeaderSize = 64;
+const int kSlotSize = 1024;
+const int kSlotCount = 4096;
+const int kSlotHeader = 16;
+const int kProbeLength = 8;
+
+// MurmurHash64A: fast, well-distributed, and stable across runs, which the
+// on-disk tier depends on.
+quint64 murmurHash64(const char *data, int size, quint64 seed)
+{
+    const quint64 m = Q_UINT64_C(0xc6a4a7935bd1e995);
+    const int r = 47;
+
+    quint64 h = seed ^ (quint64(size) * m);
+
+    const int blocks = size / 8;
+    for (int i = 0; i < blocks; ++i) {
+        quint64 k;
+        memcpy(&k, data + i * 8, sizeof(k));
+        k = qFromLittleEndian(k);
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+        h ^= k;
+        h *= m;
+    }
+
+    const uchar *tail = reinterpret_cast<const uchar *>(data + blocks * 8);
+    switch (size & 7) {
+    case 7: h ^= quint64(tail[6]) << 48; // fall through
+    case 6: h ^= quint64(tail[5]) << 40; // fall through
+    case 5: h ^= quint64(tail[4]) << 32; // fall through
+    case 4: h ^= quint64(tail[3]) << 24; // fall through
+    case 3: h ^= quint64(tail[2]) << 16; // fall through
+    case 2: h ^= quint64(tail[1]) << 8; // fall through
+    case 1: h ^= quint64(tail[0]);
+            h *= m;
+    }
+
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return h;
+}
+
+}
+
+ResultCache::ResultCache(int capacity) :
+    m_memory(capacity),
+    m_map(0),
+    m_slots(0),
+    m_hits(0),
+    m_diskHits(0),
+    m_misses(0)
+{
+}
+
+ResultCache::~ResultCache()
+{
+    setFileName(QString());
+}
+
+quint64 ResultCache::key(const QByteArray &audio, const QByteArray &parameters)
+{
+    const quint64 seed = murmurHash64(parameters.constData(), parameters.size(), 0);
+    const quint64 hash = murmurHash64(audio.constData(), audio.size(), seed);
+    // Zero marks an empty slot on disk.
+    return hash ? hash : 1;
+}
+
+int ResultCache::capacity() const
+{
+    return m_memory.maxCost();
+}
+
+void ResultCache::setCapacity(int capacity)
+{
+    m_memory.setMaxCost(capacity);
+}
+
+QString ResultCache::fileName() const
+{
+    return m_file.fileName();
+}
+
+bool ResultCache::setFileName(const QString &fileName)
+{
+    if (m_map) {
+        m_file.unmap(m_map);
+        m_map = 0;
+        m_slots = 0;
+    }
+    m_file.close();
+    m_file.setFileName(fileName);
+
+    if (fileName.isEmpty())
+        return true;
+
+    if (!m_file.open(QIODevice::ReadWrite))
+        return false;
+
+    const qint64 size = kHeaderSize + qint64(kSlotSize) * kSlotCount;
+    char magic[sizeof(kMagic)];
+    if (m_file.size() != size || m_file.read(magic, sizeof(magic)) != sizeof(magic)
+            || memcmp(magic, kMagic, sizeof(kMagic)) != 0) {
+        // Missing, truncated or from another version: start empty.
+        if (!m_file.resize(0) || !m_file.resize(size)) {
+            m_file.close();
+            return false;
+        }
+        m_file.seek(0);
+        m_file.write(kMagic, sizeof(kMagic));
+        m_file.flush();
+    }
+
+    m_map = m_file.map(0, size);
+    if (!m_map) {
+        m_file.close();
+        return false;
+    }
+    m_slots = kSlotCount;
+    return true;
+}
+
+uchar *ResultCache::slot(int index) const
+{
+    return m_map + kHeaderSize + qint64(index) * kSlotSize;
+}
+
+bool ResultCache::lookup(quint64 key, Entry *entry)
+{
+    Entry *cached = m_memory.object(key);
+    if (cached) {
+        *entry = *cached;
+        ++m_hits;
+        return true;
+    }
+
+    if (lookupDisk(key, entry)) {
+        m_memory.insert(key, new Entry(*entry));
+        ++m_hits;
+        ++m_diskHits;
+        return true;
+    }
+
+    ++m_misses;
+    return false;
+}
+
+void ResultCache::insert(quint64 key, const Entry &entry)
+{
+    if (entry.result != SpeechRecognition::Result_Success)
+        return;
+
+    m_memory.insert(key, new Entry(entry));
+    insertDisk(key, entry);
+}
+
+void ResultCache::clear()
+{
+    m_memory.clear();
+    if (m_map)
+        memset(m_map + kHeaderSize, 0, size_t(kSlotSize) * m_slots);
+}
+
+qint64 ResultCache::hits() const
+{
+    return m_hits;
+}
+
+qint64 ResultCache::diskHits() const
+{
+    return m_diskHits;
+}
+
+qint64 ResultCache::misses() const
+{
+    return m_misses;
+}
+
+// Slot layout: key (8), result (4), hypothesis count (2), payload size (2),
+// then per hypothesis: confidence as a double (8), utterance size (2) and
+// the UTF-8 utterance. All integers are little-endian.
+bool ResultCache::lookupDisk(quint64 key, Entry *entry) const
+{
+    if (!m_map)
+        return false;
+
+    for (int probe = 0; probe < kProbeLength; ++probe) {
+        const uchar *s = slot(int((key + probe) % quint64(m_slots)));
+        if (qFromLittleEndian<quint64>(s) != key)
+            continue;
+
+        entry->result = SpeechRecognition::Result(qFromLittleEndian<qint32>(s + 8));
+        const int count = qFromLittleEndian<quint16>(s + 12);
+        const int payload = qFromLittleEndian<quint16>(s + 14);
+        if (payload > kSlotSize - kSlotHeader)
+            return false;
+
+        entry->hypotheses.clear();
+        entry->hypotheses.reserve(count);
+        const uchar *p = s + kSlotHeader;
+        const uchar *end = p + payload;
+        for (int i = 0; i < count; ++i) {
+            if (end - p < 10)
+                return false;
+            SpeechRecognition::Hypothesis hypothesis;
+            const quint64 bits = qFromLittleEndian<quint64>(p);
+            double confidence;
+            memcpy(&confidence, &bits, sizeof(confidence));
+            hypothesis.confidence = confidence;
+            const int size = qFromLittleEndian<quint16>(p + 8);
+            p += 10;
+            if (end - p < size)
+                return false;
+            hypothesis.utterance = QString::fromUtf8(reinterpret_cast<const char *>(p), size);
+            p += size;
+            entry->hypotheses << hypothesis;
+        }
+        return true;
+    }
+    return false;
+}
+
+void ResultCache::insertDisk(quint64 key, const Entry &entry)
+{
+    if (!m_map)
+        return;
+
+    QByteArray payload;
+    foreach (const SpeechRecognition::Hypothesis &hypothesis, entry.hypotheses) {
+        const QByteArray utterance = hypothesis.utterance.toUtf8();
+        uchar header[10];
+        const double confidence = hypothesis.confidence;
+        quint64 bits;
+        memcpy(&bits, &confidence, sizeof(bits));
+        qToLittleEndian<quint64>(bits, header);
+        qToLittleEndian<quint16>(quint16(utterance.size()), header + 8);
+        payload.append(reinterpret_cast<const char *>(header), sizeof(header));
+        payload.append(utterance);
+    }
+    if (payload.size() > kSlotSize - kSlotHeader)
+        return;
+
+    // Reuse the key's slot, else the first empty one, else evict the first.
+    int target = -1;
+    int empty = -1;
+    for (int probe = 0; probe < kProbeLength; ++probe) {
+        const int index = int((key + probe) % quint64(m_slots));
+        const quint64 existing = qFromLittleEndian<quint64>(slot(index));
+        if (existing == key) {
+            target = index;
+            break;
+        }
+        if (existing == 0 && empty < 0)
+            empty = index;
+    }
+    if (target < 0)
+        target = empty >= 0 ? empty : int(key % quint64(m_slots));
+
+    // Write the key last so a torn write never matches.
+    uchar *s = slot(target);
+    qToLittleEndian<quint64>(0, s);
+    qToLittleEndian<qint32>(entry.result, s + 8);
+    qToLittleEndian<quint16>(quint16(entry.hypotheses.size()), s + 12);
+    qToLittleEndian<quint16>(quint16(payload.size()), s + 14);
+    memcpy(s + kSlotHeader, payload.constData(), payload.size());
+    qToLittleEndian<quint64>(key, s);
+}
@@ -0,0 +1,61 @@
+#ifndef RESULTCACHE_H
+#define RESULTCACHE_H
+
+#include <QCache>
+#include <QFile>
+#include <QString>
+
+#include "speechrecognition.h"
+
+// Recognition results keyed by a hash of the encoded audio and the request
+// parameters. The first tier is an in-memory LRU; the optional second tier
+// is a fixed-size table in a memory-mapped file, so results survive
+// restarts. Only successful results are stored.
+class ResultCache
+{
+public:
+    struct Entry {
+        SpeechRecognition::Result result;
+        SpeechRecognition::Hypotheses hypotheses;
+    };
+
+    explicit ResultCache(int capacity = 256);
+    ~ResultCache();
+
+    static quint64 key(const QByteArray &audio, const QByteArray &parameters);
+
+    int capacity() const;
+    void setCapacity(int capacity);
+
+    // Maps |fileName| as the persistent tier, creating it if needed; an
+    // empty name closes it.
+    bool setFileName(const QString &fileName);
+    QString fileName() const;
+
+    bool lookup(quint64 key, Entry *entry);
+    void insert(quint64 key, const Entry &entry);
+    void clear();
+
+    qint64 hits() const;
+    qint64 diskHits() const;
+    qint64 misses() const;
+
+private:
+    Q_DISABLE_COPY(ResultCache)
+
+    bool lookupDisk(quint64 key, Entry *entry) const;
+    void insertDisk(quint64 key, const Entry &entry);
+    uchar *slot(int index) const;
+
+    QCache<quint64, Entry> m_memory;
+
+    QFile m_file;
+    uchar *m_map;
+    int m_slots;
+
+    qint64 m_hits;
+    qint64 m_diskHits;
+    qint64 m_misses;
+};
+
+#endif // RESULTCACHE_H
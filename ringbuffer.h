@@ -0,0 +1,116 @@
+#ifndef RINGBUFFER_H
+#define RINGBUFFER_H
+
+#include <QtGlobal>
+#include <QAtomicInt>
+#include <string.h>
+
+// Single-producer/single-consumer ring buffer. One thread may call write()
+// and another read() concurrently without locking: each side only ever
+// stores its own index, and publishes it with release semantics after the
+// data it covers has been copied. Capacity is rounded up to a power of two.
+template <typename T>
+class RingBuffer
+{
+public:
+    explicit RingBuffer(int capacity)
+        : m_capacity(1)
+    {
+        while (m_capacity < capacity)
+            m_capacity <<= 1;
+        m_mask = m_capacity - 1;
+        m_data = new T[m_capacity];
+    }
+
+    ~RingBuffer()
+    {
+        delete[] m_data;
+    }
+
+    int capacity() const
+    {
+        return m_capacity;
+    }
+
+    int readAvailable() const
+    {
+        return int(uint(m_writeIndex.loadAcquire()) - uint(m_readIndex.load()));
+    }
+
+    int writeAvailable() const
+    {
+        return m_capacity - int(uint(m_writeIndex.load()) - uint(m_readIndex.loadAcquire()));
+    }
+
+    // Producer side. Returns the number of items stored, which is less than
+    // |count| when the consumer has fallen behind.
+    int write(const T *data, int count)
+    {
+        const uint w = uint(m_writeIndex.load());
+        const uint r = uint(m_readIndex.loadAcquire());
+        count = qMin(count, m_capacity - int(w - r));
+        if (count <= 0)
+            return 0;
+
+        const int start = int(w & uint(m_mask));
+        const int first = qMin(count, m_capacity - start);
+        memcpy(m_data + start, data, first * sizeof(T));
+        memcpy(m_data, data + first, (count - first) * sizeof(T));
+
+        m_writeIndex.storeRelease(int(w + uint(count)));
+        return count;
+    }
+
+    // Consumer side. Returns the number of items copied into |data|.
+    int read(T *data, int count)
+    {
+        const uint r = uint(m_readIndex.load());
+        const uint w = uint(m_writeIndex.loadAcquire());
+        count = qMin(count, int(w - r));
+        if (count <= 0)
+            return 0;
+
+        const int start = int(r & uint(m_mask));
+        const int first = qMin(count, m_capacity - start);
+        memcpy(data, m_data + start, first * sizeof(T));
+        memcpy(data + first, m_data, (count - first) * sizeof(T));
+
+        m_readIndex.storeRelease(int(r + uint(count)));
+        return count;
+    }
+
+    // Consumer side. Drops everything currently readable.
+    void clear()
+    {
+        m_readIndex.storeRelease(m_writeIndex.loadAcquire());
+    }
+
+    // Consumer side. Drops up to |count| of the oldest items and returns
+    // how many were dropped.
+    int discard(int count)
+    {
+        const uint r = uint(m_readIndex.load());
+        count = qMin(count, int(uint(m_writeIndex.loadAcquire()) - r));
+        if (count <= 0)
+            return 0;
+        m_readIndex.storeRelease(int(r + uint(count)));
+        return count;
+    }
+
+private:
+    Q_DISABLE_COPY(RingBuffer)
+
+    T *m_data;
+    int m_capacity;
+    int m_mask;
+
+    // Keep the two indices on separate cache lines so the producer and the
+    // consumer do not keep invalidating each other's line.
+    char m_pad0[64];
+    QAtomicInt m_writeIndex;
+    char m_pad1[64];
+    QAtomicInt m_readIndex;
+    char m_pad2[64];
+};
+
+#endif // RINGBUFFER_H
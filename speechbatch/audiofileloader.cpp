@@ -0,0 +1,159 @@
+#include "audiofileloader.h"
+#include "flacencoder.h"
+#include "resampler.h"
+
+#include <QFile>
+#include <QMetaObject>
+#include <QObject>
+#include <QVector>
+#include <QtEndian>
+
+namespace {
+
+// Rate WAV input is uploaded at; anything above adds bytes, not accuracy.
+const int kUploadRate = 16000;
+
+const uchar *bytes(const QByteArray &data, int offset)
+{
+    return reinterpret_cast<const uchar *>(data.constData()) + offset;
+}
+
+}
+
+AudioFileLoader::AudioFileLoader(int index, const QString &path, QObject *receiver) :
+    m_index(index),
+    m_path(path),
+    m_receiver(receiver)
+{
+}
+
+void AudioFileLoader::run()
+{
+    QByteArray data;
+    QByteArray contentType;
+    double seconds = 0.0;
+    QString error;
+    if (!load(m_path, &data, &contentType, &seconds, &error))
+        data.clear();
+
+    QMetaObject::invokeMethod(m_receiver, "fileLoaded", Qt::QueuedConnection,
+                              Q_ARG(int, m_index),
+                              Q_ARG(QByteArray, data),
+                              Q_ARG(QByteArray, contentType),
+                              Q_ARG(double, seconds),
+                              Q_ARG(QString, error));
+}
+
+bool AudioFileLoader::load(const QString &path, QByteArray *data, QByteArray *contentType,
+                           double *seconds, QString *error)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        *error = file.errorString();
+        return false;
+    }
+    const QByteArray contents = file.readAll();
+
+    if (contents.startsWith("fLaC")) {
+        *data = contents;
+        return loadFlac(contents, contentType, seconds, error);
+    }
+    if (contents.startsWith("RIFF") && contents.mid(8, 4) == "WAVE")
+        return loadWav(contents, data, contentType, seconds, error);
+
+    *error = QObject::tr("Not a FLAC or WAV file");
+    return false;
+}
+
+bool AudioFileLoader::loadFlac(const QByteArray &file, QByteArray *contentType,
+                               double *seconds, QString *error)
+{
+    int sampleRate;
+    qint64 samples;
+    if (!FlacEncoder::readStreamInfo(file, &sampleRate, &samples)) {
+        *error = QObject::tr("FLAC stream has no valid STREAMINFO block");
+        return false;
+    }
+
+    *contentType = "audio/x-flac; rate=" + QByteArray::number(sampleRate);
+    *seconds = double(samples) / sampleRate;
+    return true;
+}
+
+bool AudioFileLoader::loadWav(const QByteArray &file, QByteArray *data, QByteArray *contentType,
+                              double *seconds, QString *error)
+{
+    int channels = 0;
+    int sampleRate = 0;
+    int bitsPerSample = 0;
+    int pcmOffset = -1;
+    int pcmSize = 0;
+
+    int offset = 12;
+    while (offset + 8 <= file.size()) {
+        const QByteArray id = file.mid(offset, 4);
+        const quint32 size = qFromLittleEndian<quint32>(bytes(file, offset + 4));
+        const int body = offset + 8;
+        if (size > quint32(file.size() - body)) {
+            // Truncated, or streamed with a placeholder size: take the rest.
+            if (id == "data") {
+                pcmOffset = body;
+                pcmSize = file.size() - body;
+            }
+            break;
+        }
+
+        if (id == "fmt " && size >= 16) {
+            const int format = qFromLittleEndian<quint16>(bytes(file, body));
+            channels = qFromLittleEndian<quint16>(bytes(file, body + 2));
+            sampleRate = int(qFromLittleEndian<quint32>(bytes(file, body + 4)));
+            bitsPerSample = qFromLittleEndian<quint16>(bytes(file, body + 14));
+            if (format != 1 && format != 0xfffe) {
+                *error = QObject::tr("Unsupported WAV format %1").arg(format);
+                return false;
+            }
+        } else if (id == "data") {
+            pcmOffset = body;
+            pcmSize = int(size);
+            break;
+        }
+        offset = body + int(size) + int(size & 1);
+    }
+
+    if (channels <= 0 || sampleRate <= 0 || pcmOffset < 0) {
+        *error = QObject::tr("Malformed WAV file");
+        return false;
+    }
+    if (bitsPerSample != 16) {
+        *error = QObject::tr("Unsupported WAV sample size %1").arg(bitsPerSample);
+        return false;
+    }
+
+    const int frames = pcmSize / (2 * channels);
+    QVector<qint16> mono(frames);
+    const uchar *pcm = bytes(file, pcmOffset);
+    for (int i = 0; i < frames; ++i) {
+        int sum = 0;
+        for (int c = 0; c < channels; ++c)
+            sum += qFromLittleEndian<qint16>(pcm + 2 * (i * channels + c));
+        mono[i] = qint16(sum / channels);
+    }
+
+    const int uploadRate = qMin(sampleRate, kUploadRate);
+    if (uploadRate != sampleRate) {
+        Resampler resampler(sampleRate, uploadRate);
+        QVector<qint16> resampled;
+        resampled.reserve(int(qint64(frames) * uploadRate / sampleRate) + 64);
+        resampler.process(mono.constData(), frames, &resampled);
+        resampler.flush(&resampled);
+        mono.swap(resampled);
+    }
+
+    FlacEncoder encoder(uploadRate);
+    *data = encoder.streamHeader();
+    data->append(encoder.encode(mono.constData(), mono.size()));
+    data->append(encoder.finish());
+    *contentType = "audio/x-flac; rate=" + QByteArray::number(uploadRate);
+    *seconds = double(frames) / sampleRate;
+    return true;
+}
@@ -0,0 +1,37 @@
+#ifndef AUDIOFILELOADER_H
+#define AUDIOFILELOADER_H
+
+#include <QRunnable>
+#include <QByteArray>
+#include <QString>
+
+class QObject;
+
+// Reads one file on a pool thread and turns it into something the
+// recognizer accepts: FLAC is passed through, 16-bit PCM WAV is downmixed
+// to mono, resampled to at most 16 kHz and encoded to FLAC. The outcome is delivered to |receiver| with
+// a queued call to
+//   fileLoaded(int index, QByteArray data, QByteArray contentType,
+//              double seconds, QString error)
+class AudioFileLoader : public QRunnable
+{
+public:
+    AudioFileLoader(int index, const QString &path, QObject *receiver);
+
+    void run();
+
+    static bool load(const QString &path, QByteArray *data, QByteArray *contentType,
+                     double *seconds, QString *error);
+
+private:
+    static bool loadFlac(const QByteArray &file, QByteArray *contentType,
+                         double *seconds, QString *error);
+    static bool loadWav(const QByteArray &file, QByteArray *data, QByteArray *contentType,
+                        double *seconds, QString *error);
+
+    int m_index;
+    QString m_path;
+    QObject *m_receiver;
+};
+
+#endif // AUDIOFILELOADER_H
@@ -0,0 +1,216 @@
+#include "batchrunner.h"
+#include "audiofileloader.h"
+
+#include <QBuffer>
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#include <stdio.h>
+
+BatchRunner::BatchRunner(QObject *parent) :
+    QObject(parent),
+    m_iterator(0),
+    m_inputsDone(false),
+    m_output(0),
+    m_recognizer(new SpeechRecognition(this)),
+    m_concurrency(4),
+    m_nextIndex(0),
+    m_files(0),
+    m_failed(0),
+    m_audioSeconds(0.0),
+    m_finished(false)
+{
+    m_recognizer->setMaxInFlight(m_concurrency);
+    // The signal's argument types are spelled unqualified inside
+    // SpeechRecognition, which string-based connections would not match.
+    connect(m_recognizer, &SpeechRecognition::Finished,
+            this, &BatchRunner::recognitionFinished);
+}
+
+BatchRunner::~BatchRunner()
+{
+    m_pool.waitForDone();
+    delete m_iterator;
+}
+
+void BatchRunner::setInputs(const QStringList &inputs)
+{
+    m_inputs = inputs;
+}
+
+void BatchRunner::setOutput(QIODevice *output)
+{
+    m_output = output;
+}
+
+int BatchRunner::concurrency() const
+{
+    return m_concurrency;
+}
+
+void BatchRunner::setConcurrency(int concurrency)
+{
+    m_concurrency = qMax(1, concurrency);
+    m_recognizer->setMaxInFlight(m_concurrency);
+}
+
+int BatchRunner::threads() const
+{
+    return m_pool.maxThreadCount();
+}
+
+void BatchRunner::setThreads(int threads)
+{
+    m_pool.setMaxThreadCount(qMax(1, threads));
+}
+
+SpeechRecognition *BatchRunner::recognizer() const
+{
+    return m_recognizer;
+}
+
+int BatchRunner::exitCode() const
+{
+    return m_failed ? 1 : 0;
+}
+
+void BatchRunner::start()
+{
+    m_timer.start();
+    fill();
+}
+
+bool BatchRunner::nextFile(QString *path)
+{
+    forever {
+        if (m_iterator && m_iterator->hasNext()) {
+            *path = m_iterator->next();
+            return true;
+        }
+        delete m_iterator;
+        m_iterator = 0;
+
+        if (m_inputs.isEmpty()) {
+            m_inputsDone = true;
+            return false;
+        }
+
+        const QString input = m_inputs.takeFirst();
+        if (!QFileInfo(input).isDir()) {
+            *path = input;
+            return true;
+        }
+        m_iterator = new QDirIterator(input, QStringList() << "*.flac" << "*.wav",
+                                      QDir::Files, QDirIterator::Subdirectories);
+    }
+}
+
+void BatchRunner::fill()
+{
+    // Each file is held from loading until its result is written; keep
+    // enough in flight to cover both the encoders and the network.
+    const int window = m_concurrency + m_pool.maxThreadCount();
+    QString path;
+    while (m_loading.size() + m_running.size() < window && nextFile(&path)) {
+        const int index = m_nextIndex++;
+        Job job;
+        job.path = path;
+        job.seconds = 0.0;
+        job.timer.start();
+        m_loading.insert(index, job);
+        m_pool.start(new AudioFileLoader(index, path, this));
+    }
+    finishIfDone();
+}
+
+void BatchRunner::fileLoaded(int index, const QByteArray &data, const QByteArray &contentType,
+                             double seconds, const QString &error)
+{
+    Job job = m_loading.take(index);
+    job.seconds = seconds;
+
+    if (!error.isEmpty()) {
+        QJsonObject object;
+        object.insert("file", job.path);
+        object.insert("error", error);
+        writeLine(object);
+        ++m_files;
+        ++m_failed;
+        fill();
+        return;
+    }
+
+    QBuffer *buffer = new QBuffer;
+    buffer->setData(data);
+    buffer->open(QIODevice::ReadOnly);
+    job.timer.start();
+    const int id = m_recognizer->submit(buffer, contentType);
+    m_running.insert(id, job);
+}
+
+void BatchRunner::recognitionFinished(int id, SpeechRecognition::Result result,
+                                      const SpeechRecognition::Hypotheses &hypotheses,
+                                      const LatencyTrace &trace)
+{
+    if (!m_running.contains(id))
+        return;
+    const Job job = m_running.take(id);
+
+    QJsonArray array;
+    foreach (const SpeechRecognition::Hypothesis &hypothesis, hypotheses) {
+        QJsonObject entry;
+        entry.insert("utterance", hypothesis.utterance);
+        entry.insert("confidence", hypothesis.confidence);
+        if (!hypothesis.language.isEmpty())
+            entry.insert("language", hypothesis.language);
+        array.append(entry);
+    }
+
+    QJsonObject object;
+    object.insert("file", job.path);
+    object.insert("status", int(result));
+    object.insert("seconds", job.seconds);
+    object.insert("latency", double(job.timer.elapsed()) / 1000.0);
+    object.insert("hypotheses", array);
+    object.insert("trace", QJsonObject::fromVariantMap(trace.toVariantMap()));
+    writeLine(object);
+
+    ++m_files;
+    if (result != SpeechRecognition::Result_Success)
+        ++m_failed;
+    m_audioSeconds += job.seconds;
+    fill();
+}
+
+void BatchRunner::writeLine(const QJsonObject &object)
+{
+    if (!m_output)
+        return;
+    m_output->write(QJsonDocument(object).toJson(QJsonDocument::Compact));
+    m_output->write("\n");
+}
+
+void BatchRunner::finishIfDone()
+{
+    if (m_finished || !m_inputsDone || !m_loading.isEmpty() || !m_running.isEmpty())
+        return;
+    m_finished = true;
+    report();
+    emit finished();
+}
+
+void BatchRunner::report()
+{
+    const double elapsed = qMax(m_timer.elapsed(), qint64(1)) / 1000.0;
+    fprintf(stderr, "%d files, %d failed, %.1f s of audio in %.2f s: "
+            "%.2f files/s, %.2f audio-s/s\n",
+            m_files, m_failed, m_audioSeconds, elapsed,
+            m_files / elapsed, m_audioSeconds / elapsed);
+    if (m_recognizer->cacheEnabled()) {
+        fprintf(stderr, "cache: %lld hits, %lld misses\n",
+                m_recognizer->cacheHits(), m_recognizer->cacheMisses());
+    }
+}
@@ -0,0 +1,87 @@
+#ifndef BATCHRUNNER_H
+#define BATCHRUNNER_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QStringList>
+#include <QThreadPool>
+
+#include "speechrecognition.h"
+
+class QDirIterator;
+class QIODevice;
+class QJsonObject;
+
+// Transcribes every FLAC and WAV file under a set of paths. Files are
+// listed lazily and only a fixed window of them is held at once: decoding
+// and encoding run on a thread pool, recognition requests go through a
+// single SpeechRecognition limited to the configured concurrency. One JSON
+// object per file is written to the output as soon as its result arrives.
+class BatchRunner : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit BatchRunner(QObject *parent = 0);
+    ~BatchRunner();
+
+    void setInputs(const QStringList &inputs);
+    void setOutput(QIODevice *output);
+
+    int concurrency() const;
+    void setConcurrency(int concurrency);
+    int threads() const;
+    void setThreads(int threads);
+
+    SpeechRecognition *recognizer() const;
+
+    int exitCode() const;
+
+public Q_SLOTS:
+    void start();
+
+Q_SIGNALS:
+    void finished();
+
+private Q_SLOTS:
+    void fileLoaded(int index, const QByteArray &data, const QByteArray &contentType,
+                    double seconds, const QString &error);
+    void recognitionFinished(int id, SpeechRecognition::Result result,
+                             const SpeechRecognition::Hypotheses &hypotheses,
+                             const LatencyTrace &trace);
+
+private:
+    struct Job {
+        QString path;
+        double seconds;
+        QElapsedTimer timer;
+    };
+
+    bool nextFile(QString *path);
+    void fill();
+    void writeLine(const QJsonObject &object);
+    void finishIfDone();
+    void report();
+
+    QStringList m_inputs;
+    QDirIterator *m_iterator;
+    bool m_inputsDone;
+    QIODevice *m_output;
+
+    SpeechRecognition *m_recognizer;
+    QThreadPool m_pool;
+    int m_concurrency;
+
+    QHash<int, Job> m_loading;
+    QHash<int, Job> m_running;
+    int m_nextIndex;
+
+    QElapsedTimer m_timer;
+    int m_files;
+    int m_failed;
+    double m_audioSeconds;
+    bool m_finished;
+};
+
+#endif // BATCHRUNNER_H
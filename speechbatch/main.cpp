@@ -0,0 +1,96 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QFile>
+#include <QThread>
+
+#include <stdio.h>
+
+#include "batchrunner.h"
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("speechbatch");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(
+        QCoreApplication::translate("main",
+            "Transcribes FLAC and WAV files, writing one JSON object per line."));
+    parser.addHelpOption();
+    parser.addPositionalArgument("paths",
+        QCoreApplication::translate("main", "Files or directories to transcribe."),
+        "paths...");
+
+    QCommandLineOption concurrencyOption(QStringList() << "c" << "concurrency",
+        QCoreApplication::translate("main", "Recognition requests in flight at once."),
+        "n", "4");
+    QCommandLineOption threadsOption(QStringList() << "j" << "threads",
+        QCoreApplication::translate("main", "Threads decoding and encoding audio."),
+        "n", QString::number(qMax(1, QThread::idealThreadCount())));
+    QCommandLineOption outputOption(QStringList() << "o" << "output",
+        QCoreApplication::translate("main", "Write results to <file> instead of stdout."),
+        "file");
+    QCommandLineOption cacheOption("cache",
+        QCoreApplication::translate("main", "Reuse results stored in <file>."),
+        "file");
+    QCommandLineOption languagesOption(QStringList() << "l" << "languages",
+        QCoreApplication::translate("main",
+            "Recognize each file in every one of these comma-separated languages."),
+        "codes");
+    QCommandLineOption metricsPortOption("metrics-port",
+        QCoreApplication::translate("main",
+            "Serve Prometheus metrics on http://127.0.0.1:<port>/metrics."),
+        "port");
+    QCommandLineOption metricsFileOption("metrics-file",
+        QCoreApplication::translate("main",
+            "Rewrite <file> with Prometheus metrics every 15 seconds."),
+        "file");
+    parser.addOption(concurrencyOption);
+    parser.addOption(threadsOption);
+    parser.addOption(outputOption);
+    parser.addOption(cacheOption);
+    parser.addOption(languagesOption);
+    parser.addOption(metricsPortOption);
+    parser.addOption(metricsFileOption);
+    parser.process(app);
+
+    const QStringList paths = parser.positionalArguments();
+    if (paths.isEmpty())
+        parser.showHelp(1);
+
+    QFile output;
+    bool opened;
+    if (parser.isSet(outputOption)) {
+        output.setFileName(parser.value(outputOption));
+        opened = output.open(QIODevice::WriteOnly | QIODevice::Truncate);
+    } else {
+        opened = output.open(stdout, QIODevice::WriteOnly | QIODevice::Unbuffered);
+    }
+    if (!opened) {
+        fprintf(stderr, "speechbatch: %s\n", qPrintable(output.errorString()));
+        return 2;
+    }
+
+    BatchRunner runner;
+    runner.setInputs(paths);
+    runner.setOutput(&output);
+    runner.setConcurrency(parser.value(concurrencyOption).toInt());
+    runner.setThreads(parser.value(threadsOption).toInt());
+    if (parser.isSet(cacheOption)) {
+        runner.recognizer()->setCachePath(parser.value(cacheOption));
+        runner.recognizer()->setCacheEnabled(true);
+    }
+    if (parser.isSet(languagesOption)) {
+        runner.recognizer()->setLanguages(
+            parser.value(languagesOption).split(QLatin1Char(','), QString::SkipEmptyParts));
+    }
+    if (parser.isSet(metricsPortOption))
+        runner.recognizer()->setMetricsPort(parser.value(metricsPortOption).toInt());
+    if (parser.isSet(metricsFileOption))
+        runner.recognizer()->setMetricsFile(parser.value(metricsFileOption));
+
+    QObject::connect(&runner, SIGNAL(finished()), &app, SLOT(quit()));
+    QMetaObject::invokeMethod(&runner, "start", Qt::QueuedConnection);
+    app.exec();
+    return runner.exitCode();
+}
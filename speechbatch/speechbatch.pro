@@ -0,0 +1,17 @@
+TEMPLATE = app
+TARGET = speechbatch
+QT += core network
+QT -= gui
+CONFIG += console
+CONFIG -= app_bundle
+
+include(../speechcore.pri)
+
+SOURCES += \
+    main.cpp \
+    batchrunner.cpp \
+    audiofileloader.cpp
+
+HEADERS += \
+    batchrunner.h \
+    audiofileloader.h
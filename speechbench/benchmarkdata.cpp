@@ -0,0 +1,52 @@
+#include "benchmarkdata.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+namespace {
+
+const int kSampleRate = 16000;
+
+}
+
+QByteArray makeRealisticResponse()
+{
+    return "{\"status\":0,\"id\":\"b3c5f0e1a2d4c6e8f0a1b2c3d4e5f6a7-1\",\"hypotheses\":["
+           "{\"utterance\":\"turn on the kitchen lights\",\"confidence\":0.91873455},"
+           "{\"utterance\":\"turn on the kitchen light\",\"confidence\":0.05},"
+           "{\"utterance\":\"turn on the chicken lights\",\"confidence\":0.02},"
+           "{\"utterance\":\"turn off the kitchen lights\",\"confidence\":0.01},"
+           "{\"utterance\":\"turn on a kitchen lights\",\"confidence\":0.005}]}\n";
+}
+
+QByteArray makeWorstCaseResponse()
+{
+    QByteArray json = "{\"status\":0,\"id\":\"worst\",\"hypotheses\":[";
+    for (int i = 0; i < 100; ++i) {
+        if (i > 0)
+            json += ',';
+        json += "{\"utterance\":\"";
+        for (int w = 0; w < 20; ++w)
+            json += "caf\\u00e9 \\\"na\\u00efve\\\" \\ud83d\\ude00 \xc3\xa0 ";
+        json += "\",\"confidence\":" + QByteArray::number(1.0 / (i + 1), 'g', 8) + '}';
+    }
+    json += "]}";
+    return json;
+}
+
+QVector<qint16> makeSpeech(int samples)
+{
+    QVector<qint16> out(samples);
+    srand(1);
+    double phase = 0.0;
+    for (int i = 0; i < samples; ++i) {
+        const double pitch = 120.0 + 40.0 * sin(2.0 * M_PI * i / kSampleRate);
+        phase += 2.0 * M_PI * pitch / kSampleRate;
+        double value = 0.0;
+        for (int h = 1; h <= 8; ++h)
+            value += sin(h * phase) / h;
+        value = 6000.0 * value + (rand() % 601 - 300);
+        out[i] = qint16(qBound(-32768.0, value, 32767.0));
+    }
+    return out;
+}
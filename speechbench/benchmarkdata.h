@@ -0,0 +1,20 @@
+#ifndef BENCHMARKDATA_H
+#define BENCHMARKDATA_H
+
+#include <QByteArray>
+#include <QVector>
+
+// Inputs shared by speechbench and tst_speechbench, so that both time the
+// same work.
+
+// A typical reply: a handful of short alternatives, the first one scored.
+QByteArray makeRealisticResponse();
+
+// A long N-best list of long utterances full of escapes and non-ASCII text.
+QByteArray makeWorstCaseResponse();
+
+// Voiced-like test signal at 16 kHz: a few harmonics of a gliding pitch
+// plus noise. Always the same for the same length.
+QVector<qint16> makeSpeech(int samples);
+
+#endif // BENCHMARKDATA_H
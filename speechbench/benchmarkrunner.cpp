@@ -0,0 +1,151 @@
+#include "benchmarkrunner.h"
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QJsonObject>
+#include <QTextStream>
+#include <QVector>
+
+#include <algorithm>
+#include <stdlib.h>
+
+#ifdef __GLIBC__
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void *__libc_realloc(void *pointer, size_t size);
+#endif
+
+namespace {
+
+// Batches shorter than this are dominated by timer resolution.
+const qint64 kBatchNsecs = 5000000;
+
+volatile qint64 sink;
+
+// Heap allocations so far. Not atomic: benchmarks run on one thread.
+qint64 allocations;
+
+}
+
+#ifdef __GLIBC__
+// Qt's containers allocate with malloc() and realloc() rather than
+// operator new, so those are what gets counted; operator new ends up here
+// too.
+extern "C" void *malloc(size_t size)
+{
+    ++allocations;
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size)
+{
+    ++allocations;
+    return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *pointer, size_t size)
+{
+    ++allocations;
+    return __libc_realloc(pointer, size);
+}
+#endif
+
+void benchmarkSink(qint64 value)
+{
+    sink = value;
+}
+
+BenchmarkRunner::BenchmarkRunner() :
+    m_minimumTime(300)
+{
+}
+
+void BenchmarkRunner::setFilter(const QString &filter)
+{
+    m_filter = filter;
+}
+
+void BenchmarkRunner::setMinimumTime(int msecs)
+{
+    m_minimumTime = qMax(1, msecs);
+}
+
+void BenchmarkRunner::run(const QString &name, Function function, qint64 items,
+                          const QString &unit)
+{
+    if (!m_filter.isEmpty() && !name.contains(m_filter))
+        return;
+
+    // Warm up caches and find a batch size.
+    QElapsedTimer timer;
+    qint64 batch = 1;
+    forever {
+        timer.start();
+        for (qint64 i = 0; i < batch; ++i)
+            function();
+        const qint64 elapsed = timer.nsecsElapsed();
+        if (elapsed >= kBatchNsecs || batch >= (Q_INT64_C(1) << 30))
+            break;
+        batch = elapsed > 0 ? qMax(batch * 2, batch * kBatchNsecs / elapsed) : batch * 16;
+    }
+
+    QVector<double> samples;
+    qint64 calls = 0;
+    QElapsedTimer total;
+    total.start();
+    while (total.elapsed() < m_minimumTime || samples.size() < 5) {
+        timer.start();
+        for (qint64 i = 0; i < batch; ++i)
+            function();
+        samples << double(timer.nsecsElapsed()) / batch;
+        calls += batch;
+    }
+    std::sort(samples.begin(), samples.end());
+    const double nsPerCall = samples.at(samples.size() / 2);
+
+    QJsonObject result;
+    result.insert("name", name);
+    result.insert("nsPerCall", nsPerCall);
+    result.insert("calls", double(calls));
+#ifdef __GLIBC__
+    const qint64 before = allocations;
+    function();
+    result.insert("allocationsPerCall", double(allocations - before));
+#endif
+    if (items > 0) {
+        result.insert("itemsPerSecond", items * 1e9 / nsPerCall);
+        result.insert("unit", unit);
+    }
+    m_results.append(result);
+}
+
+QJsonArray BenchmarkRunner::results() const
+{
+    return m_results;
+}
+
+int BenchmarkRunner::compare(const QJsonArray &results, const QJsonArray &baseline,
+                             double threshold, QTextStream *out)
+{
+    QHash<QString, double> previous;
+    foreach (const QJsonValue &value, baseline) {
+        const QJsonObject object = value.toObject();
+        previous.insert(object.value("name").toString(), object.value("nsPerCall").toDouble());
+    }
+
+    int regressions = 0;
+    foreach (const QJsonValue &value, results) {
+        const QJsonObject object = value.toObject();
+        const QString name = object.value("name").toString();
+        if (!previous.contains(name) || previous.value(name) <= 0.0)
+            continue;
+
+        const double ratio = object.value("nsPerCall").toDouble() / previous.value(name);
+        const bool regressed = ratio > 1.0 + threshold;
+        if (regressed)
+            ++regressions;
+        *out << (regressed ? "REGRESSION " : "ok         ") << name << ": "
+             << QString::number((ratio - 1.0) * 100.0, 'f', 1) << "%\n";
+    }
+    return regressions;
+}
@@ -0,0 +1,48 @@
+#ifndef BENCHMARKRUNNER_H
+#define BENCHMARKRUNNER_H
+
+#include <QJsonArray>
+#include <QString>
+
+class QTextStream;
+
+// Times small functions and compares the results with an earlier run.
+// Each function is called in batches sized to take a few milliseconds, for
+// at least the minimum time, and the median nanoseconds per call over the
+// batches is reported, which is stable enough to compare across commits.
+// With glibc, heap allocations of one more call are counted as well.
+class BenchmarkRunner
+{
+public:
+    typedef void (*Function)();
+
+    BenchmarkRunner();
+
+    // Only names containing |filter| are run.
+    void setFilter(const QString &filter);
+    void setMinimumTime(int msecs);
+
+    // |items| is how many bytes or samples one call processes, used to
+    // report throughput; 0 leaves it out.
+    void run(const QString &name, Function function, qint64 items = 0,
+             const QString &unit = QString());
+
+    // [{"name", "nsPerCall", "calls", "allocationsPerCall",
+    //   "itemsPerSecond", "unit"}, ...]
+    QJsonArray results() const;
+
+    // Reports every benchmark more than |threshold| (a fraction) slower
+    // than in |baseline|, and returns how many there were.
+    static int compare(const QJsonArray &results, const QJsonArray &baseline,
+                       double threshold, QTextStream *out);
+
+private:
+    QString m_filter;
+    int m_minimumTime;
+    QJsonArray m_results;
+};
+
+// Stores a value where the optimizer cannot discard it.
+void benchmarkSink(qint64 value);
+
+#endif // BENCHMARKRUNNER_H
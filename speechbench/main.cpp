@@ -0,0 +1,436 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QEventLoop>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTextStream>
+#include <QTimer>
+#include <QVariant>
+#include <QVector>
+
+#include <stdio.h>
+#include <time.h>
+
+#include "audiostream.h"
+#include "benchmarkdata.h"
+#include "benchmarkrunner.h"
+#include "dspkernels.h"
+#include "featureextractor.h"
+#include "fft.h"
+#include "flacencoder.h"
+#include "keywordspotter.h"
+#include "levelmeter.h"
+#include "noisesuppressor.h"
+#include "qtrecorder.h"
+#include "resampler.h"
+#include "responseparser.h"
+#include "resultcache.h"
+#include "speexencoder.h"
+#include "voiceactivitydetector.h"
+
+namespace {
+
+const int kSampleRate = 16000;
+// How long a backend may take to finish its stream after stop().
+const int kFinishTimeout = 10000;
+
+QByteArray realisticResponse;
+QByteArray worstCaseResponse;
+QVector<qint16> speech;
+QByteArray encodedSpeech;
+QVector<uchar> pcmOut;
+QVector<float> fftInput;
+QVector<float> fftRe;
+QVector<float> fftIm;
+Fft *fft = 0;
+QVector<qint16> capture48k;
+QVector<qint16> resampled;
+QVector<qint16> suppressed;
+FeatureExtractor *spectrumExtractor = 0;
+FeatureExtractor *mfccExtractor = 0;
+FeatureExtractor *mfccExtractor48k = 0;
+FeatureExtractor *keywordExtractor = 0;
+
+// Gives an extractor a reason to compute: the features are only worked out
+// as far as some consumer asks.
+class FrameSink : public FeatureConsumer
+{
+public:
+    bool consumeFrame(const FeatureFrame &frame)
+    {
+        benchmarkSink(frame.index);
+        return false;
+    }
+};
+
+// Frames one call delivers from |samples| fresh samples.
+int framesIn(const FeatureExtractor &extractor, int samples)
+{
+    return (samples - extractor.frameLength()) / extractor.hop() + 1;
+}
+
+// The parser ResponseParser replaced: the whole reply through QString and
+// QJsonDocument into a QVariantMap. Kept as the baseline to compare with.
+int parseWithQJsonDocument(const QByteArray &reply)
+{
+    const QString text = QString::fromUtf8(reply);
+    const QVariantMap data = QJsonDocument::fromJson(text.toUtf8()).toVariant().toMap();
+    if (data.value("status", SpeechRecognition::Result_ErrorNetwork).toInt()
+            != SpeechRecognition::Result_Success)
+        return 0;
+
+    SpeechRecognition::Hypotheses hypotheses;
+    foreach (const QVariant &variant, data.value("hypotheses").toList()) {
+        const QVariantMap map = variant.toMap();
+        if (!map.contains("utterance") || !map.contains("confidence"))
+            continue;
+        SpeechRecognition::Hypothesis hypothesis;
+        hypothesis.utterance = map.value("utterance").toString();
+        hypothesis.confidence = map.value("confidence").toReal();
+        hypotheses << hypothesis;
+    }
+    return hypotheses.size();
+}
+
+void parseRealisticQJsonDocument()
+{
+    benchmarkSink(parseWithQJsonDocument(realisticResponse));
+}
+
+void parseWorstCaseQJsonDocument()
+{
+    benchmarkSink(parseWithQJsonDocument(worstCaseResponse));
+}
+
+void parseRealistic()
+{
+    ResponseParser parser;
+    parser.feed(realisticResponse.constData(), realisticResponse.size());
+    benchmarkSink(parser.hypotheses().size());
+}
+
+void parseWorstCase()
+{
+    ResponseParser parser;
+    parser.feed(worstCaseResponse.constData(), worstCaseResponse.size());
+    benchmarkSink(parser.hypotheses().size());
+}
+
+// The same payload arriving one TCP segment at a time.
+void parseWorstCaseSegmented()
+{
+    ResponseParser parser;
+    const int segment = 1460;
+    for (int pos = 0; pos < worstCaseResponse.size(); pos += segment)
+        parser.feed(worstCaseResponse.constData() + pos,
+                    qMin(segment, worstCaseResponse.size() - pos));
+    benchmarkSink(parser.hypotheses().size());
+}
+
+void codecLookup()
+{
+    static const char *const codecs[] = {
+        "audio/vorbis", "audio/PCM", "audio/FLAC", "audio/AMR", "audio/mpeg", "audio/unknown"
+    };
+    qint64 size = 0;
+    for (int i = 0; i < 6; ++i) {
+        const QString codec = QLatin1String(codecs[i]);
+        size += Recorder::getContainerFromCodec(codec).size();
+        size += Recorder::getExtensionFromCodec(codec).size();
+    }
+    benchmarkSink(size);
+}
+
+void pcmToBigEndian()
+{
+    Dsp::toBigEndian(speech.constData(), speech.size(), pcmOut.data());
+    benchmarkSink(pcmOut[1]);
+}
+
+void flacEncode()
+{
+    FlacEncoder encoder(kSampleRate);
+    QByteArray out = encoder.streamHeader();
+    out += encoder.encode(speech.constData(), speech.size());
+    out += encoder.finish();
+    benchmarkSink(out.size());
+}
+
+void speexEncode()
+{
+    SpeexEncoder encoder(kSampleRate, 16800);
+    QByteArray out = encoder.encode(speech.constData(), speech.size());
+    out += encoder.finish();
+    benchmarkSink(out.size());
+}
+
+void voiceActivity()
+{
+    VoiceActivityDetector detector(kSampleRate);
+    QVector<qint16> out;
+    detector.process(speech.constData(), speech.size(), &out);
+    benchmarkSink(out.size());
+}
+
+// |speech| is one second long, so nanoseconds per call are the CPU cost
+// per second of audio.
+void noiseSuppression()
+{
+    static NoiseSuppressor suppressor(kSampleRate);
+    suppressed.resize(0);
+    suppressor.process(speech.constData(), speech.size(), &suppressed);
+    benchmarkSink(suppressed.size());
+}
+
+void featuresSpectrum()
+{
+    spectrumExtractor->reset();
+    benchmarkSink(spectrumExtractor->process(speech.constData(), speech.size()));
+}
+
+void featuresMfcc()
+{
+    mfccExtractor->reset();
+    benchmarkSink(mfccExtractor->process(speech.constData(), speech.size()));
+}
+
+void featuresMfcc48k()
+{
+    mfccExtractor48k->reset();
+    benchmarkSink(mfccExtractor48k->process(capture48k.constData(), capture48k.size()));
+}
+
+// A second of audio searched against three one-second templates.
+void keywordSpotting()
+{
+    keywordExtractor->reset();
+    benchmarkSink(keywordExtractor->process(speech.constData(), speech.size()));
+}
+
+void fftForward()
+{
+    fft->forward(fftInput.constData(), fftRe.data(), fftIm.data());
+    benchmarkSink(qint64(fftRe[1]));
+}
+
+void resample48To16()
+{
+    static Resampler resampler(48000, kSampleRate);
+    resampled.resize(0);
+    resampler.process(capture48k.constData(), capture48k.size(), &resampled);
+    benchmarkSink(resampled.size());
+}
+
+// One second of capture in the 10 ms buffers the audio thread sees.
+void levelMeter()
+{
+    static LevelMeter meter;
+    for (int pos = 0; pos + 160 <= speech.size(); pos += 160)
+        meter.process(speech.constData() + pos, 160);
+    LevelMeter::Levels levels;
+    benchmarkSink(meter.take(&levels) ? qint64(levels.peak * 32767) : 0);
+}
+
+void cacheKey()
+{
+    benchmarkSink(qint64(ResultCache::key(encodedSpeech, "audio/x-flac; rate=16000")));
+}
+
+// Records |seconds| of live input as FLAC through |backend| and reports what
+// encoding it cost: process CPU time, which includes a backend's own
+// threads, as a percentage of the recording time; the bytes produced per
+// second; how long after the start the first encoded bytes appeared; and
+// how long after the stop the stream was finished.
+QJsonObject recordWith(Recorder::Backend backend, int seconds)
+{
+    QJsonObject result;
+    result.insert("backend", backend == Recorder::MediaRecorderBackend
+                  ? QString("MediaRecorder") : QString("AudioInput"));
+
+    Recorder recorder;
+    recorder.setBackend(backend);
+    recorder.setCodec("audio/FLAC");
+    recorder.setStreaming(true);
+
+    QEventLoop loop;
+    const clock_t cpuStart = clock();
+    recorder.start();
+    QTimer::singleShot(seconds * 1000, &loop, SLOT(quit()));
+    loop.exec();
+    recorder.stop();
+
+    AudioStream *stream = recorder.audioStream();
+    if (!stream) {
+        result.insert("error", recorder.errorString());
+        return result;
+    }
+    if (!stream->isFinished()) {
+        QObject::connect(stream, SIGNAL(finished()), &loop, SLOT(quit()));
+        QTimer::singleShot(kFinishTimeout, &loop, SLOT(quit()));
+        loop.exec();
+    }
+    const double cpu = double(clock() - cpuStart) / CLOCKS_PER_SEC;
+
+    const LatencyTrace trace = stream->trace();
+    result.insert("bytesPerSecond", stream->bytesAvailable() / double(seconds));
+    result.insert("cpuPercent", 100.0 * cpu / seconds);
+    result.insert("firstFrameMs", trace.elapsed(LatencyTrace::RecordStart,
+                                                LatencyTrace::FirstFrame));
+    result.insert("finalizeMs", trace.elapsed(LatencyTrace::RecordStop,
+                                              LatencyTrace::EncoderFinalized));
+    if (!stream->isFinished())
+        result.insert("error", QString("Stream not finished"));
+    return result;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("speechbench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(
+        QCoreApplication::translate("main",
+            "Times the plugin's hot paths and writes the results as JSON."));
+    parser.addHelpOption();
+
+    QCommandLineOption filterOption("filter",
+        QCoreApplication::translate("main", "Only run benchmarks whose name contains <text>."),
+        "text");
+    QCommandLineOption timeOption("time",
+        QCoreApplication::translate("main", "Minimum milliseconds per benchmark."),
+        "ms", "300");
+    QCommandLineOption outputOption(QStringList() << "o" << "output",
+        QCoreApplication::translate("main", "Write the results to <file> instead of stdout."),
+        "file");
+    QCommandLineOption baselineOption("baseline",
+        QCoreApplication::translate("main", "Compare with the results in <file>."),
+        "file");
+    QCommandLineOption thresholdOption("threshold",
+        QCoreApplication::translate("main", "Percent slowdown counted as a regression."),
+        "percent", "10");
+    QCommandLineOption compareBackendOption("compare-backend",
+        QCoreApplication::translate("main",
+            "Record <seconds> of live input as FLAC through QAudioRecorder, then "
+            "through the built-in encoder, and report the CPU, size and latency of "
+            "each. Play the same audio into the input both times."),
+        "seconds");
+    parser.addOption(filterOption);
+    parser.addOption(timeOption);
+    parser.addOption(outputOption);
+    parser.addOption(baselineOption);
+    parser.addOption(thresholdOption);
+    parser.addOption(compareBackendOption);
+    parser.process(app);
+
+    realisticResponse = makeRealisticResponse();
+    worstCaseResponse = makeWorstCaseResponse();
+    speech = makeSpeech(kSampleRate);
+    pcmOut.resize(2 * speech.size());
+    {
+        FlacEncoder encoder(kSampleRate);
+        encodedSpeech = encoder.streamHeader();
+        encodedSpeech += encoder.encode(speech.constData(), speech.size());
+        encodedSpeech += encoder.finish();
+    }
+    Fft transform(512);
+    fft = &transform;
+    fftInput.resize(512);
+    for (int i = 0; i < 512; ++i)
+        fftInput[i] = speech[i];
+    capture48k = makeSpeech(3 * kSampleRate);
+    resampled.reserve(kSampleRate + 64);
+    suppressed.reserve(kSampleRate + 512);
+    fftRe.resize(257);
+    fftIm.resize(257);
+    KeywordSpotter keywords(kSampleRate);
+    for (int i = 0; i < 3; ++i)
+        keywords.addTemplate(capture48k.constData() + i * kSampleRate, kSampleRate);
+    // Never close enough to match, so every frame runs the full search.
+    keywords.setThreshold(1e-6);
+
+    FrameSink sink;
+    FeatureExtractor spectrum(kSampleRate);
+    spectrum.addConsumer(&sink, FeatureExtractor::Spectrum);
+    spectrumExtractor = &spectrum;
+    FeatureExtractor mfcc(kSampleRate);
+    mfcc.addConsumer(&sink, FeatureExtractor::Mfcc);
+    mfccExtractor = &mfcc;
+    FeatureExtractor mfcc48k(48000);
+    mfcc48k.addConsumer(&sink, FeatureExtractor::Mfcc);
+    mfccExtractor48k = &mfcc48k;
+    FeatureExtractor keywordFeatures(kSampleRate);
+    keywordFeatures.addConsumer(&keywords, FeatureExtractor::Mfcc);
+    keywordExtractor = &keywordFeatures;
+
+    BenchmarkRunner runner;
+    runner.setFilter(parser.value(filterOption));
+    runner.setMinimumTime(parser.value(timeOption).toInt());
+    runner.run("parse/realistic", parseRealistic, realisticResponse.size(), "bytes");
+    runner.run("parse/worstCase", parseWorstCase, worstCaseResponse.size(), "bytes");
+    runner.run("parse/worstCaseSegmented", parseWorstCaseSegmented,
+               worstCaseResponse.size(), "bytes");
+    runner.run("parse/qjsondocument", parseRealisticQJsonDocument,
+               realisticResponse.size(), "bytes");
+    runner.run("parse/qjsondocumentWorstCase", parseWorstCaseQJsonDocument,
+               worstCaseResponse.size(), "bytes");
+    runner.run("recorder/codecLookup", codecLookup);
+    runner.run("pcm/toBigEndian", pcmToBigEndian, speech.size(), "samples");
+    runner.run("encode/flac", flacEncode, speech.size(), "samples");
+    if (SpeexEncoder::isAvailable())
+        runner.run("encode/speex", speexEncode, speech.size(), "samples");
+    runner.run("vad/process", voiceActivity, speech.size(), "samples");
+    runner.run("suppress/process", noiseSuppression, speech.size(), "samples");
+    // Single-threaded, so frames per second are per core.
+    runner.run("features/spectrum", featuresSpectrum,
+               framesIn(spectrum, speech.size()), "frames");
+    runner.run("features/mfcc", featuresMfcc, framesIn(mfcc, speech.size()), "frames");
+    runner.run("features/mfcc48000", featuresMfcc48k,
+               framesIn(mfcc48k, capture48k.size()), "frames");
+    runner.run("kws/process", keywordSpotting, speech.size(), "samples");
+    runner.run("fft/forward512", fftForward);
+    runner.run("resample/48000to16000", resample48To16, capture48k.size(), "samples");
+    runner.run("meter/process", levelMeter, speech.size(), "samples");
+    runner.run("cache/key", cacheKey, encodedSpeech.size(), "bytes");
+
+    QJsonObject report;
+    report.insert("benchmarks", runner.results());
+    if (parser.isSet(compareBackendOption)) {
+        const int seconds = qMax(1, parser.value(compareBackendOption).toInt());
+        QJsonArray encoders;
+        encoders.append(recordWith(Recorder::MediaRecorderBackend, seconds));
+        encoders.append(recordWith(Recorder::AudioInputBackend, seconds));
+        report.insert("encoders", encoders);
+    }
+    const QByteArray json = QJsonDocument(report).toJson();
+
+    if (parser.isSet(outputOption)) {
+        QFile file(parser.value(outputOption));
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            fprintf(stderr, "speechbench: %s\n", qPrintable(file.errorString()));
+            return 2;
+        }
+        file.write(json);
+    } else {
+        fwrite(json.constData(), 1, json.size(), stdout);
+    }
+
+    if (parser.isSet(baselineOption)) {
+        QFile file(parser.value(baselineOption));
+        if (!file.open(QIODevice::ReadOnly)) {
+            fprintf(stderr, "speechbench: %s\n", qPrintable(file.errorString()));
+            return 2;
+        }
+        const QJsonArray baseline =
+                QJsonDocument::fromJson(file.readAll()).object().value("benchmarks").toArray();
+        QTextStream err(stderr);
+        const int regressions = BenchmarkRunner::compare(
+                runner.results(), baseline, parser.value(thresholdOption).toDouble() / 100.0, &err);
+        if (regressions > 0)
+            return 1;
+    }
+    return 0;
+}
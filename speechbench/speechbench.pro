@@ -0,0 +1,39 @@
+TEMPLATE = app
+TARGET = speechbench
+QT += core network multimedia qml
+QT -= gui
+CONFIG += console
+CONFIG -= app_bundle
+
+include(../speechcore.pri)
+
+# Plugin sources exercised by the benchmarks.
+SOURCES += \
+    ../qtrecorder.cpp \
+    ../audiocapture.cpp \
+    ../levelmeter.cpp \
+    ../fft.cpp \
+    ../featureextractor.cpp \
+    ../voiceactivitydetector.cpp \
+    ../noisesuppressor.cpp \
+    ../keywordspotter.cpp
+
+HEADERS += \
+    ../qtrecorder.h \
+    ../audiocapture.h \
+    ../levelmeter.h \
+    ../ringbuffer.h \
+    ../fft.h \
+    ../featureextractor.h \
+    ../voiceactivitydetector.h \
+    ../noisesuppressor.h \
+    ../keywordspotter.h
+
+SOURCES += \
+    main.cpp \
+    benchmarkdata.cpp \
+    benchmarkrunner.cpp
+
+HEADERS += \
+    benchmarkdata.h \
+    benchmarkrunner.h
@@ -0,0 +1,43 @@
+# Recognition, codec and transport sources shared by the QML plugin and the
+# command-line tools. Needs QT += network.
+INCLUDEPATH += $$PWD
+DEPENDPATH += $$PWD
+
+# Speex is optional; without it the "audio/speex" codec is not offered.
+packagesExist(speex) {
+    CONFIG += link_pkgconfig
+    PKGCONFIG += speex
+    DEFINES += HAVE_SPEEX
+}
+
+SOURCES += \
+    $$PWD/speechrecognition.cpp \
+    $$PWD/recognitionworker.cpp \
+    $$PWD/audiostream.cpp \
+    $$PWD/streamingupload.cpp \
+    $$PWD/flacencoder.cpp \
+    $$PWD/speexencoder.cpp \
+    $$PWD/dspkernels.cpp \
+    $$PWD/resampler.cpp \
+    $$PWD/responseparser.cpp \
+    $$PWD/resultcache.cpp \
+    $$PWD/latencytrace.cpp \
+    $$PWD/audiosegmenter.cpp \
+    $$PWD/metrics.cpp \
+    $$PWD/metricsexporter.cpp
+
+HEADERS += \
+    $$PWD/speechrecognition.h \
+    $$PWD/recognitionworker.h \
+    $$PWD/audiostream.h \
+    $$PWD/streamingupload.h \
+    $$PWD/flacencoder.h \
+    $$PWD/speexencoder.h \
+    $$PWD/dspkernels.h \
+    $$PWD/resampler.h \
+    $$PWD/responseparser.h \
+    $$PWD/resultcache.h \
+    $$PWD/latencytrace.h \
+    $$PWD/audiosegmenter.h \
+    $$PWD/metrics.h \
+    $$PWD/metricsexporter.h
@@ -0,0 +1,276 @@
+#include "loadgenerator.h"
+#include "audiostream.h"
+
+#include <QBuffer>
+#include <QTimer>
+
+#include <algorithm>
+
+namespace {
+
+const int kFrameInterval = 16;
+
+// Nearest rank on sorted values.
+qreal nearestRank(const QVector<qreal> &sorted, qreal fraction)
+{
+    if (sorted.isEmpty())
+        return 0.0;
+    const int rank = qBound(0, int(fraction * sorted.size() + 0.5) - 1, sorted.size() - 1);
+    return sorted.at(rank);
+}
+
+}
+
+LoadGenerator::LoadGenerator(QObject *parent) :
+    QObject(parent),
+    m_clientCount(8),
+    m_depth(1),
+    m_requests(1000),
+    m_threaded(false),
+    m_hedging(false),
+    m_http2(false),
+    m_recordTime(0),
+    m_warmUp(false),
+    m_streaming(false),
+    m_elapsed(0),
+    m_sent(0),
+    m_errors(0),
+    m_lastFrame(0)
+{
+    m_frameTimer = new QTimer(this);
+    m_frameTimer->setTimerType(Qt::PreciseTimer);
+    m_frameTimer->setInterval(kFrameInterval);
+    connect(m_frameTimer, SIGNAL(timeout()), this, SLOT(frameTick()));
+}
+
+void LoadGenerator::setUrl(const QUrl &url)
+{
+    m_url = url;
+}
+
+void LoadGenerator::setAudio(const QByteArray &audio, const QByteArray &contentType)
+{
+    m_audio = audio;
+    m_contentType = contentType;
+}
+
+void LoadGenerator::setClients(int clients)
+{
+    m_clientCount = qMax(1, clients);
+}
+
+void LoadGenerator::setDepth(int depth)
+{
+    m_depth = qMax(1, depth);
+}
+
+void LoadGenerator::setRequests(int requests)
+{
+    m_requests = qMax(1, requests);
+}
+
+void LoadGenerator::setThreaded(bool threaded)
+{
+    m_threaded = threaded;
+}
+
+void LoadGenerator::setHedging(bool hedging)
+{
+    m_hedging = hedging;
+}
+
+void LoadGenerator::setHttp2(bool http2)
+{
+    m_http2 = http2;
+}
+
+void LoadGenerator::setRecordTime(int recordTime)
+{
+    m_recordTime = qMax(0, recordTime);
+}
+
+void LoadGenerator::setWarmUp(bool warmUp)
+{
+    m_warmUp = warmUp;
+}
+
+void LoadGenerator::setStreaming(bool streaming)
+{
+    m_streaming = streaming;
+}
+
+int LoadGenerator::completed() const
+{
+    return m_latencies.size();
+}
+
+int LoadGenerator::errors() const
+{
+    return m_errors;
+}
+
+qreal LoadGenerator::elapsed() const
+{
+    return m_elapsed / 1e9;
+}
+
+qreal LoadGenerator::requestsPerSecond() const
+{
+    return m_elapsed ? completed() / elapsed() : 0.0;
+}
+
+qreal LoadGenerator::percentile(qreal fraction) const
+{
+    return nearestRank(m_latencies, fraction);
+}
+
+qreal LoadGenerator::mean() const
+{
+    if (m_latencies.isEmpty())
+        return 0.0;
+    qreal sum = 0.0;
+    foreach (qreal latency, m_latencies)
+        sum += latency;
+    return sum / m_latencies.size();
+}
+
+qreal LoadGenerator::timeToFirstByte(qreal fraction) const
+{
+    return nearestRank(m_firstBytes, fraction);
+}
+
+qreal LoadGenerator::frameLag(qreal fraction) const
+{
+    return nearestRank(m_frameLags, fraction);
+}
+
+qreal LoadGenerator::maxFrameLag() const
+{
+    return m_frameLags.isEmpty() ? 0.0 : m_frameLags.last();
+}
+
+int LoadGenerator::hedgesSent() const
+{
+    int sent = 0;
+    foreach (SpeechRecognition *client, m_clients)
+        sent += client->hedgesSent();
+    return sent;
+}
+
+int LoadGenerator::hedgesWon() const
+{
+    int won = 0;
+    foreach (SpeechRecognition *client, m_clients)
+        won += client->hedgesWon();
+    return won;
+}
+
+int LoadGenerator::retries() const
+{
+    int retries = 0;
+    foreach (SpeechRecognition *client, m_clients)
+        retries += client->retries();
+    return retries;
+}
+
+void LoadGenerator::start()
+{
+    m_latencies.reserve(m_requests);
+    for (int i = 0; i < m_clientCount; ++i) {
+        SpeechRecognition *client = new SpeechRecognition(this);
+        client->setUrl(m_url);
+        client->setMaxInFlight(m_depth);
+        client->setThreaded(m_threaded);
+        client->setHedging(m_hedging);
+        client->setHttp2(m_http2);
+        connect(client, &SpeechRecognition::Finished,
+                this, &LoadGenerator::recognitionFinished);
+        m_clients << client;
+    }
+
+    m_clock.start();
+    m_lastFrame = 0;
+    m_frameTimer->start();
+    for (int d = 0; d < m_depth; ++d) {
+        foreach (SpeechRecognition *client, m_clients)
+            record(client);
+    }
+}
+
+void LoadGenerator::record(SpeechRecognition *client)
+{
+    if (m_sent >= m_requests)
+        return;
+    ++m_sent;
+
+    if (m_recordTime == 0) {
+        submit(client);
+        return;
+    }
+    if (m_warmUp)
+        client->warmUp();
+    m_recording.enqueue(client);
+    QTimer::singleShot(m_recordTime, this, SLOT(recordingDone()));
+}
+
+void LoadGenerator::recordingDone()
+{
+    if (!m_recording.isEmpty())
+        submit(m_recording.dequeue());
+}
+
+void LoadGenerator::submit(SpeechRecognition *client)
+{
+    const qint64 now = m_clock.nsecsElapsed();
+    int id;
+    if (m_streaming) {
+        AudioStream *stream = new AudioStream;
+        stream->setContentType(m_contentType);
+        stream->write(m_audio);
+        stream->finish();
+        id = client->start(stream);
+    } else {
+        QBuffer *buffer = new QBuffer;
+        buffer->setData(m_audio);
+        buffer->open(QIODevice::ReadOnly);
+        id = client->submit(buffer, m_contentType);
+    }
+    m_started.insert(Key(client, id), now);
+}
+
+void LoadGenerator::recognitionFinished(int id, SpeechRecognition::Result result,
+                                        const SpeechRecognition::Hypotheses &hypotheses,
+                                        const LatencyTrace &trace)
+{
+    Q_UNUSED(hypotheses);
+
+    SpeechRecognition *client = qobject_cast<SpeechRecognition *>(sender());
+    const qint64 started = m_started.take(Key(client, id));
+    m_latencies << (m_clock.nsecsElapsed() - started) / 1e6;
+    if (result != SpeechRecognition::Result_Success)
+        ++m_errors;
+    const qreal firstByte = trace.elapsed(LatencyTrace::RequestPosted,
+                                          LatencyTrace::FirstResponseByte);
+    if (firstByte >= 0)
+        m_firstBytes << firstByte;
+
+    if (m_latencies.size() < m_requests) {
+        record(client);
+        return;
+    }
+
+    m_elapsed = m_clock.nsecsElapsed();
+    m_frameTimer->stop();
+    std::sort(m_latencies.begin(), m_latencies.end());
+    std::sort(m_firstBytes.begin(), m_firstBytes.end());
+    std::sort(m_frameLags.begin(), m_frameLags.end());
+    emit finished();
+}
+
+void LoadGenerator::frameTick()
+{
+    const qint64 now = m_clock.nsecsElapsed();
+    const qreal interval = (now - m_lastFrame) / 1e6;
+    m_lastFrame = now;
+    m_frameLags << qMax(qreal(0.0), interval - kFrameInterval);
+}
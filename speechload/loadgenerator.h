@@ -0,0 +1,111 @@
+#ifndef LOADGENERATOR_H
+#define LOADGENERATOR_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QPair>
+#include <QQueue>
+#include <QUrl>
+#include <QVector>
+
+class QTimer;
+
+#include "speechrecognition.h"
+
+// Drives a number of SpeechRecognition instances against one endpoint in a
+// closed loop: every client keeps |depth| requests outstanding until the
+// total has been sent. Latency runs from submit() to Finished(), so it
+// covers the whole networking and parsing path. While it runs, a timer
+// ticking at display rate records how late the client thread's event loop
+// serves it, which is what a GUI thread would lose in frame time. With a
+// record time, every request is preceded by that long a pause, as if the
+// user were speaking; with warm-up the client connects at its start.
+// Requests are buffered posts, or chunked streams as the recorder sends.
+class LoadGenerator : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit LoadGenerator(QObject *parent = 0);
+
+    void setUrl(const QUrl &url);
+    void setAudio(const QByteArray &audio, const QByteArray &contentType);
+    void setClients(int clients);
+    void setDepth(int depth);
+    void setRequests(int requests);
+    void setThreaded(bool threaded);
+    void setHedging(bool hedging);
+    void setHttp2(bool http2);
+    void setRecordTime(int recordTime);
+    void setWarmUp(bool warmUp);
+    void setStreaming(bool streaming);
+
+    int completed() const;
+    int errors() const;
+    qreal elapsed() const;
+    qreal requestsPerSecond() const;
+    // Milliseconds below which |fraction| of the requests completed.
+    qreal percentile(qreal fraction) const;
+    qreal mean() const;
+    // Milliseconds from posting a request to the first byte of its reply.
+    qreal timeToFirstByte(qreal fraction) const;
+    // Milliseconds the frame timer fired late.
+    qreal frameLag(qreal fraction) const;
+    qreal maxFrameLag() const;
+    // Summed over all clients.
+    int hedgesSent() const;
+    int hedgesWon() const;
+    int retries() const;
+
+public Q_SLOTS:
+    void start();
+
+Q_SIGNALS:
+    void finished();
+
+private Q_SLOTS:
+    void recognitionFinished(int id, SpeechRecognition::Result result,
+                             const SpeechRecognition::Hypotheses &hypotheses,
+                             const LatencyTrace &trace);
+    void recordingDone();
+    void frameTick();
+
+private:
+    typedef QPair<SpeechRecognition *, int> Key;
+
+    void record(SpeechRecognition *client);
+    void submit(SpeechRecognition *client);
+
+    QUrl m_url;
+    QByteArray m_audio;
+    QByteArray m_contentType;
+    int m_clientCount;
+    int m_depth;
+    int m_requests;
+    bool m_threaded;
+    bool m_hedging;
+    bool m_http2;
+    int m_recordTime;
+    bool m_warmUp;
+    bool m_streaming;
+
+    QList<SpeechRecognition *> m_clients;
+    QHash<Key, qint64> m_started;
+    QElapsedTimer m_clock;
+    qint64 m_elapsed;
+    int m_sent;
+    int m_errors;
+    QVector<qreal> m_latencies;
+    QVector<qreal> m_firstBytes;
+    // Clients whose recording pause is running, in the order it ends.
+    QQueue<SpeechRecognition *> m_recording;
+
+    QTimer *m_frameTimer;
+    qint64 m_lastFrame;
+    QVector<qreal> m_frameLags;
+};
+
+#endif // LOADGENERATOR_H
@@ -0,0 +1,246 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QFile>
+#include <QHostAddress>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QThread>
+#include <QVector>
+
+#include <math.h>
+#include <stdio.h>
+
+#include "flacencoder.h"
+#include "loadgenerator.h"
+#include "mockserver.h"
+
+namespace {
+
+// One second of a 440 Hz tone at 16 kHz, encoded like the recorder does.
+QByteArray syntheticAudio(QByteArray *contentType)
+{
+    const int sampleRate = 16000;
+    QVector<qint16> samples(sampleRate);
+    for (int i = 0; i < samples.size(); ++i)
+        samples[i] = qint16(8000.0 * sin(2.0 * M_PI * 440.0 * i / sampleRate));
+
+    FlacEncoder encoder(sampleRate);
+    QByteArray audio = encoder.streamHeader();
+    audio += encoder.encode(samples.constData(), samples.size());
+    audio += encoder.finish();
+    *contentType = "audio/x-flac; rate=" + QByteArray::number(sampleRate);
+    return audio;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("speechload");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(
+        QCoreApplication::translate("main",
+            "Load-tests a recognition endpoint. Without --url, an in-process "
+            "mock server on its own thread is used."));
+    parser.addHelpOption();
+
+    QCommandLineOption urlOption("url",
+        QCoreApplication::translate("main", "Recognition endpoint to test."), "url");
+    QCommandLineOption clientsOption("clients",
+        QCoreApplication::translate("main", "SpeechRecognition instances."), "n", "8");
+    QCommandLineOption depthOption("depth",
+        QCoreApplication::translate("main", "Requests each instance keeps outstanding."),
+        "n", "1");
+    QCommandLineOption requestsOption(QStringList() << "n" << "requests",
+        QCoreApplication::translate("main", "Total requests."), "n", "1000");
+    QCommandLineOption audioOption("audio",
+        QCoreApplication::translate("main", "FLAC file to send instead of a synthetic tone."),
+        "file");
+    QCommandLineOption rateOption("rate",
+        QCoreApplication::translate("main", "Sample rate of --audio."), "hz", "16000");
+    QCommandLineOption latencyOption("latency",
+        QCoreApplication::translate("main", "Mock server: milliseconds before each reply."),
+        "ms", "0");
+    QCommandLineOption jitterOption("jitter",
+        QCoreApplication::translate("main", "Mock server: extra milliseconds per reply."),
+        "ms", "0");
+    QCommandLineOption errorRateOption("error-rate",
+        QCoreApplication::translate("main", "Mock server: fraction of failed requests."),
+        "rate", "0");
+    QCommandLineOption payloadOption("payload",
+        QCoreApplication::translate("main", "Mock server: size of each reply."),
+        "bytes", "0");
+    QCommandLineOption handshakeOption("handshake",
+        QCoreApplication::translate("main",
+            "Mock server: milliseconds before a new connection's first request is read."),
+        "ms", "0");
+    QCommandLineOption closeOption("close",
+        QCoreApplication::translate("main",
+            "Mock server: close the connection after every reply."));
+    QCommandLineOption recordOption("record",
+        QCoreApplication::translate("main",
+            "Milliseconds each instance spends recording before every request."),
+        "ms", "0");
+    QCommandLineOption warmUpOption("warm-up",
+        QCoreApplication::translate("main",
+            "Warm up the connection when each recording starts."));
+    QCommandLineOption streamOption("stream",
+        QCoreApplication::translate("main",
+            "Send each request as a chunked stream instead of a buffered post."));
+    QCommandLineOption threadedOption("threaded",
+        QCoreApplication::translate("main",
+            "Run each instance's networking and parsing on a worker thread."));
+    QCommandLineOption compareThreadedOption("compare-threaded",
+        QCoreApplication::translate("main",
+            "Run the load once on the client thread, then again with --threaded, "
+            "and report the frame lag of both. Connections count both runs."));
+    QCommandLineOption http2Option("http2",
+        QCoreApplication::translate("main",
+            "Multiplex each instance's requests over one HTTP/2 connection. "
+            "Does not apply to --stream, which stays on HTTP/1.1."));
+    QCommandLineOption hedgeOption("hedge",
+        QCoreApplication::translate("main",
+            "Hedge slow requests and retry failed ones within the retry budget."));
+    QCommandLineOption jsonOption("json",
+        QCoreApplication::translate("main", "Print the report as a JSON object."));
+    parser.addOption(urlOption);
+    parser.addOption(clientsOption);
+    parser.addOption(depthOption);
+    parser.addOption(requestsOption);
+    parser.addOption(audioOption);
+    parser.addOption(rateOption);
+    parser.addOption(latencyOption);
+    parser.addOption(jitterOption);
+    parser.addOption(errorRateOption);
+    parser.addOption(payloadOption);
+    parser.addOption(handshakeOption);
+    parser.addOption(closeOption);
+    parser.addOption(recordOption);
+    parser.addOption(warmUpOption);
+    parser.addOption(streamOption);
+    parser.addOption(threadedOption);
+    parser.addOption(compareThreadedOption);
+    parser.addOption(http2Option);
+    parser.addOption(hedgeOption);
+    parser.addOption(jsonOption);
+    parser.process(app);
+
+    QByteArray contentType;
+    QByteArray audio;
+    if (parser.isSet(audioOption)) {
+        QFile file(parser.value(audioOption));
+        if (!file.open(QIODevice::ReadOnly)) {
+            fprintf(stderr, "speechload: %s\n", qPrintable(file.errorString()));
+            return 2;
+        }
+        audio = file.readAll();
+        contentType = "audio/x-flac; rate=" + parser.value(rateOption).toLatin1();
+    } else {
+        audio = syntheticAudio(&contentType);
+    }
+
+    // The server gets its own thread so it does not compete with the
+    // clients' event loop and skew the measurement.
+    QThread serverThread;
+    MockServer *server = 0;
+    QUrl url(parser.value(urlOption));
+    if (!parser.isSet(urlOption)) {
+        server = new MockServer;
+        server->setLatency(parser.value(latencyOption).toInt());
+        server->setJitter(parser.value(jitterOption).toInt());
+        server->setErrorRate(parser.value(errorRateOption).toDouble());
+        server->setPayloadSize(parser.value(payloadOption).toInt());
+        server->setHandshake(parser.value(handshakeOption).toInt());
+        server->setKeepAlive(!parser.isSet(closeOption));
+        if (!server->listen(QHostAddress::LocalHost)) {
+            fprintf(stderr, "speechload: %s\n", qPrintable(server->errorString()));
+            return 2;
+        }
+        url = QUrl(QString("http://127.0.0.1:%1/speech-api/v1/recognize?lang=en")
+                   .arg(server->serverPort()));
+        server->moveToThread(&serverThread);
+        serverThread.start();
+    }
+
+    // With --compare-threaded the second run repeats the first on worker
+    // threads, in the same process and against the same server, so the
+    // frame lags differ by little else.
+    const bool compare = parser.isSet(compareThreadedOption);
+    LoadGenerator generator;
+    LoadGenerator threadedGenerator;
+    LoadGenerator *const runs[] = { &generator, &threadedGenerator };
+    for (int i = 0; i < (compare ? 2 : 1); ++i) {
+        LoadGenerator *run = runs[i];
+        run->setUrl(url);
+        run->setAudio(audio, contentType);
+        run->setClients(parser.value(clientsOption).toInt());
+        run->setDepth(parser.value(depthOption).toInt());
+        run->setRequests(parser.value(requestsOption).toInt());
+        run->setThreaded(compare ? i == 1 : parser.isSet(threadedOption));
+        run->setHedging(parser.isSet(hedgeOption));
+        run->setHttp2(parser.isSet(http2Option));
+        run->setRecordTime(parser.value(recordOption).toInt());
+        run->setWarmUp(parser.isSet(warmUpOption));
+        run->setStreaming(parser.isSet(streamOption));
+        QObject::connect(run, SIGNAL(finished()), &app, SLOT(quit()));
+        QMetaObject::invokeMethod(run, "start", Qt::QueuedConnection);
+        app.exec();
+    }
+
+    serverThread.quit();
+    serverThread.wait();
+    // Connections the mock server accepted; unknown for a real endpoint.
+    const qint64 connections = server ? server->connections() : -1;
+    delete server;
+
+    if (parser.isSet(jsonOption)) {
+        QJsonObject report;
+        report.insert("requests", generator.completed());
+        report.insert("errors", generator.errors());
+        report.insert("seconds", generator.elapsed());
+        report.insert("requestsPerSecond", generator.requestsPerSecond());
+        report.insert("mean", generator.mean());
+        report.insert("p50", generator.percentile(0.50));
+        report.insert("p95", generator.percentile(0.95));
+        report.insert("p99", generator.percentile(0.99));
+        report.insert("ttfbP50", generator.timeToFirstByte(0.50));
+        report.insert("ttfbP95", generator.timeToFirstByte(0.95));
+        report.insert("hedgesSent", generator.hedgesSent());
+        report.insert("hedgesWon", generator.hedgesWon());
+        report.insert("retries", generator.retries());
+        if (connections >= 0)
+            report.insert("connections", double(connections));
+        report.insert("frameLagP50", generator.frameLag(0.50));
+        report.insert("frameLagP99", generator.frameLag(0.99));
+        report.insert("frameLagMax", generator.maxFrameLag());
+        if (compare) {
+            report.insert("threadedFrameLagP50", threadedGenerator.frameLag(0.50));
+            report.insert("threadedFrameLagP99", threadedGenerator.frameLag(0.99));
+            report.insert("threadedFrameLagMax", threadedGenerator.maxFrameLag());
+        }
+        printf("%s\n", QJsonDocument(report).toJson(QJsonDocument::Compact).constData());
+    } else {
+        printf("%d requests, %d errors in %.2f s: %.1f requests/s\n",
+               generator.completed(), generator.errors(), generator.elapsed(),
+               generator.requestsPerSecond());
+        printf("latency ms: mean %.2f, p50 %.2f, p95 %.2f, p99 %.2f\n",
+               generator.mean(), generator.percentile(0.50),
+               generator.percentile(0.95), generator.percentile(0.99));
+        printf("time to first byte ms: p50 %.2f, p95 %.2f\n",
+               generator.timeToFirstByte(0.50), generator.timeToFirstByte(0.95));
+        printf("hedges: %d sent, %d won; %d retries\n",
+               generator.hedgesSent(), generator.hedgesWon(), generator.retries());
+        if (connections >= 0)
+            printf("connections: %lld\n", connections);
+        printf("frame lag ms: p50 %.2f, p99 %.2f, max %.2f\n",
+               generator.frameLag(0.50), generator.frameLag(0.99),
+               generator.maxFrameLag());
+        if (compare)
+            printf("frame lag ms with --threaded: p50 %.2f, p99 %.2f, max %.2f\n",
+                   threadedGenerator.frameLag(0.50), threadedGenerator.frameLag(0.99),
+                   threadedGenerator.maxFrameLag());
+    }
+    return 0;
+}
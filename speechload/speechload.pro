@@ -0,0 +1,16 @@
+TEMPLATE = app
+TARGET = speechload
+QT += core network
+QT -= gui
+CONFIG += console
+CONFIG -= app_bundle
+
+include(../speechcore.pri)
+include(../speechmock/mockserver.pri)
+
+SOURCES += \
+    main.cpp \
+    loadgenerator.cpp
+
+HEADERS += \
+    loadgenerator.h
@@ -0,0 +1,71 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QHostAddress>
+
+#include <stdio.h>
+
+#include "mockserver.h"
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("speechmock");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(
+        QCoreApplication::translate("main",
+            "Serves canned speech recognition results for testing."));
+    parser.addHelpOption();
+
+    QCommandLineOption portOption(QStringList() << "p" << "port",
+        QCoreApplication::translate("main", "Port to listen on; 0 picks a free one."),
+        "port", "8080");
+    QCommandLineOption latencyOption("latency",
+        QCoreApplication::translate("main", "Milliseconds before each reply."),
+        "ms", "0");
+    QCommandLineOption jitterOption("jitter",
+        QCoreApplication::translate("main", "Up to this many extra milliseconds per reply."),
+        "ms", "0");
+    QCommandLineOption errorRateOption("error-rate",
+        QCoreApplication::translate("main", "Fraction of requests answered with HTTP 500."),
+        "rate", "0");
+    QCommandLineOption payloadOption("payload",
+        QCoreApplication::translate("main", "Approximate size of each JSON reply."),
+        "bytes", "0");
+    QCommandLineOption handshakeOption("handshake",
+        QCoreApplication::translate("main",
+            "Milliseconds before a new connection's first request is read."),
+        "ms", "0");
+    QCommandLineOption closeOption("close",
+        QCoreApplication::translate("main", "Close the connection after every reply."));
+    QCommandLineOption seedOption("seed",
+        QCoreApplication::translate("main", "Seed for jitter and errors."),
+        "n", "1");
+    parser.addOption(portOption);
+    parser.addOption(latencyOption);
+    parser.addOption(jitterOption);
+    parser.addOption(errorRateOption);
+    parser.addOption(payloadOption);
+    parser.addOption(handshakeOption);
+    parser.addOption(closeOption);
+    parser.addOption(seedOption);
+    parser.process(app);
+
+    qsrand(parser.value(seedOption).toUInt());
+
+    MockServer server;
+    server.setLatency(parser.value(latencyOption).toInt());
+    server.setJitter(parser.value(jitterOption).toInt());
+    server.setErrorRate(parser.value(errorRateOption).toDouble());
+    server.setPayloadSize(parser.value(payloadOption).toInt());
+    server.setHandshake(parser.value(handshakeOption).toInt());
+    server.setKeepAlive(!parser.isSet(closeOption));
+    if (!server.listen(QHostAddress::LocalHost, quint16(parser.value(portOption).toUInt()))) {
+        fprintf(stderr, "speechmock: %s\n", qPrintable(server.errorString()));
+        return 1;
+    }
+
+    printf("http://127.0.0.1:%d/speech-api/v1/recognize?lang=en\n", server.serverPort());
+    fflush(stdout);
+    return app.exec();
+}
@@ -0,0 +1,138 @@
+#include "mockconnection.h"
+#include "mockhttp2connection.h"
+#include "mockserver.h"
+
+#include <QList>
+#include <QTcpSocket>
+
+MockConnection::MockConnection(QTcpSocket *socket, MockServer *server) :
+    QObject(socket),
+    m_socket(socket),
+    m_server(server),
+    m_keepAlive(true),
+    m_waiting(false),
+    m_ready(server->handshake() == 0),
+    m_http1(false)
+{
+    m_delay.setSingleShot(true);
+    connect(&m_delay, SIGNAL(timeout()), this, SLOT(_q_reply()));
+    connect(m_socket, SIGNAL(readyRead()), this, SLOT(_q_readyRead()));
+    connect(m_socket, SIGNAL(disconnected()), m_socket, SLOT(deleteLater()));
+    if (!m_ready)
+        QTimer::singleShot(server->handshake(), this, SLOT(_q_handshakeDone()));
+}
+
+void MockConnection::_q_handshakeDone()
+{
+    m_ready = true;
+    _q_readyRead();
+}
+
+void MockConnection::_q_readyRead()
+{
+    if (!m_ready)
+        return;
+    m_buffer += m_socket->readAll();
+
+    // An HTTP/2 client with prior knowledge opens with the preface.
+    if (!m_http1) {
+        const int preface = MockHttp2Connection::matchPreface(m_buffer);
+        if (preface == 0)
+            return;
+        if (preface > 0) {
+            m_socket->disconnect(this);
+            new MockHttp2Connection(m_socket, m_server, m_buffer);
+            deleteLater();
+            return;
+        }
+        m_http1 = true;
+    }
+    if (m_waiting || !parseRequest())
+        return;
+
+    m_waiting = true;
+    m_delay.start(m_server->nextDelay());
+}
+
+void MockConnection::_q_reply()
+{
+    m_socket->write(m_server->respond(m_body, m_keepAlive));
+    m_waiting = false;
+    m_body.clear();
+
+    if (!m_keepAlive) {
+        m_socket->disconnectFromHost();
+        return;
+    }
+    // A pipelined request may already be buffered.
+    if (parseRequest()) {
+        m_waiting = true;
+        m_delay.start(m_server->nextDelay());
+    }
+}
+
+// Takes one complete request off the front of the buffer, if there is one.
+bool MockConnection::parseRequest()
+{
+    const int headerEnd = m_buffer.indexOf("\r\n\r\n");
+    if (headerEnd < 0)
+        return false;
+
+    const QList<QByteArray> lines = m_buffer.left(headerEnd).split('\n');
+    const bool http10 = lines.value(0).trimmed().endsWith("HTTP/1.0");
+    bool keepAlive = !http10;
+    qint64 contentLength = 0;
+    bool chunked = false;
+    for (int i = 1; i < lines.size(); ++i) {
+        const QByteArray line = lines.at(i).trimmed();
+        const int colon = line.indexOf(':');
+        if (colon < 0)
+            continue;
+        const QByteArray name = line.left(colon).trimmed().toLower();
+        const QByteArray value = line.mid(colon + 1).trimmed().toLower();
+        if (name == "content-length")
+            contentLength = value.toLongLong();
+        else if (name == "transfer-encoding" && value.contains("chunked"))
+            chunked = true;
+        else if (name == "connection")
+            keepAlive = value == "keep-alive" || (!http10 && value != "close");
+    }
+
+    int pos = headerEnd + 4;
+    QByteArray body;
+    if (chunked) {
+        forever {
+            const int lineEnd = m_buffer.indexOf("\r\n", pos);
+            if (lineEnd < 0)
+                return false;
+            bool ok = false;
+            const int size = m_buffer.mid(pos, lineEnd - pos).split(';').value(0).trimmed().toInt(&ok, 16);
+            if (!ok) {
+                m_socket->abort();
+                return false;
+            }
+            pos = lineEnd + 2;
+            if (size == 0) {
+                // No trailers are sent by our clients; skip the final CRLF.
+                if (m_buffer.size() < pos + 2)
+                    return false;
+                pos += 2;
+                break;
+            }
+            if (m_buffer.size() < pos + size + 2)
+                return false;
+            body += m_buffer.mid(pos, size);
+            pos += size + 2;
+        }
+    } else {
+        if (m_buffer.size() < pos + contentLength)
+            return false;
+        body = m_buffer.mid(pos, int(contentLength));
+        pos += int(contentLength);
+    }
+
+    m_buffer.remove(0, pos);
+    m_body = body;
+    m_keepAlive = keepAlive && m_server->keepAlive();
+    return true;
+}
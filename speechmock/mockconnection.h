@@ -0,0 +1,43 @@
+#ifndef MOCKCONNECTION_H
+#define MOCKCONNECTION_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QTimer>
+
+class QTcpSocket;
+class MockServer;
+
+// One client connection to MockServer. Reads HTTP/1.1 requests with either
+// a Content-Length or a chunked body, and answers each after the server's
+// delay. Keep-alive connections serve requests one after another. Nothing
+// is read until the server's handshake time has passed; a connection that
+// turns out to speak HTTP/2 is handed to MockHttp2Connection.
+class MockConnection : public QObject
+{
+    Q_OBJECT
+
+public:
+    MockConnection(QTcpSocket *socket, MockServer *server);
+
+private Q_SLOTS:
+    void _q_readyRead();
+    void _q_reply();
+    void _q_handshakeDone();
+
+private:
+    bool parseRequest();
+
+    QTcpSocket *m_socket;
+    MockServer *m_server;
+    QTimer m_delay;
+
+    QByteArray m_buffer;
+    QByteArray m_body;
+    bool m_keepAlive;
+    bool m_waiting;
+    bool m_ready;
+    bool m_http1;
+};
+
+#endif // MOCKCONNECTION_H
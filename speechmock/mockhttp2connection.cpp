@@ -0,0 +1,228 @@
+#include "mockhttp2connection.h"
+#include "mockserver.h"
+
+#include <QTcpSocket>
+#include <QTimer>
+#include <QtEndian>
+
+#include <string.h>
+
+namespace {
+
+const char kPreface[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+const int kPrefaceSize = sizeof(kPreface) - 1;
+const int kFrameHeaderSize = 9;
+
+enum FrameType {
+    Data = 0x0,
+    Headers = 0x1,
+    RstStream = 0x3,
+    Settings = 0x4,
+    Ping = 0x6,
+    GoAway = 0x7,
+    WindowUpdate = 0x8
+};
+
+enum FrameFlag {
+    EndStream = 0x1,
+    Ack = 0x1,
+    EndHeaders = 0x4,
+    Padded = 0x8
+};
+
+const int kSettingMaxConcurrentStreams = 0x3;
+const int kSettingInitialWindowSize = 0x4;
+const int kSettingMaxFrameSize = 0x5;
+
+const int kDefaultWindow = 65535;
+const int kDefaultMaxFrameSize = 16384;
+// Room for a few hundred uploads in flight at once.
+const quint32 kReceiveWindow = 16 * 1024 * 1024;
+const int kMaxConcurrentStreams = 1000;
+
+void appendSetting(QByteArray *payload, int id, quint32 value)
+{
+    uchar entry[6];
+    qToBigEndian<quint16>(quint16(id), entry);
+    qToBigEndian<quint32>(value, entry + 2);
+    payload->append(reinterpret_cast<const char *>(entry), 6);
+}
+
+// An HPACK "literal header field without indexing" naming a static table
+// entry; the value is short enough for a one-byte length.
+void appendHeader(QByteArray *block, int nameIndex, const QByteArray &value)
+{
+    if (nameIndex < 15) {
+        block->append(char(nameIndex));
+    } else {
+        block->append(char(0x0f));
+        block->append(char(nameIndex - 15));
+    }
+    block->append(char(value.size()));
+    block->append(value);
+}
+
+}
+
+MockHttp2Connection::MockHttp2Connection(QTcpSocket *socket, MockServer *server,
+                                         const QByteArray &received) :
+    QObject(socket),
+    m_socket(socket),
+    m_server(server),
+    m_buffer(received.mid(kPrefaceSize)),
+    m_maxFrameSize(kDefaultMaxFrameSize)
+{
+    connect(m_socket, SIGNAL(readyRead()), this, SLOT(_q_readyRead()));
+
+    QByteArray settings;
+    appendSetting(&settings, kSettingMaxConcurrentStreams, kMaxConcurrentStreams);
+    appendSetting(&settings, kSettingInitialWindowSize, kReceiveWindow);
+    sendFrame(Settings, 0, 0, settings);
+    // The connection window is not covered by the setting.
+    sendWindowUpdate(0, kReceiveWindow - kDefaultWindow);
+
+    _q_readyRead();
+}
+
+int MockHttp2Connection::matchPreface(const QByteArray &data)
+{
+    const int size = qMin(data.size(), kPrefaceSize);
+    if (memcmp(data.constData(), kPreface, size) != 0)
+        return -1;
+    return size == kPrefaceSize ? 1 : 0;
+}
+
+void MockHttp2Connection::_q_readyRead()
+{
+    m_buffer += m_socket->readAll();
+    while (readFrame()) {
+    }
+}
+
+bool MockHttp2Connection::readFrame()
+{
+    if (m_buffer.size() < kFrameHeaderSize)
+        return false;
+    const uchar *header = reinterpret_cast<const uchar *>(m_buffer.constData());
+    const int length = (header[0] << 16) | (header[1] << 8) | header[2];
+    if (m_buffer.size() < kFrameHeaderSize + length)
+        return false;
+
+    const int type = header[3];
+    const int flags = header[4];
+    const quint32 stream = qFromBigEndian<quint32>(header + 5) & 0x7fffffff;
+    const QByteArray payload = m_buffer.mid(kFrameHeaderSize, length);
+    m_buffer.remove(0, kFrameHeaderSize + length);
+    handleFrame(type, flags, stream, payload);
+    return true;
+}
+
+void MockHttp2Connection::handleFrame(int type, int flags, quint32 stream,
+                                      const QByteArray &payload)
+{
+    switch (type) {
+    case Data: {
+        QByteArray data = payload;
+        if ((flags & Padded) && !data.isEmpty()) {
+            const int padding = uchar(data.at(0));
+            data = data.mid(1, data.size() - 1 - padding);
+        }
+        if (m_bodies.contains(stream))
+            m_bodies[stream] += data;
+        // Hand back the window the frame used, padding included.
+        if (!payload.isEmpty()) {
+            sendWindowUpdate(0, payload.size());
+            if (!(flags & EndStream))
+                sendWindowUpdate(stream, payload.size());
+        }
+        if (flags & EndStream)
+            requestComplete(stream);
+        break;
+    }
+    case Headers:
+        // Trailers arrive as a second HEADERS frame on an open stream.
+        if (!m_bodies.contains(stream))
+            m_bodies.insert(stream, QByteArray());
+        if (flags & EndStream)
+            requestComplete(stream);
+        break;
+    case RstStream:
+        m_bodies.remove(stream);
+        break;
+    case Settings:
+        if (flags & Ack)
+            break;
+        for (int i = 0; i + 6 <= payload.size(); i += 6) {
+            const uchar *entry = reinterpret_cast<const uchar *>(payload.constData()) + i;
+            if (qFromBigEndian<quint16>(entry) == kSettingMaxFrameSize)
+                m_maxFrameSize = int(qFromBigEndian<quint32>(entry + 2));
+        }
+        sendFrame(Settings, Ack, 0, QByteArray());
+        break;
+    case Ping:
+        if (!(flags & Ack))
+            sendFrame(Ping, Ack, 0, payload);
+        break;
+    case GoAway:
+        m_socket->disconnectFromHost();
+        break;
+    default:
+        // Priorities, window updates and continuations need no answer.
+        break;
+    }
+}
+
+void MockHttp2Connection::requestComplete(quint32 stream)
+{
+    QTimer *timer = new QTimer(this);
+    timer->setSingleShot(true);
+    connect(timer, SIGNAL(timeout()), this, SLOT(_q_reply()));
+    m_replies.insert(timer, stream);
+    timer->start(m_server->nextDelay());
+}
+
+void MockHttp2Connection::_q_reply()
+{
+    QTimer *timer = qobject_cast<QTimer *>(sender());
+    const quint32 stream = m_replies.take(timer);
+    timer->deleteLater();
+    if (!m_bodies.contains(stream))
+        return;
+
+    QByteArray content;
+    const int code = m_server->answer(m_bodies.take(stream), &content);
+
+    // Static table entries 8, 31 and 28: :status, content-type and
+    // content-length.
+    QByteArray block;
+    appendHeader(&block, 8, QByteArray::number(code));
+    appendHeader(&block, 31, "application/json; charset=utf-8");
+    appendHeader(&block, 28, QByteArray::number(content.size()));
+    sendFrame(Headers, EndHeaders | (content.isEmpty() ? EndStream : 0), stream, block);
+
+    for (int offset = 0; offset < content.size(); offset += m_maxFrameSize) {
+        const bool last = offset + m_maxFrameSize >= content.size();
+        sendFrame(Data, last ? EndStream : 0, stream, content.mid(offset, m_maxFrameSize));
+    }
+}
+
+void MockHttp2Connection::sendFrame(int type, int flags, quint32 stream,
+                                    const QByteArray &payload)
+{
+    uchar header[kFrameHeaderSize];
+    header[0] = uchar(payload.size() >> 16);
+    header[1] = uchar(payload.size() >> 8);
+    header[2] = uchar(payload.size());
+    header[3] = uchar(type);
+    header[4] = uchar(flags);
+    qToBigEndian<quint32>(stream, header + 5);
+    m_socket->write(reinterpret_cast<const char *>(header), kFrameHeaderSize);
+    m_socket->write(payload);
+}
+
+void MockHttp2Connection::sendWindowUpdate(quint32 stream, quint32 increment)
+{
+    uchar payload[4];
+    qToBigEndian<quint32>(increment, payload);
+    sendFrame(WindowUpdate, 0, stream, QByteArray(reinterpret_cast<const char *>(payload), 4));
+}
@@ -0,0 +1,55 @@
+#ifndef MOCKHTTP2CONNECTION_H
+#define MOCKHTTP2CONNECTION_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QHash>
+
+class QTcpSocket;
+class QTimer;
+class MockServer;
+
+// An HTTP/2 client connection to MockServer, for clients that open with the
+// connection preface straight away, as over cleartext with prior
+// knowledge. Every stream is one request, answered after the server's
+// delay, and any number of them run at once. Request headers are not
+// decoded; every stream counts as a POST to the recognizer. The receive
+// windows are made large at the start and topped up as request bodies
+// arrive, so uploads are paced by the socket, not by window updates.
+// Replies are not held to the client's window, which the default 64 KiB
+// covers for payload sizes below that.
+class MockHttp2Connection : public QObject
+{
+    Q_OBJECT
+
+public:
+    // |received| is what was read from |socket| so far, preface included.
+    MockHttp2Connection(QTcpSocket *socket, MockServer *server, const QByteArray &received);
+
+    // 1 if |data| starts with the connection preface, 0 if it is a prefix
+    // of it, and -1 if it is something else.
+    static int matchPreface(const QByteArray &data);
+
+private Q_SLOTS:
+    void _q_readyRead();
+    void _q_reply();
+
+private:
+    bool readFrame();
+    void handleFrame(int type, int flags, quint32 stream, const QByteArray &payload);
+    void sendFrame(int type, int flags, quint32 stream, const QByteArray &payload);
+    void sendWindowUpdate(quint32 stream, quint32 increment);
+    void requestComplete(quint32 stream);
+
+    QTcpSocket *m_socket;
+    MockServer *m_server;
+    QByteArray m_buffer;
+    int m_maxFrameSize;
+
+    // Request bodies of open streams, and the timers of those waiting for
+    // their reply.
+    QHash<quint32, QByteArray> m_bodies;
+    QHash<QTimer *, quint32> m_replies;
+};
+
+#endif // MOCKHTTP2CONNECTION_H
@@ -0,0 +1,188 @@
+#include "mockserver.h"
+#include "mockconnection.h"
+
+#include <QTcpSocket>
+
+#include <stdlib.h>
+
+namespace {
+
+const char *const kWords[] = {
+    "turn", "on", "the", "kitchen", "lights", "play", "some", "music",
+    "what", "is", "weather", "like", "today", "set", "a", "timer"
+};
+const int kWordCount = sizeof(kWords) / sizeof(kWords[0]);
+
+QByteArray statusText(int code)
+{
+    switch (code) {
+    case 200: return "OK";
+    case 400: return "Bad Request";
+    case 500: return "Internal Server Error";
+    default: return "Unknown";
+    }
+}
+
+}
+
+MockServer::MockServer(QObject *parent) :
+    QTcpServer(parent),
+    m_latency(0),
+    m_jitter(0),
+    m_errorRate(0.0),
+    m_payloadSize(0),
+    m_handshake(0),
+    m_keepAlive(true),
+    m_requests(0),
+    m_errors(0),
+    m_connections(0)
+{
+    connect(this, SIGNAL(newConnection()), this, SLOT(_q_newConnection()));
+}
+
+int MockServer::latency() const
+{
+    return m_latency;
+}
+
+void MockServer::setLatency(int latency)
+{
+    m_latency = qMax(0, latency);
+}
+
+int MockServer::jitter() const
+{
+    return m_jitter;
+}
+
+void MockServer::setJitter(int jitter)
+{
+    m_jitter = qMax(0, jitter);
+}
+
+qreal MockServer::errorRate() const
+{
+    return m_errorRate;
+}
+
+void MockServer::setErrorRate(qreal errorRate)
+{
+    m_errorRate = qBound(qreal(0.0), errorRate, qreal(1.0));
+}
+
+int MockServer::payloadSize() const
+{
+    return m_payloadSize;
+}
+
+void MockServer::setPayloadSize(int payloadSize)
+{
+    m_payloadSize = qMax(0, payloadSize);
+}
+
+int MockServer::handshake() const
+{
+    return m_handshake;
+}
+
+void MockServer::setHandshake(int handshake)
+{
+    m_handshake = qMax(0, handshake);
+}
+
+bool MockServer::keepAlive() const
+{
+    return m_keepAlive;
+}
+
+void MockServer::setKeepAlive(bool keepAlive)
+{
+    m_keepAlive = keepAlive;
+}
+
+qint64 MockServer::requests() const
+{
+    return m_requests;
+}
+
+qint64 MockServer::errors() const
+{
+    return m_errors;
+}
+
+qint64 MockServer::connections() const
+{
+    return m_connections;
+}
+
+void MockServer::_q_newConnection()
+{
+    while (QTcpSocket *socket = nextPendingConnection()) {
+        ++m_connections;
+        new MockConnection(socket, this);
+    }
+}
+
+qreal MockServer::random()
+{
+    return qrand() / (RAND_MAX + 1.0);
+}
+
+int MockServer::nextDelay()
+{
+    return m_latency + int(random() * (m_jitter + 1));
+}
+
+int MockServer::answer(const QByteArray &body, QByteArray *content)
+{
+    ++m_requests;
+
+    if (random() < m_errorRate) {
+        ++m_errors;
+        content->clear();
+        return 500;
+    }
+    *content = recognitionResult(body);
+    return 200;
+}
+
+QByteArray MockServer::respond(const QByteArray &body, bool keepAlive)
+{
+    QByteArray content;
+    const int code = answer(body, &content);
+
+    QByteArray response;
+    response += "HTTP/1.1 " + QByteArray::number(code) + ' ' + statusText(code) + "\r\n";
+    response += "Content-Type: application/json; charset=utf-8\r\n";
+    response += "Content-Length: " + QByteArray::number(content.size()) + "\r\n";
+    response += keepAlive ? "Connection: keep-alive\r\n" : "Connection: close\r\n";
+    response += "\r\n";
+    response += content;
+    return response;
+}
+
+QByteArray MockServer::recognitionResult(const QByteArray &body)
+{
+    const QByteArray id = "mock-" + QByteArray::number(m_requests);
+    if (body.isEmpty())
+        return "{\"status\":4,\"id\":\"" + id + "\",\"hypotheses\":[]}";
+
+    QByteArray json = "{\"status\":0,\"id\":\"" + id + "\",\"hypotheses\":[";
+    int word = int(body.size() % kWordCount);
+    qreal confidence = 0.95;
+    for (int i = 0; i == 0 || json.size() < m_payloadSize; ++i) {
+        if (i > 0)
+            json += ',';
+        json += "{\"utterance\":\"";
+        for (int w = 0; w < 4; ++w) {
+            if (w > 0)
+                json += ' ';
+            json += kWords[word];
+            word = (word + 1) % kWordCount;
+        }
+        json += "\",\"confidence\":" + QByteArray::number(confidence, 'f', 4) + '}';
+        confidence *= 0.9;
+    }
+    json += "]}";
+    return json;
+}
@@ -0,0 +1,70 @@
+#ifndef MOCKSERVER_H
+#define MOCKSERVER_H
+
+#include <QTcpServer>
+#include <QByteArray>
+
+// Answers POSTs the way the v1 recognize endpoint does, so the networking
+// and parsing path can be exercised without the real service. Each reply
+// is held back by a fixed latency plus a uniformly distributed jitter; a
+// configurable fraction of requests fails with HTTP 500, and successful
+// replies carry as many hypotheses as it takes to reach the payload size.
+// Clients may speak HTTP/1.1 or, with prior knowledge, HTTP/2.
+class MockServer : public QTcpServer
+{
+    Q_OBJECT
+
+public:
+    explicit MockServer(QObject *parent = 0);
+
+    // Milliseconds before each reply is sent.
+    int latency() const;
+    void setLatency(int latency);
+    // Up to this many milliseconds are added to the latency at random.
+    int jitter() const;
+    void setJitter(int jitter);
+    // Fraction of requests, 0 to 1, answered with an HTTP error.
+    qreal errorRate() const;
+    void setErrorRate(qreal errorRate);
+    // Approximate size of a successful JSON body in bytes.
+    int payloadSize() const;
+    void setPayloadSize(int payloadSize);
+    // Milliseconds a new connection waits before its first request is
+    // read, standing in for the DNS, TCP and TLS round trips of a real
+    // endpoint.
+    int handshake() const;
+    void setHandshake(int handshake);
+    // Without keep-alive every reply closes its connection.
+    bool keepAlive() const;
+    void setKeepAlive(bool keepAlive);
+
+    qint64 requests() const;
+    qint64 errors() const;
+    qint64 connections() const;
+
+    // Used by the connections: the status code and JSON body answering a
+    // request, and the same as a complete HTTP/1.1 response.
+    int nextDelay();
+    int answer(const QByteArray &body, QByteArray *content);
+    QByteArray respond(const QByteArray &body, bool keepAlive);
+
+private Q_SLOTS:
+    void _q_newConnection();
+
+private:
+    qreal random();
+    QByteArray recognitionResult(const QByteArray &body);
+
+    int m_latency;
+    int m_jitter;
+    qreal m_errorRate;
+    int m_payloadSize;
+    int m_handshake;
+    bool m_keepAlive;
+
+    qint64 m_requests;
+    qint64 m_errors;
+    qint64 m_connections;
+};
+
+#endif // MOCKSERVER_H
@@ -0,0 +1,13 @@
+# Local stand-in for the recognizer, shared by speechmock and speechload.
+INCLUDEPATH += $$PWD
+DEPENDPATH += $$PWD
+
+SOURCES += \
+    $$PWD/mockserver.cpp \
+    $$PWD/mockconnection.cpp \
+    $$PWD/mockhttp2connection.cpp
+
+HEADERS += \
+    $$PWD/mockserver.h \
+    $$PWD/mockconnection.h \
+    $$PWD/mockhttp2connection.h
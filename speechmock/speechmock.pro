@@ -0,0 +1,11 @@
+TEMPLATE = app
+TARGET = speechmock
+QT += core network
+QT -= gui
+CONFIG += console
+CONFIG -= app_bundle
+
+include(mockserver.pri)
+
+SOURCES += \
+    main.cpp
@@ -1,87 +1,1133 @@
-#include <QNetworkReply>
-#include <QNetworkRequest>
-#include <QSslSocket>
 #include <QUrl>
-#include <QJsonDocument>
-#include <QJsonArray>
-#include <QJsonObject>
+#include <QUrlQuery>
+#include <QBuffer>
+#include <QTimer>
+#include <QThread>
 #include "speechrecognition.h"
 #include <QFile>
-#include "speechrecognition.h"
+#include "audiostream.h"
+#include "recognitionworker.h"
+#include "resultcache.h"
+#include "metrics.h"
+#include "metricsexporter.h"
+#include "audiosegmenter.h"
+#include "flacencoder.h"
+#include "speexencoder.h"
 #include <QDebug>
+#include <algorithm>
 const char* SpeechRecognition::kContentType = "audio/x-flac; rate=8000";
 const char* SpeechRecognition::kUrl = "http://www.google.com/speech-api/v1/recognize?xjerr=1&client=directions&lang=en";
 
+namespace {
+
+// Hedge delay until enough latencies have been seen to learn one.
+const int kInitialHedgeDelay = 1000;
+const int kMinHedgeDelay = 20;
+const int kLatencyWindow = 64;
+const int kMinLatencySamples = 8;
+const int kMaxRetries = 2;
+const int kRetryBackoff = 100;
+const int kMaxBackoff = 10000;
+// Uploads this small are dominated by round trips, not throughput.
+const qint64 kMinThroughputBytes = 16 * 1024;
+const qreal kThroughputSmoothing = 0.3;
+// Typical FLAC rate of 16 kHz speech, and the share of an utterance's
+// duration its upload may take.
+const int kFlacBitrate = 160000;
+const int kUploadShare = 4;
+const int kMinSpeexBitrate = 8000;
+const int kMaxSpeexBitrate = 42200;
+// Unused budget is capped, so a long quiet spell cannot fund a burst.
+const qreal kMaxRetryTokens = 10.0;
+
+// |base| doubled per |attempt|, then drawn uniformly from its upper half so
+// that clients retrying together spread out. |jitter| is the request's own
+// generator state: qrand() is unseeded and shared between threads.
+int Backoff(int base, int attempt, quint32* jitter)
+{
+    const int delay = qMin(kMaxBackoff, base << qMin(attempt, 16));
+    *jitter = *jitter * 1664525u + 1013904223u;
+    return delay / 2 + int((*jitter >> 8) % quint32(delay / 2 + 1));
+}
+
+}
+
 SpeechRecognition::SpeechRecognition(QObject* parent)
-  : QObject(parent)
+  : QObject(parent),
+    worker_(NULL),
+    thread_(NULL),
+    url_(QString::fromLatin1(kUrl)),
+    http2_(false),
+    next_id_(1),
+    max_in_flight_(4),
+    total_wait_ms_(0),
+    max_wait_ms_(0),
+    dispatched_(0),
+    next_attempt_(1),
+    timeout_(30000),
+    hedging_(false),
+    hedge_percentile_(0.95),
+    max_hedges_(1),
+    retry_budget_(0.1),
+    retry_tokens_(kMaxRetryTokens),
+    next_latency_(0),
+    hedges_sent_(0),
+    hedges_won_(0),
+    retries_(0),
+    upload_throughput_(0),
+    cache_(new ResultCache),
+    cache_enabled_(false),
+    exporter_(NULL),
+    metrics_port_(0),
+    segment_length_(10000),
+    language_threshold_(0.9)
+{
+    RecognitionWorker::registerMetaTypes();
+    StartWorker(false);
+}
+
+SpeechRecognition::~SpeechRecognition()
+{
+    StopWorker();
+    // Queued and in-flight requests own their timers and audio.
+    QList<Request*> requests = sent_.values();
+    foreach (Request* request, pending_)
+      requests << request;
+    foreach (Request* request, requests) {
+      delete request->hedge_timer;
+      delete request->deadline_timer;
+      // A streamed request's audio is its stream.
+      delete request->audio;
+    }
+    qDeleteAll(requests);
+    qDeleteAll(recordings_);
+    qDeleteAll(fan_outs_);
+    delete cache_;
+}
+
+void SpeechRecognition::StartWorker(bool threaded)
+{
+    worker_ = new RecognitionWorker;
+    worker_->setHttp2(http2_);
+    if (threaded) {
+        thread_ = new QThread(this);
+        worker_->moveToThread(thread_);
+        connect(thread_, SIGNAL(finished()), worker_, SLOT(deleteLater()));
+        thread_->start();
+    }
+    // Queued when threaded; the arguments are registered metatypes.
+    connect(worker_, &RecognitionWorker::finished,
+            this, &SpeechRecognition::workerFinished);
+}
+
+void SpeechRecognition::StopWorker()
 {
-    network_ = new QNetworkAccessManager(this);
-    connect(network_, SIGNAL(finished(QNetworkReply*)),
-            this, SLOT(replyFinished(QNetworkReply*)));
+    if (thread_) {
+        thread_->quit();
+        thread_->wait();
+        delete thread_;
+        thread_ = NULL;
+    } else {
+        delete worker_;
+    }
+    worker_ = NULL;
 }
 
-void SpeechRecognition::start(){
-    const QUrl url(kUrl);
-    QNetworkRequest req(url);
-    req.setHeader(QNetworkRequest::ContentTypeHeader, kContentType);
-    req.setAttribute(QNetworkRequest::DoNotBufferUploadDataAttribute, false);
-    req.setAttribute(QNetworkRequest::CacheLoadControlAttribute,
-                     QNetworkRequest::AlwaysNetwork);
+void SpeechRecognition::warmUp(){
+    QMetaObject::invokeMethod(worker_, "warmUp", Q_ARG(QUrl, url_));
+}
+
+int SpeechRecognition::start(){
     QFile *compressedFile = new QFile("/home/joseph/.qt-googlevoice/output.flac");
     compressedFile->open(QIODevice::ReadOnly);
-    reply_ = network_->post(req, compressedFile);
+    // Declare the rate the file was actually recorded at.
+    QByteArray content_type = kContentType;
+    int sample_rate;
+    qint64 samples;
+    if (FlacEncoder::readStreamInfo(compressedFile->peek(42), &sample_rate, &samples))
+        content_type = "audio/x-flac; rate=" + QByteArray::number(sample_rate);
+    return submit(compressedFile, content_type);
 }
 
-void SpeechRecognition::replyFinished(QNetworkReply* reply) {
+int SpeechRecognition::start(AudioStream* stream){
+    Request* request = new Request;
+    request->url = url_;
+    request->audio = stream;
+    request->stream = stream;
+    request->content_type = stream->contentType();
+    request->cache_key = 0;
+    return Enqueue(request);
+}
 
-  Result result = Result_ErrorNetwork;
-  Hypotheses hypotheses;
+int SpeechRecognition::submit(QIODevice* audio, const QByteArray& content_type){
+    if (!languages_.isEmpty())
+        return SubmitLanguages(audio, content_type);
+
+    Request* request = new Request;
+    request->url = url_;
+    request->audio = audio;
+    request->stream = NULL;
+    request->content_type = content_type;
+    request->cache_key = 0;
+
+    if (cache_enabled_) {
+        const QByteArray data = audio->readAll();
+        delete audio;
+        request->cache_key = ResultCache::key(data, url_.toEncoded() + '\n' + content_type);
+
+        ResultCache::Entry entry;
+        const bool hit = cache_->lookup(request->cache_key, &entry);
+        Metrics::add(hit ? Metrics::CacheHits : Metrics::CacheMisses);
+        emit cacheStatsChanged();
+        if (hit) {
+            CachedResult cached;
+            cached.id = next_id_++;
+            cached.result = entry.result;
+            cached.hypotheses = entry.hypotheses;
+            delete request;
+            // Report after returning, so the caller knows the ID first.
+            cached_.enqueue(cached);
+            QTimer::singleShot(0, this, SLOT(deliverCached()));
+            return cached.id;
+        }
+
+        QBuffer* buffer = new QBuffer;
+        buffer->setData(data);
+        buffer->open(QIODevice::ReadOnly);
+        request->audio = buffer;
+        request->data = data;
+    }
+    return Enqueue(request);
+}
+
+void SpeechRecognition::deliverCached(){
+    if (cached_.isEmpty())
+        return;
+    const CachedResult cached = cached_.dequeue();
+    LatencyTrace trace;
+    trace.mark(LatencyTrace::ParseDone);
+    Report(cached.id, cached.result, cached.hypotheses, trace);
+}
+
+// Reads |audio| once; every language's request uploads the same bytes,
+// shared rather than copied.
+int SpeechRecognition::SubmitLanguages(QIODevice* audio, const QByteArray& content_type){
+    const QByteArray data = audio->readAll();
+    delete audio;
+
+    FanOut* fan_out = new FanOut;
+    fan_out->id = next_id_++;
+    fan_out->result = Result_ErrorAborted;
+    fan_out->answered = false;
+    fan_out->reported = false;
+    fan_outs_.insert(fan_out->id, fan_out);
+
+    foreach (const QString& language, languages_) {
+        QUrlQuery query(url_);
+        query.removeAllQueryItems(QLatin1String("lang"));
+        query.addQueryItem(QLatin1String("lang"), language);
+        Request* request = new Request;
+        request->url = url_;
+        request->url.setQuery(query);
+        request->audio = NULL;
+        request->stream = NULL;
+        request->content_type = content_type;
+        request->data = data;
+        request->cache_key = 0;
+        // Replies arrive through the event loop, so registering it after
+        // it was sent is soon enough.
+        const int id = Enqueue(request);
+        fan_out->languages.insert(id, language);
+        language_requests_.insert(id, fan_out);
+    }
+    return fan_out->id;
+}
+
+int SpeechRecognition::beginSegments(){
+    Recording* recording = new Recording;
+    recording->id = next_id_++;
+    recording->result = Result_Success;
+    recording->ended = false;
+    recordings_.insert(recording->id, recording);
+    return recording->id;
+}
+
+// Returns 0, leaving |stream| with the caller, if |recording| has ended.
+int SpeechRecognition::addSegment(int recording, AudioStream* stream){
+    Recording* owner = recordings_.value(recording);
+    if (!owner || owner->ended)
+        return 0;
+    const int id = start(stream);
+    AddSegment(owner, id);
+    return id;
+}
+
+int SpeechRecognition::addSegment(int recording, QIODevice* audio,
+                                  const QByteArray& content_type){
+    Recording* owner = recordings_.value(recording);
+    if (!owner || owner->ended)
+        return 0;
+    const int id = submit(audio, content_type);
+    AddSegment(owner, id);
+    return id;
+}
+
+void SpeechRecognition::AddSegment(Recording* recording, int id){
+    recording->segments << id;
+    segments_.insert(id, recording);
+}
+
+void SpeechRecognition::endSegments(int recording){
+    Recording* owner = recordings_.value(recording);
+    if (!owner || owner->ended)
+        return;
+    owner->ended = true;
+    if (owner->segments.isEmpty()) {
+        // Nothing was recorded; report after returning, like a cache hit.
+        recordings_.remove(recording);
+        delete owner;
+        CachedResult cached;
+        cached.id = recording;
+        cached.result = Result_NoSpeech;
+        cached_.enqueue(cached);
+        QTimer::singleShot(0, this, SLOT(deliverCached()));
+        return;
+    }
+    if (owner->done.size() == owner->segments.size())
+        FinishRecording(owner);
+}
+
+int SpeechRecognition::submitSegmented(const QVector<qint16>& pcm, int sample_rate){
+    const int recording = beginSegments();
+    const QByteArray content_type = "audio/x-flac; rate=" + QByteArray::number(sample_rate);
+    AudioSegmenter segmenter(sample_rate, segment_length_);
+    const qint16* samples = pcm.constData();
+    int left = pcm.size();
+    while (left > 0) {
+        int length = segmenter.process(samples, left);
+        if (length < 0)
+            length = left;
+        FlacEncoder encoder(sample_rate);
+        QByteArray flac = encoder.streamHeader();
+        flac += encoder.encode(samples, length);
+        flac += encoder.finish();
+        QBuffer* buffer = new QBuffer;
+        buffer->setData(flac);
+        buffer->open(QIODevice::ReadOnly);
+        addSegment(recording, buffer, content_type);
+        samples += length;
+        left -= length;
+    }
+    endSegments(recording);
+    return recording;
+}
+
+int SpeechRecognition::Enqueue(Request* request){
+    request->id = next_id_++;
+    if (request->audio)
+        request->audio->setParent(this);
+    request->first_attempt = 0;
+    request->hedges = 0;
+    request->retries = 0;
+    request->replayable = false;
+    // Seeded from the clock so separate clients draw different delays.
+    request->jitter = quint32(LatencyTrace::now()) ^ (quint32(request->id) * 2654435761u);
+    request->hedge_timer = NULL;
+    request->deadline_timer = NULL;
+    request->queued.start();
+    pending_.enqueue(request);
+    Dispatch();
+    emit queueChanged();
+    return request->id;
+}
+
+void SpeechRecognition::Dispatch(){
+    while (!pending_.isEmpty() && inFlight() < max_in_flight_)
+        Send(pending_.dequeue());
+}
+
+void SpeechRecognition::Send(Request* request){
+    const qint64 waited = request->queued.elapsed();
+    total_wait_ms_ += waited;
+    max_wait_ms_ = qMax(max_wait_ms_, waited);
+    ++dispatched_;
+    Metrics::add(Metrics::Requests);
+    request->trace.mark(LatencyTrace::RequestPosted);
+    sent_.insert(request->id, request);
+    // Every request sent earns a fraction of a hedge or retry.
+    retry_tokens_ = qMin(kMaxRetryTokens, retry_tokens_ + retry_budget_);
+
+    if (timeout_ > 0)
+        request->deadline_timer = StartTimer(request, timeout_, SLOT(deadlineExpired()));
+
+    if (request->stream) {
+        PostAttempt(request, false);
+        streams_.insert(request->stream, request);
+        connect(request->stream, SIGNAL(readyRead()), this, SLOT(streamReadyRead()));
+        connect(request->stream, SIGNAL(finished()), this, SLOT(streamFinished()));
+        // Whatever was recorded while the request was queued.
+        RelayStream(request);
+        return;
+    }
+
+    if (hedging_) {
+        // Keep the audio so it can be sent again.
+        if (request->data.isEmpty() && request->audio)
+            request->data = request->audio->readAll();
+        delete request->audio;
+        request->audio = NULL;
+        request->replayable = true;
+        PostAttempt(request, false);
+        if (max_hedges_ > 0)
+            request->hedge_timer = StartTimer(request, hedgeDelay(), SLOT(hedgeTimerExpired()));
+        return;
+    }
+
+    PostAttempt(request, false);
+}
+
+// Hands one transfer of |request| to the worker and returns its ID.
+int SpeechRecognition::PostAttempt(Request* request, bool hedge){
+    const int attempt = next_attempt_++;
+    attempts_.insert(attempt, request);
+    attempt_started_.insert(attempt, LatencyTrace::now());
+    request->attempts << attempt;
+    if (!request->first_attempt)
+        request->first_attempt = attempt;
+    if (hedge)
+        request->hedge_attempts << attempt;
+
+    if (request->stream) {
+        QMetaObject::invokeMethod(worker_, "openStream",
+                                  Q_ARG(int, attempt), Q_ARG(QUrl, request->url),
+                                  Q_ARG(QByteArray, request->content_type));
+        return attempt;
+    }
+
+    QIODevice* audio = request->audio;
+    request->audio = NULL;
+    if (!audio) {
+        QBuffer* buffer = new QBuffer;
+        buffer->setData(request->data);
+        buffer->open(QIODevice::ReadOnly);
+        audio = buffer;
+    }
+    // Hand the audio over to the worker's thread for the upload.
+    audio->setParent(NULL);
+    audio->moveToThread(worker_->thread());
+    QMetaObject::invokeMethod(worker_, "post",
+                              Q_ARG(int, attempt), Q_ARG(QUrl, request->url),
+                              Q_ARG(QByteArray, request->content_type),
+                              Q_ARG(QIODevice*, audio));
+    return attempt;
+}
+
+QTimer* SpeechRecognition::StartTimer(Request* request, int msec, const char* slot){
+    QTimer* timer = new QTimer(this);
+    timer->setSingleShot(true);
+    connect(timer, SIGNAL(timeout()), this, slot);
+    timers_.insert(timer, request);
+    timer->start(msec);
+    return timer;
+}
+
+bool SpeechRecognition::SpendRetryToken(){
+    if (retry_tokens_ < 1.0)
+        return false;
+    retry_tokens_ -= 1.0;
+    return true;
+}
+
+void SpeechRecognition::RecordLatency(int msec){
+    if (latencies_.size() < kLatencyWindow) {
+        latencies_.append(msec);
+    } else {
+        latencies_[next_latency_] = msec;
+        next_latency_ = (next_latency_ + 1) % kLatencyWindow;
+    }
+}
+
+// Copies what the recorder has written so far to the worker's side of the
+// upload, so the stream's buffer is only ever touched on this thread.
+void SpeechRecognition::RelayStream(Request* request) {
+  AudioStream* stream = request->stream;
+  const int attempt = request->first_attempt;
+  const qint64 available = stream->bytesAvailable();
+  if (available > 0)
+    QMetaObject::invokeMethod(worker_, "appendStream", Q_ARG(int, attempt),
+                              Q_ARG(QByteArray, stream->read(available)));
+  if (stream->isFinished())
+    QMetaObject::invokeMethod(worker_, "finishStream", Q_ARG(int, attempt));
+}
+
+void SpeechRecognition::streamReadyRead() {
+  Request* request = streams_.value(qobject_cast<AudioStream*>(sender()));
+  if (request)
+    RelayStream(request);
+}
 
-  if (reply->error() != QNetworkReply::NoError) {
-    qDebug() << "ERROR \n" << reply->errorString();
+void SpeechRecognition::streamFinished() {
+  Request* request = streams_.value(qobject_cast<AudioStream*>(sender()));
+  if (request)
+    RelayStream(request);
+}
+
+void SpeechRecognition::workerFinished(int attempt, int result,
+                                       const Hypotheses& hypotheses,
+                                       const LatencyTrace& trace,
+                                       qint64 bytes, qint64 nsecs) {
+  if (bytes >= kMinThroughputBytes && nsecs > 0) {
+    const qreal sample = bytes * 8e9 / nsecs;
+    upload_throughput_ = upload_throughput_ > 0
+        ? upload_throughput_ + kThroughputSmoothing * (sample - upload_throughput_)
+        : sample;
+    emit uploadThroughputChanged();
+  }
+
+  Request* request = attempts_.take(attempt);
+  const qint64 started = attempt_started_.take(attempt);
+  if (!request)
+    return;
+  request->attempts.removeOne(attempt);
+
+  // Hedging may have been turned on since the send, after the audio was
+  // handed over without a copy.
+  if (result == Result_ErrorNetwork && request->replayable) {
+    // Another copy may still answer.
+    if (!request->attempts.isEmpty())
+      return;
+    if (request->retries < kMaxRetries && SpendRetryToken()) {
+      ++request->retries;
+      ++retries_;
+      emit hedgeStatsChanged();
+      if (request->hedge_timer) {
+        timers_.remove(request->hedge_timer);
+        delete request->hedge_timer;
+      }
+      request->hedge_timer = StartTimer(request, Backoff(kRetryBackoff, request->retries - 1,
+                                                           &request->jitter),
+                                        SLOT(hedgeTimerExpired()));
+      return;
+    }
+  }
+
+  if (result == Result_Success)
+    RecordLatency(int((LatencyTrace::now() - started) / 1000000));
+  if (request->hedge_attempts.contains(attempt)) {
+    ++hedges_won_;
+    emit hedgeStatsChanged();
+  }
+  request->trace.merge(trace);
+  Finish(request, static_cast<Result>(result), hypotheses);
+}
+
+// Fires hedgeDelay() after the original was sent, then with growing
+// backoff for further hedges; after a failure it sends the retry.
+void SpeechRecognition::hedgeTimerExpired() {
+  QTimer* timer = qobject_cast<QTimer*>(sender());
+  Request* request = timers_.value(timer);
+  if (!request)
+    return;
+
+  if (request->attempts.isEmpty()) {
+    PostAttempt(request, false);
+  } else if (request->hedges < max_hedges_ && SpendRetryToken()) {
+    ++request->hedges;
+    ++hedges_sent_;
+    PostAttempt(request, true);
+    emit hedgeStatsChanged();
   } else {
-      qDebug() << "Running ParserResponse for \n" << reply << result;
-      ParseResponse(reply, &result, &hypotheses);
+    return;
   }
-  emit Finished(result, hypotheses);
-  reply_->deleteLater();
-  reply_ = NULL;
+
+  if (request->hedges < max_hedges_)
+    timer->start(Backoff(hedgeDelay(), request->hedges, &request->jitter));
 }
 
-void SpeechRecognition::ParseResponse(QIODevice* reply, Result* result,
-                                      Hypotheses* hypotheses)
-{
- QString getReplay ;
- getReplay = reply->readAll();
- qDebug() << "The Replay " << getReplay;
- QJsonDocument jsonDoc = QJsonDocument::fromJson(getReplay.toUtf8());
-  QVariantMap data = jsonDoc.toVariant().toMap();
+void SpeechRecognition::deadlineExpired() {
+  Request* request = timers_.value(qobject_cast<QTimer*>(sender()));
+  if (!request)
+    return;
+  qDebug() << "ERROR \n" << "Recognition timed out after" << timeout_ << "ms";
+  Finish(request, Result_ErrorNetwork, Hypotheses());
+}
+
+// Releases everything |request| holds besides itself, aborting any copies
+// still on the network, then reports it.
+void SpeechRecognition::Finish(Request* request, Result result,
+                               const Hypotheses& hypotheses) {
+  foreach (int attempt, request->attempts) {
+    attempts_.remove(attempt);
+    attempt_started_.remove(attempt);
+    QMetaObject::invokeMethod(worker_, "abort", Q_ARG(int, attempt));
+  }
+  request->attempts.clear();
+  sent_.remove(request->id);
+
+  if (request->hedge_timer) {
+    timers_.remove(request->hedge_timer);
+    delete request->hedge_timer;
+  }
+  if (request->deadline_timer) {
+    timers_.remove(request->deadline_timer);
+    delete request->deadline_timer;
+  }
+
+  if (request->stream) {
+    request->trace.merge(request->stream->trace());
+    streams_.remove(request->stream);
+    request->stream->disconnect(this);
+    request->stream->deleteLater();
+  } else if (request->audio) {
+    request->audio->deleteLater();
+  }
+  Complete(request, result, hypotheses);
+}
+
+void SpeechRecognition::Cancel() {
+  QList<Request*> requests;
+  while (!pending_.isEmpty())
+    requests << pending_.dequeue();
+  QList<int> ids = sent_.keys();
+  qSort(ids);
+  foreach (int id, ids)
+    requests << sent_.value(id);
+
+  foreach (Request* request, requests)
+    Finish(request, Result_ErrorAborted, Hypotheses());
+
+  // Recordings still open would wait for segments that are not coming.
+  ids = recordings_.keys();
+  qSort(ids);
+  foreach (int id, ids) {
+    Recording* recording = recordings_.value(id);
+    recording->ended = true;
+    recording->result = Result_ErrorAborted;
+    if (recording->done.size() == recording->segments.size())
+      FinishRecording(recording);
+  }
+}
+
+void SpeechRecognition::Complete(Request* request, Result result,
+                                 const Hypotheses& hypotheses) {
+  const int id = request->id;
+  const LatencyTrace trace = request->trace;
+  Metrics::addResult(result);
+  const qreal latency = trace.elapsed(LatencyTrace::RequestPosted, LatencyTrace::ParseDone);
+  if (latency >= 0)
+    Metrics::observe(Metrics::RequestLatency, latency / 1000);
+  if (request->cache_key && result == Result_Success) {
+    ResultCache::Entry entry;
+    entry.result = result;
+    entry.hypotheses = hypotheses;
+    cache_->insert(request->cache_key, entry);
+  }
+  delete request;
+
+  // Refill the freed slot before reporting, so a slow Finished() handler
+  // does not hold up the queue.
+  Dispatch();
+  emit queueChanged();
+  if (language_requests_.contains(id)) {
+    CompleteLanguage(id, result, hypotheses, trace);
+    return;
+  }
+  Report(id, result, hypotheses, trace);
+}
 
-  const int status = data.value("status", Result_ErrorNetwork).toInt();
-  *result = static_cast<Result>(status);
+// Hands a finished recognition to the recording it is a segment of, or
+// reports it.
+void SpeechRecognition::Report(int id, Result result, const Hypotheses& hypotheses,
+                               const LatencyTrace& trace) {
+  if (segments_.contains(id)) {
+    CompleteSegment(id, result, hypotheses, trace);
+    return;
+  }
+  foreach (const Hypothesis& hypothesis, hypotheses)
+    setResults(hypothesis.utterance);
+  last_trace_ = trace;
+  emit lastTraceChanged();
+  emit Finished(id, result, hypotheses, trace);
+}
 
-  if (status != Result_Success)
+// Finishes request |id| with Result_ErrorAborted, whether it is still
+// queued or already sent.
+void SpeechRecognition::Abort(int id) {
+  Request* request = sent_.value(id);
+  if (!request) {
+    foreach (Request* queued, pending_) {
+      if (queued->id == id) {
+        request = queued;
+        break;
+      }
+    }
+    pending_.removeOne(request);
+  }
+  if (request)
+    Finish(request, Result_ErrorAborted, Hypotheses());
+}
+
+// Merges one language's answer into its submit(). A language that
+// answered, even without speech, decides the result over one that failed.
+void SpeechRecognition::CompleteLanguage(int id, Result result,
+                                         const Hypotheses& hypotheses,
+                                         const LatencyTrace& trace) {
+  FanOut* fan_out = language_requests_.take(id);
+  const QString language = fan_out->languages.take(id);
+  if (fan_out->reported) {
+    // Aborted after an early result.
+    if (fan_out->languages.isEmpty()) {
+      fan_outs_.remove(fan_out->id);
+      delete fan_out;
+    }
+    return;
+  }
+
+  const bool answered = result == Result_Success || result == Result_NoMatch ||
+                        result == Result_NoSpeech;
+  if (!hypotheses.isEmpty())
+    fan_out->result = Result_Success;
+  else if (fan_out->result != Result_Success && (answered || !fan_out->answered))
+    fan_out->result = result == Result_Success ? Result_NoMatch : result;
+  fan_out->answered = fan_out->answered || answered;
+
+  foreach (Hypothesis hypothesis, hypotheses) {
+    hypothesis.language = language;
+    // Behind those at least as confident, so ties keep arrival order.
+    int i = 0;
+    while (i < fan_out->hypotheses.size() &&
+           fan_out->hypotheses.at(i).confidence >= hypothesis.confidence)
+      ++i;
+    fan_out->hypotheses.insert(i, hypothesis);
+  }
+
+  const bool early = language_threshold_ > 0 && !hypotheses.isEmpty() &&
+                     hypotheses.first().confidence >= language_threshold_;
+  if (!early && !fan_out->languages.isEmpty())
     return;
 
-  QVariantList list = data.value("hypotheses", QVariantList()).toList();
-  foreach (const QVariant& variant, list) {
-    QVariantMap map = variant.toMap();
+  const int fan_out_id = fan_out->id;
+  const Result fan_out_result = fan_out->result;
+  const Hypotheses merged = fan_out->hypotheses;
+  QList<int> running = fan_out->languages.keys();
+  qSort(running);
+  fan_out->reported = true;
+  if (running.isEmpty()) {
+    fan_outs_.remove(fan_out_id);
+    delete fan_out;
+  }
+  // The last of these deletes |fan_out|.
+  foreach (int request, running)
+    Abort(request);
+  Report(fan_out_id, fan_out_result, merged, trace);
+}
+
+// Segments without speech count as empty; any other failure fails the
+// whole recording, though the rest of its text is still reported.
+void SpeechRecognition::CompleteSegment(int id, Result result,
+                                        const Hypotheses& hypotheses,
+                                        const LatencyTrace& trace) {
+  Recording* recording = segments_.take(id);
+  Hypothesis top;
+  top.confidence = 0;
+  if (result == Result_Success && !hypotheses.isEmpty())
+    top = hypotheses.first();
+  else if (result != Result_Success && result != Result_NoMatch &&
+           result != Result_NoSpeech && recording->result == Result_Success)
+    recording->result = result;
+  recording->done.insert(id, top);
+  // The recording's trace runs from its first segment to its last result.
+  if (id == recording->segments.first())
+    recording->trace.merge(trace);
 
-    if (!map.contains("utterance") || !map.contains("confidence"))
+  bool complete;
+  const Hypothesis stitched = Stitch(recording, &complete);
+  if (!stitched.utterance.isEmpty())
+    setResults(stitched.utterance);
+  if (recording->ended && complete)
+    FinishRecording(recording);
+}
+
+// Joins the top hypotheses of the segments done so far, up to the first
+// one still running; confidence is their mean.
+SpeechRecognition::Hypothesis SpeechRecognition::Stitch(const Recording* recording,
+                                                        bool* complete) const {
+  Hypothesis stitched;
+  stitched.confidence = 0;
+  int count = 0;
+  *complete = true;
+  foreach (int id, recording->segments) {
+    if (!recording->done.contains(id)) {
+      *complete = false;
+      break;
+    }
+    const Hypothesis& top = recording->done[id];
+    if (top.utterance.isEmpty())
       continue;
+    if (!stitched.utterance.isEmpty())
+      stitched.utterance += QLatin1Char(' ');
+    stitched.utterance += top.utterance;
+    stitched.confidence += top.confidence;
+    ++count;
+  }
+  if (count)
+    stitched.confidence /= count;
+  return stitched;
+}
 
-    Hypothesis hypothesis;
-    hypothesis.utterance = map.value("utterance", QString()).toString();
-    hypothesis.confidence = map.value("confidence", 0.0).toReal();
-    *hypotheses << hypothesis;
-    qDebug() << "confidence = " << hypothesis.confidence << "\n Your Results = "<< hypothesis.utterance;
-    setResults(hypothesis.utterance);
-//  QFile f;
-////  f.setFileName("fo");
-//  if (f.exists("/home/joseph/.qt-googlevoice/output.flac"))
-//      f.remove("/home/joseph/.qt-googlevoice/output.flac");
-//  }
+void SpeechRecognition::FinishRecording(Recording* recording) {
+  bool complete;
+  const Hypothesis stitched = Stitch(recording, &complete);
+  Hypotheses hypotheses;
+  if (!stitched.utterance.isEmpty())
+    hypotheses << stitched;
+  Result result = recording->result;
+  if (result == Result_Success && hypotheses.isEmpty())
+    result = Result_NoMatch;
+
+  LatencyTrace trace;
+  trace.mark(LatencyTrace::ParseDone);
+  trace.merge(recording->trace);
+  const int id = recording->id;
+  recordings_.remove(id);
+  delete recording;
+
+  last_trace_ = trace;
+  emit lastTraceChanged();
+  emit Finished(id, result, hypotheses, trace);
+}
+
+QUrl SpeechRecognition::url() const
+{
+    return url_;
+}
+
+void SpeechRecognition::setUrl(const QUrl& url)
+{
+    if (url_ == url)
+        return;
+    url_ = url;
+    emit urlChanged();
+}
+
+bool SpeechRecognition::threaded() const
+{
+    return thread_ != NULL;
+}
+
+void SpeechRecognition::setThreaded(bool threaded)
+{
+    if (threaded == (thread_ != NULL))
+        return;
+    if (!sent_.isEmpty()) {
+        qWarning() << "SpeechRecognition: threaded can only change while idle";
+        return;
+    }
+    StopWorker();
+    StartWorker(threaded);
+    emit threadedChanged();
+}
+
+bool SpeechRecognition::http2() const
+{
+    return http2_;
+}
+
+void SpeechRecognition::setHttp2(bool http2)
+{
+    if (http2_ == http2)
+        return;
+    http2_ = http2;
+    QMetaObject::invokeMethod(worker_, "setHttp2", Q_ARG(bool, http2));
+    emit http2Changed();
+}
+
+int SpeechRecognition::maxInFlight() const
+{
+    return max_in_flight_;
+}
+
+void SpeechRecognition::setMaxInFlight(int max_in_flight)
+{
+    max_in_flight = qMax(1, max_in_flight);
+    if (max_in_flight_ == max_in_flight)
+        return;
+    max_in_flight_ = max_in_flight;
+    emit maxInFlightChanged();
+
+    Dispatch();
+    emit queueChanged();
+}
+
+int SpeechRecognition::inFlight() const
+{
+    return sent_.size();
+}
+
+int SpeechRecognition::queueDepth() const
+{
+    return pending_.size();
+}
+
+qreal SpeechRecognition::averageWaitTime() const
+{
+    return dispatched_ ? qreal(total_wait_ms_) / dispatched_ : 0.0;
+}
+
+qint64 SpeechRecognition::maxWaitTime() const
+{
+    return max_wait_ms_;
+}
+
+QVariantMap SpeechRecognition::lastTrace() const
+{
+    return last_trace_.toVariantMap();
+}
+
+int SpeechRecognition::timeout() const
+{
+    return timeout_;
+}
+
+void SpeechRecognition::setTimeout(int timeout)
+{
+    timeout = qMax(0, timeout);
+    if (timeout_ == timeout)
+        return;
+    timeout_ = timeout;
+    emit timeoutChanged();
+}
+
+bool SpeechRecognition::hedging() const
+{
+    return hedging_;
+}
+
+void SpeechRecognition::setHedging(bool hedging)
+{
+    if (hedging_ == hedging)
+        return;
+    hedging_ = hedging;
+    emit hedgingChanged();
+}
+
+qreal SpeechRecognition::hedgePercentile() const
+{
+    return hedge_percentile_;
+}
+
+void SpeechRecognition::setHedgePercentile(qreal percentile)
+{
+    percentile = qBound(qreal(0.5), percentile, qreal(0.999));
+    if (hedge_percentile_ == percentile)
+        return;
+    hedge_percentile_ = percentile;
+    emit hedgingChanged();
+    emit hedgeStatsChanged();
+}
+
+int SpeechRecognition::maxHedges() const
+{
+    return max_hedges_;
+}
+
+void SpeechRecognition::setMaxHedges(int max_hedges)
+{
+    max_hedges = qMax(0, max_hedges);
+    if (max_hedges_ == max_hedges)
+        return;
+    max_hedges_ = max_hedges;
+    emit hedgingChanged();
+}
+
+qreal SpeechRecognition::retryBudget() const
+{
+    return retry_budget_;
+}
+
+void SpeechRecognition::setRetryBudget(qreal budget)
+{
+    budget = qMax(qreal(0.0), budget);
+    if (retry_budget_ == budget)
+        return;
+    retry_budget_ = budget;
+    emit hedgingChanged();
+}
+
+int SpeechRecognition::hedgeDelay() const
+{
+    if (latencies_.size() < kMinLatencySamples)
+        return kInitialHedgeDelay;
+    QVector<int> sorted = latencies_;
+    const int rank = qMin(sorted.size() - 1, int(hedge_percentile_ * sorted.size()));
+    std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+    return qMax(kMinHedgeDelay, sorted.at(rank));
+}
+
+int SpeechRecognition::hedgesSent() const
+{
+    return hedges_sent_;
+}
+
+int SpeechRecognition::hedgesWon() const
+{
+    return hedges_won_;
+}
+
+int SpeechRecognition::retries() const
+{
+    return retries_;
+}
+
+int SpeechRecognition::segmentLength() const
+{
+    return segment_length_;
+}
+
+void SpeechRecognition::setSegmentLength(int segment_length)
+{
+    segment_length = qMax(1000, segment_length);
+    if (segment_length_ == segment_length)
+        return;
+    segment_length_ = segment_length;
+    emit segmentLengthChanged();
+}
+
+QStringList SpeechRecognition::languages() const
+{
+    return languages_;
+}
+
+void SpeechRecognition::setLanguages(const QStringList& languages)
+{
+    if (languages_ == languages)
+        return;
+    languages_ = languages;
+    emit languagesChanged();
+}
+
+qreal SpeechRecognition::languageThreshold() const
+{
+    return language_threshold_;
+}
+
+void SpeechRecognition::setLanguageThreshold(qreal threshold)
+{
+    threshold = qBound(qreal(0.0), threshold, qreal(1.0));
+    if (language_threshold_ == threshold)
+        return;
+    language_threshold_ = threshold;
+    emit languageThresholdChanged();
+}
+
+qreal SpeechRecognition::uploadThroughput() const
+{
+    return upload_throughput_;
+}
+
+QString SpeechRecognition::recommendedCodec() const
+{
+    return recommendedBitrate() > 0 ? QString("audio/speex") : QString("audio/FLAC");
+}
+
+int SpeechRecognition::recommendedBitrate() const
+{
+    if (!SpeexEncoder::isAvailable() || upload_throughput_ <= 0)
+        return 0;
+    const int affordable = int(upload_throughput_ / kUploadShare);
+    if (affordable >= kFlacBitrate)
+        return 0;
+    return qBound(kMinSpeexBitrate, affordable, kMaxSpeexBitrate);
 }
+
+bool SpeechRecognition::cacheEnabled() const
+{
+    return cache_enabled_;
+}
+
+void SpeechRecognition::setCacheEnabled(bool enabled)
+{
+    if (cache_enabled_ == enabled)
+        return;
+    cache_enabled_ = enabled;
+    emit cacheEnabledChanged();
+}
+
+QString SpeechRecognition::cachePath() const
+{
+    return cache_->fileName();
+}
+
+void SpeechRecognition::setCachePath(const QString& path)
+{
+    if (cache_->fileName() == path)
+        return;
+    if (!cache_->setFileName(path))
+        qWarning() << "Cannot open recognition cache" << path;
+    emit cachePathChanged();
+}
+
+qint64 SpeechRecognition::cacheHits() const
+{
+    return cache_->hits();
+}
+
+qint64 SpeechRecognition::cacheDiskHits() const
+{
+    return cache_->diskHits();
+}
+
+qint64 SpeechRecognition::cacheMisses() const
+{
+    return cache_->misses();
+}
+
+int SpeechRecognition::metricsPort() const
+{
+    return metrics_port_;
+}
+
+void SpeechRecognition::setMetricsPort(int port)
+{
+    if (metrics_port_ == port)
+        return;
+    metrics_port_ = port;
+    if (port > 0) {
+        if (!exporter_)
+            exporter_ = new MetricsExporter(this);
+        if (!exporter_->listen(quint16(port)))
+            qWarning() << "Cannot serve metrics on port" << port << exporter_->errorString();
+    } else if (exporter_) {
+        exporter_->close();
+        ReleaseExporter();
+    }
+    emit metricsChanged();
+}
+
+QString SpeechRecognition::metricsFile() const
+{
+    return exporter_ ? exporter_->file() : QString();
+}
+
+void SpeechRecognition::setMetricsFile(const QString& path)
+{
+    if (metricsFile() == path)
+        return;
+    if (!exporter_)
+        exporter_ = new MetricsExporter(this);
+    if (!exporter_->setFile(path))
+        qWarning() << "Cannot write metrics to" << path << exporter_->errorString();
+    ReleaseExporter();
+    emit metricsChanged();
+}
+
+// Drops the exporter once it neither serves nor writes, which turns metric
+// recording off again unless something else still wants it.
+void SpeechRecognition::ReleaseExporter(){
+    if (exporter_ && metrics_port_ <= 0 && exporter_->file().isEmpty()) {
+        delete exporter_;
+        exporter_ = NULL;
+    }
 }
 
   void SpeechRecognition::setResults(const QString &results)
@@ -3,22 +3,70 @@
 
 #include <QObject>
 #include <QList>
+#include <QQueue>
+#include <QHash>
+#include <QStringList>
+#include <QElapsedTimer>
+#include <QUrl>
+#include <QVector>
+#include <QVariantMap>
+
+#include "latencytrace.h"
 
 class QIODevice;
-class QNetworkAccessManager;
-class QNetworkReply;
+class QThread;
+class QTimer;
+class AudioStream;
+class RecognitionWorker;
+class ResultCache;
+class MetricsExporter;
 class SpeechRecognition : public QObject {
   Q_OBJECT
     Q_PROPERTY(QString results READ results NOTIFY resultsChanged)
+    Q_PROPERTY(QUrl url READ url WRITE setUrl NOTIFY urlChanged)
+    Q_PROPERTY(bool threaded READ threaded WRITE setThreaded NOTIFY threadedChanged)
+    Q_PROPERTY(bool http2 READ http2 WRITE setHttp2 NOTIFY http2Changed)
+    Q_PROPERTY(int maxInFlight READ maxInFlight WRITE setMaxInFlight NOTIFY maxInFlightChanged)
+    Q_PROPERTY(int inFlight READ inFlight NOTIFY queueChanged)
+    Q_PROPERTY(int queueDepth READ queueDepth NOTIFY queueChanged)
+    Q_PROPERTY(qreal averageWaitTime READ averageWaitTime NOTIFY queueChanged)
+    Q_PROPERTY(qint64 maxWaitTime READ maxWaitTime NOTIFY queueChanged)
+    Q_PROPERTY(int timeout READ timeout WRITE setTimeout NOTIFY timeoutChanged)
+    Q_PROPERTY(bool hedging READ hedging WRITE setHedging NOTIFY hedgingChanged)
+    Q_PROPERTY(qreal hedgePercentile READ hedgePercentile WRITE setHedgePercentile NOTIFY hedgingChanged)
+    Q_PROPERTY(int maxHedges READ maxHedges WRITE setMaxHedges NOTIFY hedgingChanged)
+    Q_PROPERTY(qreal retryBudget READ retryBudget WRITE setRetryBudget NOTIFY hedgingChanged)
+    Q_PROPERTY(int hedgeDelay READ hedgeDelay NOTIFY hedgeStatsChanged)
+    Q_PROPERTY(int hedgesSent READ hedgesSent NOTIFY hedgeStatsChanged)
+    Q_PROPERTY(int hedgesWon READ hedgesWon NOTIFY hedgeStatsChanged)
+    Q_PROPERTY(int retries READ retries NOTIFY hedgeStatsChanged)
+    Q_PROPERTY(int segmentLength READ segmentLength WRITE setSegmentLength NOTIFY segmentLengthChanged)
+    Q_PROPERTY(QStringList languages READ languages WRITE setLanguages NOTIFY languagesChanged)
+    Q_PROPERTY(qreal languageThreshold READ languageThreshold WRITE setLanguageThreshold NOTIFY languageThresholdChanged)
+    Q_PROPERTY(qreal uploadThroughput READ uploadThroughput NOTIFY uploadThroughputChanged)
+    Q_PROPERTY(QString recommendedCodec READ recommendedCodec NOTIFY uploadThroughputChanged)
+    Q_PROPERTY(int recommendedBitrate READ recommendedBitrate NOTIFY uploadThroughputChanged)
+    Q_PROPERTY(QVariantMap lastTrace READ lastTrace NOTIFY lastTraceChanged)
+    Q_PROPERTY(bool cacheEnabled READ cacheEnabled WRITE setCacheEnabled NOTIFY cacheEnabledChanged)
+    Q_PROPERTY(QString cachePath READ cachePath WRITE setCachePath NOTIFY cachePathChanged)
+    Q_PROPERTY(qint64 cacheHits READ cacheHits NOTIFY cacheStatsChanged)
+    Q_PROPERTY(qint64 cacheDiskHits READ cacheDiskHits NOTIFY cacheStatsChanged)
+    Q_PROPERTY(qint64 cacheMisses READ cacheMisses NOTIFY cacheStatsChanged)
+    Q_PROPERTY(int metricsPort READ metricsPort WRITE setMetricsPort NOTIFY metricsChanged)
+    Q_PROPERTY(QString metricsFile READ metricsFile WRITE setMetricsFile NOTIFY metricsChanged)
 
 public:
   SpeechRecognition( QObject* parent = 0);
+  ~SpeechRecognition();
   static const char* kUrl;
+  // Used for start() when the recording's rate cannot be read.
   static const char* kContentType;
 
   struct Hypothesis {
     QString utterance;
     qreal confidence;
+    // The language it was recognized in; empty unless languages are set.
+    QString language;
   };
   typedef QList<Hypothesis> Hypotheses;
 
@@ -33,27 +81,310 @@ public:
     Result_NoMatch,
     Result_BadGrammar
   };
-  Q_INVOKABLE void start();
-  void Cancel();
+  // Each start()/submit() queues one recognition and returns its ID, which
+  // Finished() carries back. At most maxInFlight requests share the
+  // network at a time; the rest wait in FIFO order.
+  Q_INVOKABLE int start();
+  // Uploads |stream| as soon as a slot is free and keeps sending audio as
+  // the recorder produces it. The recognizer takes ownership of the stream.
+  int start(AudioStream* stream);
+  // Recognizes the whole of |audio|, which the recognizer takes ownership of.
+  // With languages set, it is recognized in each of them; see languages().
+  int submit(QIODevice* audio, const QByteArray& content_type);
+  // Long recordings are recognized as a series of segments, each its own
+  // request, so up to maxInFlight of them run at once. beginSegments()
+  // returns the recording's ID; its segments are added in order, and once
+  // endSegments() is called and every segment is done, one Finished()
+  // carries the recording's ID and the segments' top hypotheses stitched
+  // together in order. Segments do not report Finished() themselves;
+  // results() follows the stitched text as segments complete.
+  int beginSegments();
+  int addSegment(int recording, AudioStream* stream);
+  int addSegment(int recording, QIODevice* audio, const QByteArray& content_type);
+  void endSegments(int recording);
+  // Splits |pcm| at pauses into segments of at most segmentLength()
+  // milliseconds, encodes them to FLAC and recognizes them as above.
+  int submitSegmented(const QVector<qint16>& pcm, int sample_rate);
+  // Drops every queued and in-flight recognition; each one finishes with
+  // Result_ErrorAborted, as does every unfinished segmented recording.
+  Q_INVOKABLE void Cancel();
   QString results()const;
   void setResults(const QString &results);
 
+  // Recognizer endpoint; defaults to kUrl.
+  QUrl url() const;
+  void setUrl(const QUrl& url);
+
+  // Runs the network manager and response parsing on a worker thread
+  // owned by the recognizer; only finished results come back to this
+  // object's thread. Can only be changed while nothing is in flight.
+  bool threaded() const;
+  void setThreaded(bool threaded);
+
+  // Multiplexes submitted and segmented requests on one HTTP/2 connection
+  // to the endpoint instead of spreading them over a pool of HTTP/1.1
+  // keep-alive connections. HTTPS endpoints negotiate it and fall back to
+  // HTTP/1.1; plain HTTP ones must accept HTTP/2 directly. Needs Qt 5.8,
+  // or 5.11 for plain HTTP, and is ignored otherwise. Streamed requests,
+  // from start(AudioStream*), are not affected: each still opens an
+  // HTTP/1.1 connection of its own, because QNetworkAccessManager buffers
+  // an upload of unknown length before sending it.
+  bool http2() const;
+  void setHttp2(bool http2);
+
+  int maxInFlight() const;
+  void setMaxInFlight(int max_in_flight);
+  int inFlight() const;
+  int queueDepth() const;
+  // Milliseconds requests spent queued before being sent.
+  qreal averageWaitTime() const;
+  qint64 maxWaitTime() const;
+
+  // Milliseconds after which an unanswered request fails with
+  // Result_ErrorNetwork; 0 waits forever.
+  int timeout() const;
+  void setTimeout(int timeout);
+
+  // With hedging, a request still unanswered after hedgeDelay() is sent
+  // again and the first reply wins, the others are aborted. The delay is
+  // the hedgePercentile of recent latencies. Network errors are retried
+  // with jittered exponential backoff. Hedges and retries together are
+  // limited to retryBudget times the number of requests sent, so a
+  // struggling backend does not get extra load. Streamed requests cannot
+  // be replayed and are never hedged.
+  bool hedging() const;
+  void setHedging(bool hedging);
+  qreal hedgePercentile() const;
+  void setHedgePercentile(qreal percentile);
+  int maxHedges() const;
+  void setMaxHedges(int max_hedges);
+  qreal retryBudget() const;
+  void setRetryBudget(qreal budget);
+  // Milliseconds before the first hedge of a request sent now.
+  int hedgeDelay() const;
+  int hedgesSent() const;
+  // Hedges whose reply arrived before the original's.
+  int hedgesWon() const;
+  int retries() const;
+
+  // Longest segment submitSegmented() makes, in milliseconds.
+  int segmentLength() const;
+  void setSegmentLength(int segment_length);
+
+  // Language codes submit() recognizes audio in, each sent as the URL's
+  // lang parameter. Every language is its own request, counted against
+  // maxInFlight, and all of them upload the same buffer. One Finished()
+  // carries the submit() ID and every language's hypotheses merged by
+  // confidence, each tagged with its language. As soon as one language's
+  // top hypothesis reaches languageThreshold the result is reported and
+  // the other languages are aborted; 0 always waits for all of them.
+  // Empty, the default, recognizes in the URL's own language. These
+  // requests bypass the cache, and streamed ones only use the URL's own
+  // language.
+  QStringList languages() const;
+  void setLanguages(const QStringList& languages);
+  qreal languageThreshold() const;
+  void setLanguageThreshold(qreal threshold);
+
+  // Smoothed upload throughput of recent requests in bits per second, or 0
+  // before the first large enough upload.
+  qreal uploadThroughput() const;
+  // The Recorder codec and Speex bitrate that keep uploading an utterance
+  // to a fraction of its duration at the measured throughput: FLAC while
+  // the link has room for it or nothing is known yet, else Speex at a
+  // bitrate the link can carry. The bitrate is 0 for FLAC.
+  QString recommendedCodec() const;
+  int recommendedBitrate() const;
+
+  // With the cache enabled, submit() hashes the audio together with the URL
+  // and content type and answers repeats without going to the network.
+  // Streamed requests are never cached.
+  bool cacheEnabled() const;
+  void setCacheEnabled(bool enabled);
+  // Optional file backing the cache across restarts; empty keeps it in
+  // memory only.
+  QString cachePath() const;
+  void setCachePath(const QString& path);
+  qint64 cacheHits() const;
+  qint64 cacheDiskHits() const;
+  qint64 cacheMisses() const;
+
+  // Publishes the process-wide Metrics in Prometheus text format, on
+  // http://127.0.0.1:<metricsPort>/metrics and/or rewritten every 15
+  // seconds to metricsFile. Setting either starts recording metrics for
+  // the whole process; 0 and empty, the defaults, publish nothing.
+  int metricsPort() const;
+  void setMetricsPort(int port);
+  QString metricsFile() const;
+  void setMetricsFile(const QString& path);
+
+  // Stage timings of the most recently finished recognition, in
+  // milliseconds; see LatencyTrace::toVariantMap().
+  QVariantMap lastTrace() const;
+
+public slots:
+  // Connects to the endpoint ahead of the next request, doing DNS, TCP and
+  // for HTTPS the TLS handshake while the user is still speaking; connect
+  // it to Recorder::recording(). The connection is kept for the requests
+  // that follow, and TLS sessions are resumed across connections.
+  void warmUp();
+
 signals:
-  void Finished(Result result, const Hypotheses& hypotheses);
+  void Finished(int id, Result result, const Hypotheses& hypotheses,
+                const LatencyTrace& trace);
   void resultsChanged();
+  void urlChanged();
+  void threadedChanged();
+  void http2Changed();
+  void maxInFlightChanged();
+  void queueChanged();
+  void timeoutChanged();
+  void hedgingChanged();
+  void hedgeStatsChanged();
+  void segmentLengthChanged();
+  void languagesChanged();
+  void languageThresholdChanged();
+  void uploadThroughputChanged();
+  void cacheEnabledChanged();
+  void cachePathChanged();
+  void cacheStatsChanged();
+  void metricsChanged();
+  void lastTraceChanged();
 
 private slots:
-  void replyFinished(QNetworkReply* reply);
+  void workerFinished(int id, int result, const Hypotheses& hypotheses,
+                      const LatencyTrace& trace, qint64 bytes, qint64 nsecs);
+  void streamReadyRead();
+  void streamFinished();
+  void hedgeTimerExpired();
+  void deadlineExpired();
+  void deliverCached();
 
 private:
-  void ParseResponse(QIODevice* reply, Result* result, Hypotheses* hypotheses);
+  struct Request {
+    int id;
+    QUrl url;
+    QIODevice* audio;
+    AudioStream* stream;
+    QByteArray content_type;
+    // The whole upload, kept for hedges and retries.
+    QByteArray data;
+    QElapsedTimer queued;
+    quint64 cache_key;
+    LatencyTrace trace;
+    // IDs of the transfers handed to the worker that are still running.
+    QList<int> attempts;
+    QList<int> hedge_attempts;
+    int first_attempt;
+    int hedges;
+    int retries;
+    // Whether |data| holds the whole upload, decided when it was sent.
+    bool replayable;
+    // Backoff jitter state.
+    quint32 jitter;
+    QTimer* hedge_timer;
+    QTimer* deadline_timer;
+  };
+  struct CachedResult {
+    int id;
+    Result result;
+    Hypotheses hypotheses;
+  };
+  struct Recording {
+    int id;
+    // Segment request IDs in recording order, and the top hypothesis of
+    // each one done so far.
+    QList<int> segments;
+    QHash<int, Hypothesis> done;
+    Result result;
+    bool ended;
+    LatencyTrace trace;
+  };
+  struct FanOut {
+    int id;
+    // Languages still running, by request ID.
+    QHash<int, QString> languages;
+    Hypotheses hypotheses;
+    Result result;
+    // Whether any language got an answer, even without speech in it.
+    bool answered;
+    bool reported;
+  };
+
+  int SubmitLanguages(QIODevice* audio, const QByteArray& content_type);
+  int Enqueue(Request* request);
+  void Dispatch();
+  void Send(Request* request);
+  void RelayStream(Request* request);
+  int PostAttempt(Request* request, bool hedge);
+  QTimer* StartTimer(Request* request, int msec, const char* slot);
+  bool SpendRetryToken();
+  void RecordLatency(int msec);
+  void ReleaseExporter();
+  void Finish(Request* request, Result result, const Hypotheses& hypotheses);
+  void Complete(Request* request, Result result, const Hypotheses& hypotheses);
+  void Report(int id, Result result, const Hypotheses& hypotheses,
+              const LatencyTrace& trace);
+  void Abort(int id);
+  void CompleteLanguage(int id, Result result, const Hypotheses& hypotheses,
+                        const LatencyTrace& trace);
+  void AddSegment(Recording* recording, int id);
+  void CompleteSegment(int id, Result result, const Hypotheses& hypotheses,
+                       const LatencyTrace& trace);
+  Hypothesis Stitch(const Recording* recording, bool* complete) const;
+  void FinishRecording(Recording* recording);
+  void StartWorker(bool threaded);
+  void StopWorker();
 
 private:
-  QNetworkAccessManager* network_;
-  QNetworkReply* reply_;
+  RecognitionWorker* worker_;
+  QThread* thread_;
+  QUrl url_;
+  QQueue<Request*> pending_;
+  QHash<int, Request*> sent_;
+  QHash<int, Request*> attempts_;
+  QHash<int, qint64> attempt_started_;
+  QHash<AudioStream*, Request*> streams_;
+  QHash<QTimer*, Request*> timers_;
+  bool http2_;
+  int next_id_;
+  int max_in_flight_;
+  qint64 total_wait_ms_;
+  qint64 max_wait_ms_;
+  int dispatched_;
+  int next_attempt_;
+  int timeout_;
+  bool hedging_;
+  qreal hedge_percentile_;
+  int max_hedges_;
+  qreal retry_budget_;
+  qreal retry_tokens_;
+  QVector<int> latencies_;
+  int next_latency_;
+  int hedges_sent_;
+  int hedges_won_;
+  int retries_;
+  qreal upload_throughput_;
+  ResultCache* cache_;
+  bool cache_enabled_;
+  QQueue<CachedResult> cached_;
+  MetricsExporter* exporter_;
+  int metrics_port_;
+  QHash<int, Recording*> recordings_;
+  // Segment request ID to the recording it belongs to.
+  QHash<int, Recording*> segments_;
+  int segment_length_;
+  QStringList languages_;
+  qreal language_threshold_;
+  QHash<int, FanOut*> fan_outs_;
+  // Language request ID to the submit() it was fanned out from.
+  QHash<int, FanOut*> language_requests_;
+  LatencyTrace last_trace_;
   QByteArray buffered_raw_data_;
   int num_samples_recorded_;
     QString m_results;
 };
 
+Q_DECLARE_METATYPE(SpeechRecognition::Hypotheses)
+
 #endif // SPEECHRECOGNITION_H
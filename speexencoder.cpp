@@ -0,0 +1,137 @@
+#include "speexencoder.h"
+
+#include <string.h>
+
+#ifdef HAVE_SPEEX
+#include <speex/speex.h>
+#endif
+
+SpeexEncoder::SpeexEncoder(int sampleRate, int bitrate) :
+    m_sampleRate(sampleRate),
+    m_bitrate(0),
+    m_frameSize(0),
+    m_state(0),
+    m_bits(0),
+    m_pendingCount(0)
+{
+#ifdef HAVE_SPEEX
+    int mode = SPEEX_MODEID_NB;
+    if (sampleRate >= 32000)
+        mode = SPEEX_MODEID_UWB;
+    else if (sampleRate >= 16000)
+        mode = SPEEX_MODEID_WB;
+    m_state = speex_encoder_init(speex_lib_get_mode(mode));
+
+    spx_int32_t rate = sampleRate;
+    speex_encoder_ctl(m_state, SPEEX_SET_SAMPLING_RATE, &rate);
+    spx_int32_t target = bitrate;
+    speex_encoder_ctl(m_state, SPEEX_SET_BITRATE, &target);
+    // Cheap enough to run on the recording thread on low-end devices.
+    spx_int32_t complexity = 4;
+    speex_encoder_ctl(m_state, SPEEX_SET_COMPLEXITY, &complexity);
+    spx_int32_t actual = 0;
+    speex_encoder_ctl(m_state, SPEEX_GET_BITRATE, &actual);
+    m_bitrate = actual;
+    spx_int32_t frameSize = 0;
+    speex_encoder_ctl(m_state, SPEEX_GET_FRAME_SIZE, &frameSize);
+    m_frameSize = frameSize;
+
+    SpeexBits *bits = new SpeexBits;
+    speex_bits_init(bits);
+    m_bits = bits;
+
+    m_pending.resize(m_frameSize);
+#else
+    Q_UNUSED(bitrate);
+#endif
+}
+
+SpeexEncoder::~SpeexEncoder()
+{
+#ifdef HAVE_SPEEX
+    SpeexBits *bits = static_cast<SpeexBits *>(m_bits);
+    speex_bits_destroy(bits);
+    delete bits;
+    speex_encoder_destroy(m_state);
+#endif
+}
+
+bool SpeexEncoder::isAvailable()
+{
+#ifdef HAVE_SPEEX
+    return true;
+#else
+    return false;
+#endif
+}
+
+QByteArray SpeexEncoder::contentType(int sampleRate)
+{
+    return "audio/x-speex-with-header-byte; rate=" + QByteArray::number(sampleRate);
+}
+
+int SpeexEncoder::sampleRate() const
+{
+    return m_sampleRate;
+}
+
+int SpeexEncoder::bitrate() const
+{
+    return m_bitrate;
+}
+
+int SpeexEncoder::frameSize() const
+{
+    return m_frameSize;
+}
+
+QByteArray SpeexEncoder::encode(const qint16 *samples, int count)
+{
+    QByteArray out;
+    if (!m_state)
+        return out;
+
+    while (count > 0) {
+        const int n = qMin(count, m_frameSize - m_pendingCount);
+        memcpy(m_pending.data() + m_pendingCount, samples, n * sizeof(qint16));
+        m_pendingCount += n;
+        samples += n;
+        count -= n;
+
+        if (m_pendingCount == m_frameSize) {
+            encodeFrame(&out);
+            m_pendingCount = 0;
+        }
+    }
+    return out;
+}
+
+QByteArray SpeexEncoder::finish()
+{
+    QByteArray out;
+    if (!m_state || m_pendingCount == 0)
+        return out;
+
+    memset(m_pending.data() + m_pendingCount, 0,
+           (m_frameSize - m_pendingCount) * sizeof(qint16));
+    encodeFrame(&out);
+    m_pendingCount = 0;
+    return out;
+}
+
+void SpeexEncoder::encodeFrame(QByteArray *out)
+{
+#ifdef HAVE_SPEEX
+    SpeexBits *bits = static_cast<SpeexBits *>(m_bits);
+    speex_bits_reset(bits);
+    speex_encode_int(m_state, m_pending.data(), bits);
+
+    // Even the largest ultra-wideband frame fits the one-byte length prefix.
+    char frame[255];
+    const int size = speex_bits_write(bits, frame, sizeof(frame));
+    out->append(char(size));
+    out->append(frame, size);
+#else
+    Q_UNUSED(out);
+#endif
+}
@@ -0,0 +1,49 @@
+#ifndef SPEEXENCODER_H
+#define SPEEXENCODER_H
+
+#include <QByteArray>
+#include <QVector>
+
+// In-process Speex encoder for 16-bit mono PCM, producing the recognizer's
+// "audio/x-speex-with-header-byte" format: every frame is preceded by one
+// byte holding its length. Narrowband, wideband or ultra-wideband is chosen
+// from the sample rate. Only functional when built with libspeex
+// (HAVE_SPEEX); otherwise isAvailable() is false and nothing is produced.
+class SpeexEncoder
+{
+public:
+    // |bitrate| in bits per second; the encoder uses the closest mode at or
+    // below it.
+    SpeexEncoder(int sampleRate, int bitrate);
+    ~SpeexEncoder();
+
+    static bool isAvailable();
+    // Content type for uploading this encoder's output at |sampleRate|.
+    static QByteArray contentType(int sampleRate);
+
+    int sampleRate() const;
+    int bitrate() const;
+    int frameSize() const;
+
+    // Consumes |count| samples and returns every frame completed by them.
+    QByteArray encode(const qint16 *samples, int count);
+
+    // Pads the remaining samples with silence into a final frame.
+    QByteArray finish();
+
+private:
+    Q_DISABLE_COPY(SpeexEncoder)
+
+    void encodeFrame(QByteArray *out);
+
+    int m_sampleRate;
+    int m_bitrate;
+    int m_frameSize;
+    void *m_state;
+    void *m_bits;
+
+    QVector<qint16> m_pending;
+    int m_pendingCount;
+};
+
+#endif // SPEEXENCODER_H
@@ -0,0 +1,315 @@
+#include "streamingupload.h"
+#include "audiostream.h"
+
+#include <QSslSocket>
+#include <QList>
+#include <QDebug>
+
+StreamingUpload::StreamingUpload(const QUrl &url, AudioStream *stream, QObject *parent) :
+    QObject(parent),
+    m_url(url),
+    m_stream(stream),
+    m_socket(new QSslSocket(this)),
+    m_connected(false),
+    m_uploadDone(false),
+    m_bodySent(false),
+    m_done(false),
+    m_headerLength(-1),
+    m_statusCode(0),
+    m_contentLength(-1),
+    m_chunked(false)
+{
+    attachSocket();
+
+    connect(m_stream, SIGNAL(readyRead()), this, SLOT(_q_streamReadyRead()));
+    connect(m_stream, SIGNAL(finished()), this, SLOT(_q_streamFinished()));
+}
+
+StreamingUpload::~StreamingUpload()
+{
+}
+
+void StreamingUpload::attachSocket()
+{
+    connect(m_socket, SIGNAL(readyRead()), this, SLOT(_q_socketReadyRead()));
+    connect(m_socket, SIGNAL(bytesWritten(qint64)), this, SLOT(_q_bytesWritten()));
+    connect(m_socket, SIGNAL(disconnected()), this, SLOT(_q_socketDisconnected()));
+    connect(m_socket, SIGNAL(error(QAbstractSocket::SocketError)),
+            this, SLOT(_q_socketError(QAbstractSocket::SocketError)));
+}
+
+QSslSocket *StreamingUpload::connectTo(const QUrl &url, const QSslConfiguration &configuration,
+                                       QObject *parent)
+{
+    QSslSocket *socket = new QSslSocket(parent);
+    if (url.scheme() == "https") {
+        socket->setSslConfiguration(configuration);
+        socket->connectToHostEncrypted(url.host(), quint16(url.port(443)));
+    } else {
+        socket->connectToHost(url.host(), quint16(url.port(80)));
+    }
+    return socket;
+}
+
+void StreamingUpload::setSslConfiguration(const QSslConfiguration &configuration)
+{
+    m_socket->setSslConfiguration(configuration);
+}
+
+void StreamingUpload::setSocket(QSslSocket *socket)
+{
+    delete m_socket;
+    m_socket = socket;
+    m_socket->setParent(this);
+    attachSocket();
+}
+
+QSslConfiguration StreamingUpload::sslConfiguration() const
+{
+    return m_socket->sslConfiguration();
+}
+
+bool StreamingUpload::isEncrypted() const
+{
+    return m_socket->isEncrypted();
+}
+
+void StreamingUpload::start()
+{
+    const bool encrypted = m_url.scheme() == "https";
+    if (encrypted)
+        connect(m_socket, SIGNAL(encrypted()), this, SLOT(_q_connected()));
+    else
+        connect(m_socket, SIGNAL(connected()), this, SLOT(_q_connected()));
+
+    // An adopted socket may be ready, or still on its way.
+    if (m_socket->state() == QAbstractSocket::ConnectedState
+            && (!encrypted || m_socket->isEncrypted())) {
+        _q_connected();
+        return;
+    }
+    if (m_socket->state() != QAbstractSocket::UnconnectedState)
+        return;
+
+    if (encrypted)
+        m_socket->connectToHostEncrypted(m_url.host(), m_url.port(443));
+    else
+        m_socket->connectToHost(m_url.host(), m_url.port(80));
+}
+
+void StreamingUpload::abort()
+{
+    if (m_done)
+        return;
+
+    m_socket->abort();
+    complete("Operation canceled");
+}
+
+bool StreamingUpload::hasError() const
+{
+    return !m_errorString.isEmpty();
+}
+
+QString StreamingUpload::errorString() const
+{
+    return m_errorString;
+}
+
+int StreamingUpload::statusCode() const
+{
+    return m_statusCode;
+}
+
+qint64 StreamingUpload::bytesPending() const
+{
+    const qint64 unread = m_stream.isNull() ? 0 : m_stream->bytesAvailable();
+    return unread + m_socket->bytesToWrite();
+}
+
+QByteArray StreamingUpload::body() const
+{
+    return m_body;
+}
+
+void StreamingUpload::_q_connected()
+{
+    if (m_connected)
+        return;
+
+    QByteArray path = m_url.path(QUrl::FullyEncoded).toLatin1();
+    if (path.isEmpty())
+        path = "/";
+    if (m_url.hasQuery())
+        path += '?' + m_url.query(QUrl::FullyEncoded).toLatin1();
+
+    QByteArray header;
+    header += "POST " + path + " HTTP/1.1\r\n";
+    header += "Host: " + m_url.host().toLatin1();
+    const int defaultPort = m_url.scheme() == "https" ? 443 : 80;
+    if (m_url.port() != -1 && m_url.port() != defaultPort)
+        header += ':' + QByteArray::number(m_url.port());
+    header += "\r\n";
+    header += "Content-Type: " + m_stream->contentType() + "\r\n";
+    header += "Transfer-Encoding: chunked\r\n";
+    header += "Connection: close\r\n";
+    header += "\r\n";
+    m_socket->write(header);
+
+    m_connected = true;
+    sendChunks();
+}
+
+void StreamingUpload::_q_streamReadyRead()
+{
+    sendChunks();
+}
+
+void StreamingUpload::_q_streamFinished()
+{
+    sendChunks();
+}
+
+void StreamingUpload::sendChunks()
+{
+    if (!m_connected || m_uploadDone || m_stream.isNull())
+        return;
+
+    const qint64 available = m_stream->bytesAvailable();
+    if (available > 0) {
+        const QByteArray data = m_stream->read(available);
+        m_socket->write(QByteArray::number(data.size(), 16) + "\r\n");
+        m_socket->write(data);
+        m_socket->write("\r\n");
+    }
+
+    if (m_stream->isFinished()) {
+        m_socket->write("0\r\n\r\n");
+        m_uploadDone = true;
+    }
+}
+
+void StreamingUpload::_q_bytesWritten()
+{
+    if (!m_uploadDone || m_bodySent || m_socket->bytesToWrite() > 0)
+        return;
+
+    m_bodySent = true;
+    emit bodySent();
+}
+
+void StreamingUpload::_q_socketReadyRead()
+{
+    if (m_response.isEmpty())
+        emit responseStarted();
+    m_response += m_socket->readAll();
+    if (parseResponse(false))
+        complete(QString());
+}
+
+void StreamingUpload::_q_socketDisconnected()
+{
+    if (m_done)
+        return;
+
+    if (parseResponse(true))
+        complete(QString());
+    else
+        complete("Connection closed before a complete response was received");
+}
+
+void StreamingUpload::_q_socketError(QAbstractSocket::SocketError error)
+{
+    // The server closing the connection after the body is how a
+    // "Connection: close" response normally ends.
+    if (error == QAbstractSocket::RemoteHostClosedError)
+        return;
+
+    if (!m_done)
+        complete(m_socket->errorString());
+}
+
+// Returns true once a complete response has been received.
+bool StreamingUpload::parseResponse(bool eof)
+{
+    if (m_headerLength < 0) {
+        const int end = m_response.indexOf("\r\n\r\n");
+        if (end < 0)
+            return false;
+
+        m_headerLength = end + 4;
+        const QList<QByteArray> lines = m_response.left(end).split('\n');
+        const QList<QByteArray> statusLine = lines.value(0).trimmed().split(' ');
+        m_statusCode = statusLine.value(1).toInt();
+
+        for (int i = 1; i < lines.size(); ++i) {
+            const QByteArray line = lines.at(i).trimmed();
+            const int colon = line.indexOf(':');
+            if (colon < 0)
+                continue;
+            const QByteArray name = line.left(colon).trimmed().toLower();
+            const QByteArray value = line.mid(colon + 1).trimmed();
+            if (name == "content-length")
+                m_contentLength = value.toLongLong();
+            else if (name == "transfer-encoding" && value.toLower().contains("chunked"))
+                m_chunked = true;
+        }
+    }
+
+    const int bodyLength = m_response.size() - m_headerLength;
+
+    if (m_chunked) {
+        QByteArray body;
+        int pos = m_headerLength;
+        forever {
+            const int lineEnd = m_response.indexOf("\r\n", pos);
+            if (lineEnd < 0)
+                return false;
+            bool ok = false;
+            const int size = m_response.mid(pos, lineEnd - pos).split(';').value(0).trimmed().toInt(&ok, 16);
+            if (!ok)
+                return eof;
+            if (size == 0) {
+                m_body = body;
+                return true;
+            }
+            pos = lineEnd + 2;
+            if (m_response.size() < pos + size + 2)
+                return false;
+            body += m_response.mid(pos, size);
+            pos += size + 2;
+        }
+    }
+
+    if (m_contentLength >= 0) {
+        if (bodyLength < m_contentLength)
+            return false;
+        m_body = m_response.mid(m_headerLength, int(m_contentLength));
+        return true;
+    }
+
+    if (eof) {
+        m_body = m_response.mid(m_headerLength);
+        return true;
+    }
+
+    return false;
+}
+
+void StreamingUpload::complete(const QString &errorString)
+{
+    if (m_done)
+        return;
+
+    m_done = true;
+    m_errorString = errorString;
+    if (m_errorString.isEmpty() && (m_statusCode < 200 || m_statusCode >= 300))
+        m_errorString = QString("HTTP status %1").arg(m_statusCode);
+
+    if (!m_stream.isNull())
+        m_stream->disconnect(this);
+    m_socket->disconnect(this);
+    m_socket->abort();
+
+    emit finished();
+}
@@ -0,0 +1,96 @@
+#ifndef STREAMINGUPLOAD_H
+#define STREAMINGUPLOAD_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QPointer>
+#include <QUrl>
+#include <QAbstractSocket>
+#include <QSslConfiguration>
+
+class QSslSocket;
+class AudioStream;
+
+// POSTs an AudioStream with "Transfer-Encoding: chunked" while it is still
+// being written. QNetworkAccessManager buffers any sequential upload whose
+// length is unknown, so this talks HTTP/1.1 on the socket directly: every
+// readyRead on the stream becomes one chunk on the wire and finish() sends
+// the terminating chunk.
+class StreamingUpload : public QObject
+{
+    Q_OBJECT
+
+public:
+    StreamingUpload(const QUrl &url, AudioStream *stream, QObject *parent = 0);
+    ~StreamingUpload();
+
+    // Used for HTTPS; set before start(). A session ticket in it lets the
+    // handshake resume an earlier session.
+    void setSslConfiguration(const QSslConfiguration &configuration);
+    // Sends over |socket|, already connecting or connected to the URL's
+    // host, instead of opening a connection of its own; see connectTo().
+    // Takes ownership. Set before start().
+    void setSocket(QSslSocket *socket);
+
+    // Opens a socket to |url|'s host, encrypted for HTTPS, for a later
+    // upload to adopt with setSocket().
+    static QSslSocket *connectTo(const QUrl &url, const QSslConfiguration &configuration,
+                                 QObject *parent = 0);
+    // After an HTTPS connection, what was negotiated, including the
+    // session ticket the server issued.
+    QSslConfiguration sslConfiguration() const;
+    bool isEncrypted() const;
+
+    void start();
+    void abort();
+
+    bool hasError() const;
+    QString errorString() const;
+
+    int statusCode() const;
+
+    // Bytes of the stream not yet written to the network.
+    qint64 bytesPending() const;
+    QByteArray body() const;
+
+Q_SIGNALS:
+    // The terminating chunk has been handed to the operating system.
+    void bodySent();
+    void responseStarted();
+    void finished();
+
+private Q_SLOTS:
+    void _q_connected();
+    void _q_streamReadyRead();
+    void _q_streamFinished();
+    void _q_bytesWritten();
+    void _q_socketReadyRead();
+    void _q_socketDisconnected();
+    void _q_socketError(QAbstractSocket::SocketError error);
+
+private:
+    void attachSocket();
+    void sendChunks();
+    bool parseResponse(bool eof);
+    void complete(const QString &errorString);
+
+    QUrl m_url;
+    QPointer<AudioStream> m_stream;
+    QSslSocket *m_socket;
+
+    bool m_connected;
+    bool m_uploadDone;
+    bool m_bodySent;
+    bool m_done;
+
+    QByteArray m_response;
+    int m_headerLength;
+    int m_statusCode;
+    qint64 m_contentLength;
+    bool m_chunked;
+    QByteArray m_body;
+
+    QString m_errorString;
+};
+
+#endif // STREAMINGUPLOAD_H
@@ -0,0 +1,232 @@
+#include <QtTest>
+#include <QByteArray>
+#include <QVector>
+
+#include "benchmarkdata.h"
+#include "dspkernels.h"
+#include "featureextractor.h"
+#include "fft.h"
+#include "flacencoder.h"
+#include "noisesuppressor.h"
+#include "resampler.h"
+#include "responseparser.h"
+#include "speexencoder.h"
+#include "voiceactivitydetector.h"
+
+namespace {
+
+const int kSampleRate = 16000;
+
+// Counts frames, so the extractor has a consumer to compute them for.
+class FrameCounter : public FeatureConsumer
+{
+public:
+    FrameCounter() : frames(0) {}
+
+    bool consumeFrame(const FeatureFrame &)
+    {
+        ++frames;
+        return false;
+    }
+
+    int frames;
+};
+
+}
+
+// The encode, parse and DSP paths of speechbench as QBENCHMARK cases, for
+// runs under QTestLib's own options: -callgrind, -perf or -tickcounter for
+// instruction or cycle counts, -iterations and -minimumvalue for wall time.
+// Every case also checks its output, so a broken path fails rather than
+// getting faster. The audio is one second long, so per-iteration figures
+// are the cost of one second of speech.
+class tst_SpeechBench : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+
+    void encodeFlac();
+    void encodeSpeex();
+
+    void parseRealistic();
+    void parseWorstCase();
+    void parseWorstCaseSegmented();
+
+    void dspToBigEndian();
+    void dspToInt16();
+    void dspFftForward();
+    void dspResample();
+    void dspVoiceActivity();
+    void dspNoiseSuppression();
+    void dspMfcc();
+
+private:
+    QByteArray m_realisticResponse;
+    QByteArray m_worstCaseResponse;
+    QVector<qint16> m_speech;
+    QVector<qint16> m_capture48k;
+};
+
+void tst_SpeechBench::initTestCase()
+{
+    m_realisticResponse = makeRealisticResponse();
+    m_worstCaseResponse = makeWorstCaseResponse();
+    m_speech = makeSpeech(kSampleRate);
+    m_capture48k = makeSpeech(3 * kSampleRate);
+}
+
+void tst_SpeechBench::encodeFlac()
+{
+    QByteArray out;
+    QBENCHMARK {
+        FlacEncoder encoder(kSampleRate);
+        out = encoder.streamHeader();
+        out += encoder.encode(m_speech.constData(), m_speech.size());
+        out += encoder.finish();
+    }
+    QVERIFY(out.startsWith("fLaC"));
+    QVERIFY(out.size() < m_speech.size() * 2);
+}
+
+void tst_SpeechBench::encodeSpeex()
+{
+    if (!SpeexEncoder::isAvailable())
+        QSKIP("Built without Speex");
+
+    QByteArray out;
+    QBENCHMARK {
+        SpeexEncoder encoder(kSampleRate, 16800);
+        out = encoder.encode(m_speech.constData(), m_speech.size());
+        out += encoder.finish();
+    }
+    QVERIFY(!out.isEmpty());
+}
+
+void tst_SpeechBench::parseRealistic()
+{
+    int hypotheses = 0;
+    QBENCHMARK {
+        ResponseParser parser;
+        parser.feed(m_realisticResponse.constData(), m_realisticResponse.size());
+        hypotheses = parser.hypotheses().size();
+    }
+    QCOMPARE(hypotheses, 5);
+}
+
+void tst_SpeechBench::parseWorstCase()
+{
+    int hypotheses = 0;
+    QBENCHMARK {
+        ResponseParser parser;
+        parser.feed(m_worstCaseResponse.constData(), m_worstCaseResponse.size());
+        hypotheses = parser.hypotheses().size();
+    }
+    QCOMPARE(hypotheses, 100);
+}
+
+// The same payload arriving one TCP segment at a time.
+void tst_SpeechBench::parseWorstCaseSegmented()
+{
+    const int segment = 1460;
+    int hypotheses = 0;
+    QBENCHMARK {
+        ResponseParser parser;
+        for (int pos = 0; pos < m_worstCaseResponse.size(); pos += segment)
+            parser.feed(m_worstCaseResponse.constData() + pos,
+                        qMin(segment, m_worstCaseResponse.size() - pos));
+        hypotheses = parser.hypotheses().size();
+    }
+    QCOMPARE(hypotheses, 100);
+}
+
+void tst_SpeechBench::dspToBigEndian()
+{
+    QVector<uchar> out(2 * m_speech.size());
+    QBENCHMARK {
+        Dsp::toBigEndian(m_speech.constData(), m_speech.size(), out.data());
+    }
+    QCOMPARE(qint16((out[2] << 8) | out[3]), m_speech[1]);
+}
+
+void tst_SpeechBench::dspToInt16()
+{
+    QVector<float> in(m_speech.size());
+    Dsp::toFloat(m_speech.constData(), m_speech.size(), in.data());
+    QVector<qint16> out(m_speech.size());
+    QBENCHMARK {
+        Dsp::toInt16(in.constData(), in.size(), out.data());
+    }
+    QVERIFY(out == m_speech);
+}
+
+void tst_SpeechBench::dspFftForward()
+{
+    Fft fft(512);
+    QVector<float> in(512);
+    for (int i = 0; i < 512; ++i)
+        in[i] = m_speech[i];
+    QVector<float> re(257);
+    QVector<float> im(257);
+    QBENCHMARK {
+        fft.forward(in.constData(), re.data(), im.data());
+    }
+    // Bin 0 is the sum of the input.
+    float sum = 0.0f;
+    foreach (float value, in)
+        sum += value;
+    QVERIFY(qAbs(re[0] - sum) <= qAbs(sum) * 1e-4f + 1.0f);
+}
+
+void tst_SpeechBench::dspResample()
+{
+    Resampler resampler(48000, kSampleRate);
+    QVector<qint16> out;
+    out.reserve(kSampleRate + 64);
+    QBENCHMARK {
+        out.resize(0);
+        resampler.process(m_capture48k.constData(), m_capture48k.size(), &out);
+    }
+    QVERIFY(qAbs(out.size() - m_capture48k.size() / 3) <= 64);
+}
+
+void tst_SpeechBench::dspVoiceActivity()
+{
+    QVector<qint16> out;
+    QBENCHMARK {
+        VoiceActivityDetector detector(kSampleRate);
+        out.resize(0);
+        detector.process(m_speech.constData(), m_speech.size(), &out);
+    }
+    QVERIFY(!out.isEmpty());
+}
+
+void tst_SpeechBench::dspNoiseSuppression()
+{
+    NoiseSuppressor suppressor(kSampleRate);
+    QVector<qint16> out;
+    out.reserve(kSampleRate + 512);
+    QBENCHMARK {
+        out.resize(0);
+        suppressor.process(m_speech.constData(), m_speech.size(), &out);
+    }
+    QVERIFY(qAbs(out.size() - m_speech.size()) <= 512);
+}
+
+void tst_SpeechBench::dspMfcc()
+{
+    FrameCounter counter;
+    FeatureExtractor extractor(kSampleRate);
+    extractor.addConsumer(&counter, FeatureExtractor::Mfcc);
+    QBENCHMARK {
+        extractor.reset();
+        counter.frames = 0;
+        extractor.process(m_speech.constData(), m_speech.size());
+    }
+    QVERIFY(counter.frames > 0);
+}
+
+QTEST_GUILESS_MAIN(tst_SpeechBench)
+
+#include "tst_speechbench.moc"
@@ -0,0 +1,28 @@
+TEMPLATE = app
+TARGET = tst_speechbench
+QT += core network testlib
+QT -= gui
+CONFIG += console testcase
+CONFIG -= app_bundle
+
+include(../speechcore.pri)
+
+# The same inputs speechbench times, shared so the numbers compare.
+INCLUDEPATH += ../speechbench
+
+SOURCES += \
+    ../speechbench/benchmarkdata.cpp \
+    ../fft.cpp \
+    ../featureextractor.cpp \
+    ../voiceactivitydetector.cpp \
+    ../noisesuppressor.cpp
+
+HEADERS += \
+    ../speechbench/benchmarkdata.h \
+    ../fft.h \
+    ../featureextractor.h \
+    ../voiceactivitydetector.h \
+    ../noisesuppressor.h
+
+SOURCES += \
+    tst_speechbench.cpp
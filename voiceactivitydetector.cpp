@@ -0,0 +1,193 @@
+#include "voiceactivitydetector.h"
+#include "dspkernels.h"
+
+#include <math.h>
+#include <string.h>
+
+namespace {
+
+// Frames of speech needed before an onset is accepted.
+const int kOnsetFrames = 2;
+// Frames used to seed the noise estimates.
+const int kCalibrationFrames = 10;
+// Highest energy the seeded floor may take, about -45 dBFS: a recording
+// started by a keyword or on a short pre-roll opens on speech.
+const float kMaxInitialNoise = 45.0f;
+
+int nextPowerOfTwo(int value)
+{
+    int result = 1;
+    while (result < value)
+        result <<= 1;
+    return result;
+}
+
+void appendSamples(QVector<qint16> *out, const qint16 *samples, int count)
+{
+    if (count <= 0)
+        return;
+    const int size = out->size();
+    out->resize(size + count);
+    memcpy(out->data() + size, samples, count * sizeof(qint16));
+}
+
+}
+
+VoiceActivityDetector::VoiceActivityDetector(int sampleRate, QObject *parent) :
+    QObject(parent),
+    m_sampleRate(sampleRate),
+    m_frameSize(sampleRate / 50),
+    m_hangover(800),
+    m_padding(sampleRate / 5),
+    m_fft(nextPowerOfTwo(sampleRate / 50)),
+    m_window(sampleRate / 50),
+    m_windowed(m_fft.size()),
+    m_re(m_fft.size() / 2 + 1),
+    m_im(m_fft.size() / 2 + 1),
+    m_power(m_fft.size() / 2 + 1),
+    m_frame(sampleRate / 50),
+    m_frameFill(0)
+{
+    for (int i = 0; i < m_frameSize; ++i)
+        m_window[i] = float(0.5 - 0.5 * cos(2.0 * M_PI * i / (m_frameSize - 1)));
+
+    reset();
+}
+
+int VoiceActivityDetector::hangover() const
+{
+    return m_hangover;
+}
+
+void VoiceActivityDetector::setHangover(int hangover)
+{
+    m_hangover = qMax(hangover, 20);
+}
+
+bool VoiceActivityDetector::isSpeech() const
+{
+    return m_speech;
+}
+
+void VoiceActivityDetector::reset()
+{
+    m_frameFill = 0;
+    m_noiseEnergy = 0.0f;
+    m_noiseFlatness = 0.0f;
+    m_noiseZcr = 0.0f;
+    m_framesSeen = 0;
+    m_speech = false;
+    m_onsetFrames = 0;
+    m_held.clear();
+}
+
+bool VoiceActivityDetector::classify(const qint16 *frame)
+{
+    const float energy = 10.0f * log10f(Dsp::meanSquare(frame, m_frameSize) + 1.0f);
+    const float zcr = float(Dsp::zeroCrossings(frame, m_frameSize)) / m_frameSize;
+
+    Dsp::applyWindow(frame, m_window.constData(), m_frameSize, m_windowed.data());
+    m_fft.forward(m_windowed.constData(), m_re.data(), m_im.data());
+    const int bins = m_fft.size() / 2;
+    Dsp::powerSpectrum(m_re.constData() + 1, m_im.constData() + 1, bins, m_power.data());
+    const float flatness = Dsp::spectralFlatness(m_power.constData(), bins);
+
+    if (m_framesSeen < kCalibrationFrames) {
+        // The quietest frame rather than the mean, so speech in the first
+        // frames does not become the floor.
+        const float floor = m_framesSeen ? qMin(m_noiseEnergy, energy) : energy;
+        m_noiseEnergy = qMin(floor, kMaxInitialNoise);
+        const float weight = 1.0f / (m_framesSeen + 1);
+        m_noiseFlatness += (flatness - m_noiseFlatness) * weight;
+        m_noiseZcr += (zcr - m_noiseZcr) * weight;
+        ++m_framesSeen;
+        // The shape of the noise is not known yet, so only loudness counts.
+        return energy > m_noiseEnergy + 20.0f;
+    }
+
+    // Energy has to rise above the floor; the spectral shape or crossing
+    // rate has to differ from the noise as well, unless the frame is loud.
+    const bool loud = energy > m_noiseEnergy + 9.0f;
+    const bool veryLoud = energy > m_noiseEnergy + 20.0f;
+    const bool tonal = m_noiseFlatness - flatness > 0.15f;
+    const bool zcrShift = fabsf(zcr - m_noiseZcr) > 0.1f;
+    const bool speech = loud && (veryLoud || tonal || zcrShift);
+
+    if (energy < m_noiseEnergy) {
+        // Follow a falling noise floor quickly, a rising one slowly.
+        m_noiseEnergy += (energy - m_noiseEnergy) * 0.3f;
+    } else if (!speech) {
+        m_noiseEnergy += (energy - m_noiseEnergy) * 0.02f;
+    }
+    if (!speech) {
+        m_noiseFlatness += (flatness - m_noiseFlatness) * 0.05f;
+        m_noiseZcr += (zcr - m_noiseZcr) * 0.05f;
+    }
+
+    return speech;
+}
+
+void VoiceActivityDetector::process(const qint16 *samples, int count, QVector<qint16> *out)
+{
+    while (count > 0) {
+        const int take = qMin(count, m_frameSize - m_frameFill);
+        memcpy(m_frame.data() + m_frameFill, samples, take * sizeof(qint16));
+        m_frameFill += take;
+        samples += take;
+        count -= take;
+
+        if (m_frameFill < m_frameSize)
+            break;
+        m_frameFill = 0;
+
+        const qint16 *frame = m_frame.constData();
+        const bool speech = classify(frame);
+        m_onsetFrames = speech ? m_onsetFrames + 1 : 0;
+
+        if (!m_speech) {
+            // Keep a short pad of what came before the onset.
+            appendSamples(&m_held, frame, m_frameSize);
+            if (m_held.size() > m_padding)
+                m_held.remove(0, m_held.size() - m_padding);
+
+            if (m_onsetFrames >= kOnsetFrames) {
+                m_speech = true;
+                *out += m_held;
+                m_held.clear();
+                emit speechStarted();
+            }
+        } else if (speech) {
+            *out += m_held;
+            m_held.clear();
+            appendSamples(out, frame, m_frameSize);
+        } else {
+            holdSilence(frame, out);
+        }
+    }
+}
+
+void VoiceActivityDetector::holdSilence(const qint16 *frame, QVector<qint16> *out)
+{
+    appendSamples(&m_held, frame, m_frameSize);
+    if (m_held.size() < qint64(m_hangover) * m_sampleRate / 1000)
+        return;
+
+    // The pause outlasted the hangover: keep a trailing pad, drop the rest
+    // and start collecting pre-onset pad for whatever comes next.
+    const int pad = qMin(m_padding, m_held.size() / 2);
+    appendSamples(out, m_held.constData(), pad);
+    m_held.remove(0, m_held.size() - pad);
+    m_speech = false;
+    m_onsetFrames = 0;
+    emit endOfSpeech();
+}
+
+void VoiceActivityDetector::flush(QVector<qint16> *out)
+{
+    if (m_speech) {
+        appendSamples(&m_held, m_frame.constData(), m_frameFill);
+        appendSamples(out, m_held.constData(), qMin(m_padding, m_held.size()));
+    }
+    m_held.clear();
+    m_frameFill = 0;
+}
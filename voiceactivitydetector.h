@@ -0,0 +1,71 @@
+#ifndef VOICEACTIVITYDETECTOR_H
+#define VOICEACTIVITYDETECTOR_H
+
+#include <QObject>
+#include <QVector>
+
+#include "fft.h"
+
+// Classifies 20 ms frames as speech or silence from their energy, zero
+// crossing rate and spectral flatness, each compared against a running
+// estimate of the background noise. Used as a pipeline stage it also trims
+// silence: leading silence is dropped, pauses longer than the hangover are
+// cut to a short pad, and endOfSpeech() fires once the hangover expires.
+class VoiceActivityDetector : public QObject
+{
+    Q_OBJECT
+
+public:
+    VoiceActivityDetector(int sampleRate, QObject *parent = 0);
+
+    // Milliseconds of silence after speech before it counts as ended.
+    int hangover() const;
+    void setHangover(int hangover);
+
+    bool isSpeech() const;
+
+    // Appends the samples worth keeping to |out|. Silence is held back
+    // until it is known whether speech resumes, so output may lag input
+    // by up to the hangover during pauses, but never during speech.
+    void process(const qint16 *samples, int count, QVector<qint16> *out);
+
+    // Releases the trailing pad at the end of the recording.
+    void flush(QVector<qint16> *out);
+
+    void reset();
+
+Q_SIGNALS:
+    void speechStarted();
+    void endOfSpeech();
+
+private:
+    bool classify(const qint16 *frame);
+    void holdSilence(const qint16 *frame, QVector<qint16> *out);
+
+    int m_sampleRate;
+    int m_frameSize;
+    int m_hangover;
+    int m_padding;
+
+    Fft m_fft;
+    QVector<float> m_window;
+    QVector<float> m_windowed;
+    QVector<float> m_re;
+    QVector<float> m_im;
+    QVector<float> m_power;
+
+    QVector<qint16> m_frame;
+    int m_frameFill;
+
+    // Running noise estimates.
+    float m_noiseEnergy;
+    float m_noiseFlatness;
+    float m_noiseZcr;
+    int m_framesSeen;
+
+    bool m_speech;
+    int m_onsetFrames;
+    QVector<qint16> m_held;
+};
+
+#endif // VOICEACTIVITYDETECTOR_H